@@ -0,0 +1,126 @@
+#include "assetcache.hh"
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <sys/stat.h>
+
+static constexpr uint64_t kFnvOffsetBasis = 14695981039346656037ull;
+static constexpr uint64_t kFnvPrime = 1099511628211ull;
+
+struct AssetBlobHeader
+{
+	char m_magic[4]; // "RKBL"
+	uint32_t m_version;
+	uint64_t m_size;
+};
+
+static const char kAssetBlobMagic[4] = { 'R', 'K', 'B', 'L' };
+static constexpr uint32_t kAssetBlobVersion = 1;
+
+////////////////////////////////////////////////////////////////////////////////
+AssetKey::AssetKey()
+	: m_hash(kFnvOffsetBasis)
+{
+}
+
+void AssetKey::Add(const void* data, size_t size)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	uint64_t hash = m_hash;
+	for(size_t i = 0; i < size; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= kFnvPrime;
+	}
+	m_hash = hash;
+}
+
+// with the terminator, so "ab" + "c" and "a" + "bc" differ
+void AssetKey::AddString(const char* str)
+{
+	Add(str, strlen(str) + 1);
+}
+
+bool AssetKey::AddFile(const char* filename)
+{
+	FILE* fp = fopen(filename, "rb");
+	if(!fp)
+		return false;
+	char buffer[4096];
+	size_t size = 0, read;
+	while((read = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+	{
+		Add(buffer, read);
+		size += read;
+	}
+	const bool ok = !ferror(fp);
+	fclose(fp);
+	Add(size);
+	return ok;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+std::string assetcache_GetPath(const AssetKey& key, const char* suffix)
+{
+	if(mkdir(kAssetCacheDir, 0755) != 0 && errno != EEXIST)
+		std::cerr << "failed to create " << kAssetCacheDir << std::endl;
+	char name[17];
+	snprintf(name, sizeof(name), "%016" PRIx64, key.Get());
+	return std::string(kAssetCacheDir) + "/" + name + suffix;
+}
+
+bool assetcache_Exists(const std::string& path)
+{
+	struct stat st;
+	return stat(path.c_str(), &st) == 0;
+}
+
+bool assetcache_WriteBlob(const std::string& path, const void* data, size_t size)
+{
+	AssetBlobHeader header;
+	memcpy(header.m_magic, kAssetBlobMagic, sizeof(kAssetBlobMagic));
+	header.m_version = kAssetBlobVersion;
+	header.m_size = size;
+
+	const std::string tempName = path + ".tmp";
+	FILE* fp = fopen(tempName.c_str(), "wb");
+	if(!fp)
+	{
+		std::cerr << "failed to open " << tempName << " for writing" << std::endl;
+		return false;
+	}
+	bool ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+		(size == 0 || fwrite(data, size, 1, fp) == 1);
+	ok = fclose(fp) == 0 && ok;
+	if(!ok || rename(tempName.c_str(), path.c_str()) != 0)
+	{
+		std::cerr << "failed to write " << path << std::endl;
+		remove(tempName.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool assetcache_ReadBlob(const std::string& path, void* data, size_t size)
+{
+	FILE* fp = fopen(path.c_str(), "rb");
+	if(!fp)
+	{
+		if(errno != ENOENT)
+			std::cerr << "failed to open cached asset " << path << std::endl;
+		return false;
+	}
+	AssetBlobHeader header;
+	bool ok = fread(&header, sizeof(header), 1, fp) == 1 &&
+		memcmp(header.m_magic, kAssetBlobMagic, sizeof(kAssetBlobMagic)) == 0 &&
+		header.m_version == kAssetBlobVersion &&
+		header.m_size == size &&
+		(size == 0 || fread(data, size, 1, fp) == 1);
+	fclose(fp);
+	if(!ok)
+		std::cerr << "cached asset " << path << " is corrupt, or the wrong size" << std::endl;
+	return ok;
+}
+
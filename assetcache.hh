@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+////////////////////////////////////////////////////////////////////////////////
+// Asset cache
+// Generated assets kept on disk in kAssetCacheDir, named by a hash of
+// everything that went into making them. Changing any input gives the asset a
+// new name, so nothing is ever invalidated; old files are left behind until
+// the directory is deleted.
+
+static const char* const kAssetCacheDir = "cache";
+
+// 64 bit FNV-1a of whatever's added. Values are added as their bytes, so
+// they shouldn't have padding.
+class AssetKey
+{
+public:
+	AssetKey();
+
+	void Add(const void* data, size_t size);
+	template<class T> void Add(const T& value) { Add(&value, sizeof(value)); }
+	void AddString(const char* str);
+	// the file's contents, false if it can't be read
+	bool AddFile(const char* filename);
+
+	uint64_t Get() const { return m_hash; }
+private:
+	uint64_t m_hash;
+};
+
+// kAssetCacheDir/<key in hex><suffix>, creating the directory if needed.
+std::string assetcache_GetPath(const AssetKey& key, const char* suffix);
+bool assetcache_Exists(const std::string& path);
+
+// Blobs are size bytes of anything, after a header that checks the size.
+// Writes go to a temporary that's renamed over path, so a reader never sees
+// half a blob. Reading a blob that isn't there fails quietly, that's a miss;
+// any other failure is reported to std::cerr. Assets made of several files
+// should check they all exist first, so a partial set is a quiet miss too.
+bool assetcache_WriteBlob(const std::string& path, const void* data, size_t size);
+bool assetcache_ReadBlob(const std::string& path, void* data, size_t size);
+
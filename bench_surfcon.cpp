@@ -0,0 +1,260 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include "common.hh"
+#include "surfcon.hh"
+#include "mesh.hh"
+#include "meshsimplify.hh"
+#include "noise.hh"
+#include "task.hh"
+#include "timer.hh"
+
+////////////////////////////////////////////////////////////////////////////////
+// Contouring benchmark
+// Times the mesh pipeline on analytic fields and writes one JSON object per
+// line per stage, so runs can be diffed to catch regressions. Needs no GL, SDL
+// or OpenCL; build it with 'make bench_surfcon config=release'.
+//
+// usage: bench_surfcon [-o results.jsonl] [-min dim] [-max dim] [-field name]
+// Results go to bench_surfcon.jsonl by default, or stdout with '-o -'; the 
+// contourers log to stdout too.
+//
+// Stages:
+//   contour           serial tetrahedra; vertices are deduplicated as they're
+//                     made, through the edge cache
+//   contour_parallel  SURFCON_Parallel, which also welds the slabs' shared vertices
+//   normals           TriSoup::ComputeNormals
+//   cachesort         TriSoup::CacheSort(32); ACMR/ATVR before and after go to
+//                     stdout
+//   pack              CreateGeom's CPU side, packing 16 bit indices, and 
+//                     splitting meshes too big for them into submeshes
+//   pack_vertices     TriSoup::PackVertices to TRISOUP_VertexPacked8
+//   meshlets          TriSoup::BuildMeshlets, with the renderer's sizes
+//   simplify          mesh_Simplify to 15% of the faces; verts and tris are
+//                     the simplified mesh's
+//   save              TriSoup::Save in TRISOUP_VertexPacked8, to kMeshFileName
+//   load              TriSoup::Load of that file; meshfile_Map alone, which is
+//                     all the renderer needs, is too quick to be worth a stage
+// peak_rss_kb is the process's peak so far, so it only grows over a run.
+
+static constexpr float kIsolevel = 0.f;
+static constexpr float kSimplifyRatio = 0.15f;
+static const char* kMeshFileName = "bench_surfcon.mesh";
+
+typedef std::function<float(const vec3& p)> BenchFieldFunc;
+
+struct BenchField
+{
+	const char* m_name;
+	BenchFieldFunc m_func;
+};
+
+struct BenchResult
+{
+	const char* m_field;
+	int m_dim;
+	const char* m_stage;
+	float m_seconds;
+	int m_verts;
+	int m_tris;
+};
+
+static long bench_PeakRssKb()
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss;
+}
+
+// Samples func over [-1,1]^3, the same box the contourers map the field to.
+static std::vector<float> bench_CreateField(const BenchFieldFunc& func, int dim)
+{
+	std::vector<float> field(size_t(dim) * dim * dim);
+	const float scale = 2.f / (dim - 1);
+	task_ParallelFor(dim, [&](int z) {
+		float* slice = &field[size_t(z) * dim * dim];
+		for(int y = 0; y < dim; ++y)
+			for(int x = 0; x < dim; ++x)
+				slice[x + dim * y] = func(vec3(x, y, z) * scale - vec3(1.f));
+	});
+	return field;
+}
+
+// runs func, several times for small fields, and returns the fastest time
+static float bench_Time(int dim, const std::function<void()>& func)
+{
+	const int reps = dim <= 64 ? 5 : 1;
+	float best = 0.f;
+	for(int i = 0; i < reps; ++i)
+	{
+		Timer timer;
+		timer.Start();
+		func();
+		timer.Stop();
+		const float t = timer.GetTime();
+		if(i == 0 || t < best)
+			best = t;
+	}
+	return best;
+}
+
+static void bench_Write(FILE* out, const BenchResult& result)
+{
+	const double cells = double(result.m_dim - 1) * (result.m_dim - 1) * (result.m_dim - 1);
+	const double seconds = Max(result.m_seconds, 1e-6f);
+	fprintf(out, "{\"field\":\"%s\",\"dim\":%d,\"stage\":\"%s\",\"seconds\":%.6f,"
+		"\"cells_per_s\":%.0f,\"tris_per_s\":%.0f,\"verts\":%d,\"tris\":%d,\"peak_rss_kb\":%ld}\n",
+		result.m_field, result.m_dim, result.m_stage, result.m_seconds,
+		cells / seconds, result.m_tris / seconds,
+		result.m_verts, result.m_tris, bench_PeakRssKb());
+	fflush(out);
+}
+
+static void bench_Run(FILE* out, const BenchField& benchField, int dim)
+{
+	std::vector<float> field = bench_CreateField(benchField.m_func, dim);
+	auto record = [&](const char* stage, float seconds, const TriSoup& mesh) {
+		bench_Write(out, BenchResult{benchField.m_name, dim, stage, seconds,
+			mesh.NumVertices(), mesh.NumFaces()});
+	};
+
+	std::shared_ptr<TriSoup> mesh;
+	float t = bench_Time(dim, [&]() {
+		mesh = surfcon_CreateMeshFromDensityField(kIsolevel, &field[0], dim, dim, dim, 0);
+	});
+	record("contour", t, *mesh);
+
+	t = bench_Time(dim, [&]() {
+		mesh = surfcon_CreateMeshFromDensityField(kIsolevel, &field[0], dim, dim, dim, SURFCON_Parallel);
+	});
+	record("contour_parallel", t, *mesh);
+
+	// the later stages work on the mesh in place, so each rep gets a fresh copy
+	std::vector<float>().swap(field);
+	TriSoup work;
+	t = bench_Time(dim, [&]() {
+		work = *mesh;
+		work.ComputeNormals();
+	});
+	record("normals", t, *mesh);
+
+	TriSoup::CacheSortStats cacheStats;
+	t = bench_Time(dim, [&]() {
+		work = *mesh;
+		cacheStats = work.CacheSort(32);
+	});
+	record("cachesort", t, *mesh);
+	printf("cache sort: acmr %.3f -> %.3f, atvr %.3f -> %.3f\n",
+		cacheStats.m_before.m_acmr, cacheStats.m_after.m_acmr,
+		cacheStats.m_before.m_atvr, cacheStats.m_after.m_atvr);
+
+	std::vector<unsigned short> indices;
+	std::vector<float> vertices;
+	std::vector<TriSoup::Submesh> submeshes;
+	t = bench_Time(dim, [&]() {
+		const int maxVertices = std::numeric_limits<unsigned short>::max();
+		if(mesh->NumVertices() <= maxVertices)
+			mesh->PackIndices(indices);
+		else
+			mesh->PackSubmeshes(maxVertices, mesh->NumFaces(), vertices, indices, submeshes);
+	});
+	record("pack", t, *mesh);
+
+	std::vector<unsigned char> packed;
+	const AABB bounds = mesh->ComputeBounds();
+	t = bench_Time(dim, [&]() {
+		TriSoup::PackVertices(mesh->GetVertexData(), mesh->NumVertices(), 
+			TRISOUP_VertexPacked8, bounds, packed);
+	});
+	record("pack_vertices", t, *mesh);
+
+	std::vector<TriSoup::Meshlet> meshlets;
+	t = bench_Time(dim, [&]() {
+		mesh->BuildMeshlets(TriSoup::kMeshletMaxVertices, TriSoup::kMeshletMaxFaces, 
+			vertices, indices, meshlets);
+	});
+	record("meshlets", t, *mesh);
+
+	std::shared_ptr<TriSoup> simplified;
+	t = bench_Time(dim, [&]() {
+		simplified = mesh_Simplify(*mesh, kSimplifyRatio);
+	});
+	record("simplify", t, *simplified);
+
+	t = bench_Time(dim, [&]() {
+		mesh->Save(kMeshFileName, TRISOUP_VertexPacked8);
+	});
+	record("save", t, *mesh);
+
+	std::shared_ptr<TriSoup> loaded;
+	t = bench_Time(dim, [&]() {
+		loaded = TriSoup::Load(kMeshFileName);
+	});
+	remove(kMeshFileName);
+	if(loaded)
+		record("load", t, *loaded);
+}
+
+int main(int argc, char** argv)
+{
+	const char* outName = "bench_surfcon.jsonl";
+	const char* onlyField = nullptr;
+	int minDim = 32, maxDim = 512;
+	for(int i = 1; i < argc; ++i)
+	{
+		if(strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+			outName = argv[++i];
+		else if(strcmp(argv[i], "-min") == 0 && i + 1 < argc)
+			minDim = atoi(argv[++i]);
+		else if(strcmp(argv[i], "-max") == 0 && i + 1 < argc)
+			maxDim = atoi(argv[++i]);
+		else if(strcmp(argv[i], "-field") == 0 && i + 1 < argc)
+			onlyField = argv[++i];
+		else
+		{
+			fprintf(stderr, "usage: %s [-o results.jsonl] [-min dim] [-max dim] [-field name]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	FILE* out = stdout;
+	if(strcmp(outName, "-") != 0)
+	{
+		out = fopen(outName, "w");
+		if(!out)
+		{
+			fprintf(stderr, "failed to open %s\n", outName);
+			return 1;
+		}
+	}
+
+	Noise noise(1234);
+	const BenchField fields[] = {
+		{ "sphere", [](const vec3& p) { return Length(p) - 0.8f; } },
+		{ "torus", [](const vec3& p) {
+			const float ring = sqrtf(p.x*p.x + p.y*p.y) - 0.6f;
+			return sqrtf(ring*ring + p.z*p.z) - 0.25f;
+		} },
+		{ "fbm", [&noise](const vec3& p) {
+			// Noise wants positive coordinates
+			return Length(p) - 0.7f + 0.25f * noise.FbmSample(2.f * p + vec3(4.f), 0.8f, 2.f, 5.f);
+		} },
+	};
+
+	for(const BenchField& field: fields)
+	{
+		if(onlyField && strcmp(onlyField, field.m_name) != 0)
+			continue;
+		for(int dim = minDim; dim <= maxDim; dim *= 2)
+			bench_Run(out, field, dim);
+	}
+
+	if(out != stdout)
+		fclose(out);
+	return 0;
+}
@@ -0,0 +1,184 @@
+#include <algorithm>
+#include <vector>
+#include "common.hh"
+#include "chunks.hh"
+#include "camera.hh"
+#include "mesh.hh"
+#include "render.hh"
+#include "task.hh"
+
+////////////////////////////////////////////////////////////////////////////////
+// Rough size of a chunk's mesh: the TriSoup keeps a position and normal per
+// vertex and a face per triangle, and the Geom keeps a copy of both.
+static size_t chunk_MeshMemory(const TriSoup& mesh)
+{
+	const size_t vertexBytes = mesh.NumVertices() * 2 * sizeof(vec3);
+	const size_t indexBytes = mesh.NumFaces() * 3 * sizeof(int);
+	return 2 * (vertexBytes + indexBytes);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+ChunkCache::ChunkCache(float chunkSize, int samplesPerSide, const GenerateFunc& generate)
+	: m_chunkSize(chunkSize)
+	, m_samplesPerSide(samplesPerSide)
+	, m_generate(generate)
+	, m_viewRadius(3)
+	, m_memoryBudget(64 * 1024 * 1024)
+	, m_memoryUsed(0)
+	, m_maxPending(4)
+	, m_updateCount(0)
+	, m_generation(0)
+	, m_chunks()
+	, m_lru()
+	, m_pending()
+{
+}
+
+ChunkCoord ChunkCache::CoordOf(const vec3& pos) const
+{
+	const vec3 scaled = pos / m_chunkSize;
+	return ChunkCoord{ int(floorf(scaled.x)), int(floorf(scaled.y)), int(floorf(scaled.z)) };
+}
+
+vec3 ChunkCache::OriginOf(const ChunkCoord& coord) const
+{
+	return m_chunkSize * vec3(coord.x, coord.y, coord.z);
+}
+
+void ChunkCache::Update(const vec3& viewPos)
+{
+	++m_updateCount;
+
+	// chunks within the view radius, nearest first
+	const ChunkCoord center = CoordOf(viewPos);
+	const int radius = m_viewRadius;
+	std::vector<std::pair<int, ChunkCoord>> inRange;
+	for(int dz = -radius; dz <= radius; ++dz)
+	for(int dy = -radius; dy <= radius; ++dy)
+	for(int dx = -radius; dx <= radius; ++dx)
+	{
+		const int distSq = dx*dx + dy*dy + dz*dz;
+		if(distSq <= radius * radius)
+			inRange.push_back(std::make_pair(distSq,
+				ChunkCoord{ center.x + dx, center.y + dy, center.z + dz }));
+	}
+	std::sort(inRange.begin(), inRange.end());
+
+	for(const auto& entry: inRange)
+	{
+		const ChunkCoord& coord = entry.second;
+		auto found = m_chunks.find(coord);
+		if(found != m_chunks.end())
+		{
+			Chunk& chunk = found->second;
+			chunk.m_lastSeen = m_updateCount;
+			m_lru.splice(m_lru.begin(), m_lru, chunk.m_lruPos);
+		}
+		else if(m_pending.count(coord) == 0 &&
+			int(m_pending.size()) < m_maxPending &&
+			m_memoryUsed < m_memoryBudget)
+		{
+			Request(coord);
+		}
+	}
+
+	Evict();
+}
+
+void ChunkCache::Request(const ChunkCoord& coord)
+{
+	struct ChunkGenData {
+		std::shared_ptr<TriSoup> m_mesh;
+	};
+
+	m_pending.insert(coord);
+	auto data = std::make_shared<ChunkGenData>();
+	const GenerateFunc generate = m_generate;
+	const vec3 origin = OriginOf(coord);
+	const float chunkSize = m_chunkSize;
+	const unsigned int generation = m_generation;
+
+	auto runFunc = [data, generate, origin, chunkSize]() {
+		data->m_mesh = generate(origin, chunkSize);
+	};
+
+	auto completeFunc = [this, data, coord, generation]() {
+		if(generation != m_generation)
+			return;
+		m_pending.erase(coord);
+		Insert(coord, data->m_mesh);
+	};
+
+	task_AppendTask(std::make_shared<Task>(nullptr, completeFunc, runFunc));
+}
+
+void ChunkCache::Insert(const ChunkCoord& coord, const std::shared_ptr<TriSoup>& mesh)
+{
+	Chunk chunk;
+	chunk.m_memory = sizeof(Chunk);
+	if(mesh && mesh->NumFaces() > 0)
+	{
+		chunk.m_mesh = mesh;
+		chunk.m_geom = mesh->CreateGeom();
+		chunk.m_memory += chunk_MeshMemory(*mesh);
+	}
+	// empty chunks stay cached too, so they aren't generated again
+	chunk.m_lastSeen = m_updateCount;
+	chunk.m_lruPos = m_lru.insert(m_lru.begin(), coord);
+	m_memoryUsed += chunk.m_memory;
+	m_chunks[coord] = chunk;
+}
+
+void ChunkCache::Evict()
+{
+	// chunks in range this update are never evicted, so a budget smaller than
+	// the view radius needs stops new requests rather than thrashing
+	while(m_memoryUsed > m_memoryBudget && !m_lru.empty())
+	{
+		auto found = m_chunks.find(m_lru.back());
+		ASSERT(found != m_chunks.end());
+		if(found->second.m_lastSeen == m_updateCount)
+			break;
+		m_memoryUsed -= found->second.m_memory;
+		m_chunks.erase(found);
+		m_lru.pop_back();
+	}
+}
+
+void ChunkCache::Draw(const Camera& camera, const DrawFunc& draw) const
+{
+	const mat4& view = camera.GetView();
+	const float halfSize = 0.5f * m_chunkSize;
+	const float radius = halfSize * sqrtf(3.f);
+	// mesh space sample i is -1 + 2i/samplesPerSide, world space origin + i*spacing
+	const float spacing = m_chunkSize / (m_samplesPerSide - 1);
+	const mat4 meshToChunk = MakeScale(vec3(0.5f * spacing * m_samplesPerSide)) * 
+		MakeTranslation(vec3(1.f));
+	for(const auto& entry: m_chunks)
+	{
+		const Chunk& chunk = entry.second;
+		if(!chunk.m_geom)
+			continue;
+
+		// bounding sphere against the view space frustum planes
+		const vec3 center = OriginOf(entry.first) + vec3(halfSize);
+		const vec3 viewCenter = TransformPoint(view, center);
+		bool visible = true;
+		for(int i = FRUSTUM_Near; visible && i <= FRUSTUM_Bottom; ++i)
+			visible = PlaneDist(camera.GetFrustum(i), viewCenter) >= -radius;
+		if(!visible)
+			continue;
+
+		draw(MakeTranslation(OriginOf(entry.first)) * meshToChunk, *chunk.m_geom);
+	}
+}
+
+void ChunkCache::Clear()
+{
+	++m_generation;
+	m_chunks.clear();
+	m_lru.clear();
+	m_pending.clear();
+	m_memoryUsed = 0;
+}
+
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <list>
+#include <map>
+#include <set>
+#include <memory>
+#include <functional>
+#include "vec.hh"
+#include "matrix.hh"
+
+class Camera;
+class Geom;
+class TriSoup;
+
+struct ChunkCoord
+{
+	int x, y, z;
+	bool operator<(const ChunkCoord& o) const {
+		if(z != o.z) return z < o.z;
+		if(y != o.y) return y < o.y;
+		return x < o.x;
+	}
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// ChunkCache
+// Tiles space into cubes of chunkSize and keeps meshes for the cubes around
+// the viewer. Missing chunks are generated on the task system, nearest first,
+// and the chunks that have been out of range longest are dropped once the
+// cached meshes go over the memory budget.
+class ChunkCache
+{
+public:
+	// Runs on a worker thread. Returns the mesh of the chunk whose lowest
+	// corner is at origin, or null if it's empty. The mesh is surfcon's
+	// contour of a samplesPerSide^3 field sampling the chunk corner to corner,
+	// so sample i is at -1 + 2i/samplesPerSide, and the last one falls short
+	// of 1; Draw maps the samples back onto the chunk's lattice.
+	typedef std::function<std::shared_ptr<TriSoup>(const vec3& origin, float chunkSize)> GenerateFunc;
+	typedef std::function<void(const mat4& model, Geom& geom)> DrawFunc;
+
+	ChunkCache(float chunkSize, int samplesPerSide, const GenerateFunc& generate);
+
+	void SetViewRadius(int chunks) { m_viewRadius = chunks; }
+	void SetMemoryBudget(size_t bytes) { m_memoryBudget = bytes; }
+	void SetMaxPending(int tasks) { m_maxPending = tasks; }
+	// only affects chunks requested after the call; Clear to regenerate the rest
+	void SetGenerateFunc(const GenerateFunc& generate) { m_generate = generate; }
+
+	// Requests missing chunks around viewPos and evicts over budget. Call
+	// once a frame from the main thread.
+	void Update(const vec3& viewPos);
+
+	// Calls draw for each cached chunk in the camera's frustum.
+	void Draw(const Camera& camera, const DrawFunc& draw) const;
+
+	// Drops every chunk, for when the generator's parameters change. Chunks
+	// still being generated are discarded when they finish.
+	void Clear();
+
+	size_t GetMemoryUsed() const { return m_memoryUsed; }
+	int NumChunks() const { return m_chunks.size(); }
+	int NumPending() const { return m_pending.size(); }
+private:
+	struct Chunk
+	{
+		std::shared_ptr<TriSoup> m_mesh;
+		std::shared_ptr<Geom> m_geom;
+		size_t m_memory;
+		unsigned int m_lastSeen; // m_updateCount when last in range
+		std::list<ChunkCoord>::iterator m_lruPos;
+	};
+
+	ChunkCoord CoordOf(const vec3& pos) const;
+	vec3 OriginOf(const ChunkCoord& coord) const;
+	void Request(const ChunkCoord& coord);
+	void Insert(const ChunkCoord& coord, const std::shared_ptr<TriSoup>& mesh);
+	void Evict();
+
+	float m_chunkSize;
+	int m_samplesPerSide;
+	GenerateFunc m_generate;
+	int m_viewRadius;
+	size_t m_memoryBudget;
+	size_t m_memoryUsed;
+	int m_maxPending;
+	unsigned int m_updateCount;
+	unsigned int m_generation; // bumped by Clear so stale results are dropped
+	std::map<ChunkCoord, Chunk> m_chunks;
+	std::list<ChunkCoord> m_lru; // most recently in range first
+	std::set<ChunkCoord> m_pending;
+};
+
@@ -0,0 +1,149 @@
+#include <iostream>
+#include <vector>
+#include "common.hh"
+#include "clcontour.hh"
+#include "compute.hh"
+#include "mesh.hh"
+
+////////////////////////////////////////////////////////////////////////////////
+// Total of a count array from its exclusive scan: the last offset plus the
+// last count, or plus 1 if it's nonzero for a scan made with countNonZero.
+static unsigned int clcontour_ReadTotal(const ComputeBuffer* counts, 
+	const ComputeBuffer* offsets, unsigned int num, bool countNonZero = false)
+{
+	unsigned int last[2] = {};
+	const size_t lastOffset = sizeof(unsigned int) * (num - 1);
+	counts->EnqueueRead(lastOffset, sizeof(unsigned int), &last[0]);
+	ComputeEvent ev = offsets->EnqueueRead(lastOffset, sizeof(unsigned int), &last[1]);
+	compute_WaitForEvent(ev);
+	if(countNonZero)
+		last[0] = last[0] ? 1 : 0;
+	return last[0] + last[1];
+}
+
+std::shared_ptr<TriSoup> clcontour_CreateMeshFromDensityBuffer(
+	ComputeProgram* program,
+	const ComputeBuffer* densityField,
+	float isolevel,
+	unsigned int width, unsigned int height, unsigned int depth)
+{
+	if(width < 2 || height < 2 || depth < 2)
+	{
+		std::cerr << "can't contour a " << width << "x" << height << "x" << depth << 
+			" field" << std::endl;
+		return nullptr;
+	}
+
+	const unsigned int numPoints = width * height * depth;
+	const unsigned int numCells = (width - 1) * (height - 1) * (depth - 1);
+	const int dims[3] = { int(width), int(height), int(depth) };
+	const float smallestSide = Min(Min(width,height),depth);
+	const float inc = 2.0 / smallestSide;
+	const vec3 startPt = -vec3(width,height,depth) / smallestSide;
+
+	// classify
+	auto vertexCounts = compute_CreateBufferRW(sizeof(unsigned int) * numPoints);
+	auto edgeMasks = compute_CreateBufferRW(sizeof(unsigned char) * numPoints);
+	auto triCounts = compute_CreateBufferRW(sizeof(unsigned int) * numCells);
+	if(!vertexCounts || !edgeMasks || !triCounts)
+		return nullptr;
+
+	auto classifyPoints = program->CreateKernel("classifyContourPoints");
+	classifyPoints->SetArg(0, densityField);
+	classifyPoints->SetArg(1, vertexCounts.get());
+	classifyPoints->SetArg(2, edgeMasks.get());
+	classifyPoints->SetArgVal(3, isolevel);
+	for(int i = 0; i < 3; ++i)
+		classifyPoints->SetArgVal(4 + i, dims[i]);
+	classifyPoints->Enqueue(3, (const size_t[]){width, height, depth});
+
+	auto classifyCells = program->CreateKernel("classifyContourCells");
+	classifyCells->SetArg(0, densityField);
+	classifyCells->SetArg(1, triCounts.get());
+	classifyCells->SetArgVal(2, isolevel);
+	for(int i = 0; i < 3; ++i)
+		classifyCells->SetArgVal(3 + i, dims[i]);
+	classifyCells->Enqueue(3, (const size_t[]){width - 1, height - 1, depth - 1});
+
+	// scan, for where each point's vertices and each cell's triangles go, and
+	// the slots of the points and cells that have any
+	auto vertexOffsets = compute_CreateBufferRW(sizeof(unsigned int) * numPoints);
+	auto pointSlots = compute_CreateBufferRW(sizeof(unsigned int) * numPoints);
+	auto triOffsets = compute_CreateBufferRW(sizeof(unsigned int) * numCells);
+	auto cellSlots = compute_CreateBufferRW(sizeof(unsigned int) * numCells);
+	compute_ScanBuffer(vertexCounts.get(), vertexOffsets.get(), numPoints);
+	compute_ScanBuffer(vertexCounts.get(), pointSlots.get(), numPoints, true);
+	compute_ScanBuffer(triCounts.get(), triOffsets.get(), numCells);
+	compute_ScanBuffer(triCounts.get(), cellSlots.get(), numCells, true);
+
+	const unsigned int numVertices = clcontour_ReadTotal(vertexCounts.get(), vertexOffsets.get(), numPoints);
+	const unsigned int numTris = clcontour_ReadTotal(triCounts.get(), triOffsets.get(), numCells);
+	std::shared_ptr<TriSoup> result = std::make_shared<TriSoup>();
+	if(numTris == 0)
+		return result;
+	const unsigned int numActivePoints = clcontour_ReadTotal(vertexCounts.get(), pointSlots.get(), numPoints, true);
+	const unsigned int numActiveCells = clcontour_ReadTotal(triCounts.get(), cellSlots.get(), numCells, true);
+
+	// compact
+	auto activePoints = compute_CreateBufferRW(sizeof(unsigned int) * numActivePoints);
+	auto activeCells = compute_CreateBufferRW(sizeof(unsigned int) * numActiveCells);
+	auto compact = program->CreateKernel("compactContourItems");
+	compact->SetArg(0, vertexCounts.get());
+	compact->SetArg(1, pointSlots.get());
+	compact->SetArg(2, activePoints.get());
+	compact->Enqueue(1, (const size_t[]){numPoints});
+	compact->SetArg(0, triCounts.get());
+	compact->SetArg(1, cellSlots.get());
+	compact->SetArg(2, activeCells.get());
+	compact->Enqueue(1, (const size_t[]){numCells});
+
+	// generate
+	auto vertices = compute_CreateBufferWO(sizeof(float) * 6 * numVertices);
+	auto indices = compute_CreateBufferWO(sizeof(unsigned int) * 3 * numTris);
+
+	auto generateVertices = program->CreateKernel("generateContourVertices");
+	generateVertices->SetArg(0, densityField);
+	generateVertices->SetArg(1, edgeMasks.get());
+	generateVertices->SetArg(2, vertexOffsets.get());
+	generateVertices->SetArg(3, activePoints.get());
+	generateVertices->SetArg(4, vertices.get());
+	generateVertices->SetArgVal(5, isolevel);
+	for(int i = 0; i < 3; ++i)
+		generateVertices->SetArgVal(6 + i, dims[i]);
+	generateVertices->SetArg(9, sizeof(cl_float3), (cl_float3[]){{{startPt.x, startPt.y, startPt.z}}});
+	generateVertices->SetArgVal(10, inc);
+	generateVertices->Enqueue(1, (const size_t[]){numActivePoints});
+
+	auto generateTris = program->CreateKernel("generateContourTriangles");
+	generateTris->SetArg(0, densityField);
+	generateTris->SetArg(1, edgeMasks.get());
+	generateTris->SetArg(2, vertexOffsets.get());
+	generateTris->SetArg(3, triOffsets.get());
+	generateTris->SetArg(4, activeCells.get());
+	generateTris->SetArg(5, indices.get());
+	generateTris->SetArgVal(6, isolevel);
+	for(int i = 0; i < 3; ++i)
+		generateTris->SetArgVal(7 + i, dims[i]);
+	generateTris->Enqueue(1, (const size_t[]){numActiveCells});
+
+	// read back only the mesh
+	std::vector<float> vertexData(6 * numVertices);
+	std::vector<unsigned int> indexData(3 * numTris);
+	vertices->EnqueueRead(0, sizeof(float) * vertexData.size(), &vertexData[0]);
+	ComputeEvent ev = indices->EnqueueRead(0, sizeof(unsigned int) * indexData.size(), &indexData[0]);
+	compute_WaitForEvent(ev);
+
+	for(unsigned int i = 0; i < numVertices; ++i)
+	{
+		const float* vertex = &vertexData[6 * i];
+		result->AddVertex(vec3(vertex[0], vertex[1], vertex[2]), 
+			vec3(vertex[3], vertex[4], vertex[5]));
+	}
+	for(unsigned int i = 0; i < numTris; ++i)
+		result->AddFace(indexData[3*i], indexData[3*i + 1], indexData[3*i + 2]);
+
+	std::cout << "mesh has " << result->NumVertices() << " verts and " <<
+		result->NumFaces() << " faces. " <<std::endl;
+
+	return result;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <memory>
+
+class TriSoup;
+class ComputeProgram;
+class ComputeBuffer;
+
+// Contours a density field that's already on the compute device with the 
+// contouring kernels in program (programs/rock.cl), and reads back only the
+// mesh. Same tetrahedral split, placement and normals as 
+// surfcon_CreateMeshFromDensityField with no flags, though the vertices come
+// out in a different order. Returns null on failure.
+std::shared_ptr<TriSoup> clcontour_CreateMeshFromDensityBuffer(
+	ComputeProgram* program,
+	const ComputeBuffer* densityField,
+	float isolevel,
+	unsigned int width, unsigned int height, unsigned int depth);
+
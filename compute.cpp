@@ -867,3 +867,41 @@ ComputeEvent compute_PrefixSum(unsigned int* in, unsigned int* out, unsigned int
 	return lastEv;
 }
 
+
+static void compute_ScanLevel(const ComputeBuffer* in, const ComputeBuffer* out, 
+	unsigned int size, bool countNonZero)
+{
+	// small enough for any device's work groups, the kernels need a power of two
+	constexpr unsigned int kGroupSize = 256;
+	const unsigned int numGroups = (size + kGroupSize - 1) / kGroupSize;
+	const size_t globalSize = numGroups * kGroupSize;
+	auto blockSums = compute_CreateBufferRW(sizeof(unsigned int) * numGroups);
+
+	auto scanKernel = g_prefixSumProgram->CreateKernel("scanBlocksExclusive");
+	scanKernel->SetArg(0, out);
+	scanKernel->SetArg(1, in);
+	scanKernel->SetArg(2, blockSums.get());
+	scanKernel->SetArgVal(3, size);
+	scanKernel->SetArgVal(4, (unsigned int)(countNonZero ? 1 : 0));
+	scanKernel->SetArgTempSize(5, 2 * kGroupSize * sizeof(unsigned int));
+	scanKernel->Enqueue(1, (const size_t[]){globalSize}, (const size_t[]){kGroupSize});
+	if(numGroups == 1)
+		return;
+
+	// offset every group by the scanned totals of the groups before it
+	auto blockOffsets = compute_CreateBufferRW(sizeof(unsigned int) * numGroups);
+	compute_ScanLevel(blockSums.get(), blockOffsets.get(), numGroups, false);
+
+	auto addKernel = g_prefixSumProgram->CreateKernel("addBlockSums");
+	addKernel->SetArg(0, out);
+	addKernel->SetArg(1, blockOffsets.get());
+	addKernel->SetArgVal(2, size);
+	addKernel->Enqueue(1, (const size_t[]){globalSize}, (const size_t[]){kGroupSize});
+}
+
+void compute_ScanBuffer(const ComputeBuffer* in, const ComputeBuffer* out, 
+	unsigned int size, bool countNonZero)
+{
+	if(size == 0) return;
+	compute_ScanLevel(in, out, size, countNonZero);
+}
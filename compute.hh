@@ -180,5 +180,11 @@ void compute_WaitForEvent(const ComputeEvent& event);
 ComputeEvent compute_EnqueueMarker();
 void compute_Finish();
 ComputeEvent compute_PrefixSum(unsigned int* in, unsigned int* out, unsigned int size);
+// Exclusive prefix sum of size uints from in to out, without leaving the 
+// device. With countNonZero every nonzero element adds 1 rather than its 
+// value, which gives the output slots for compacting the nonzero elements.
+// Enqueued in order, so later work on the queue sees the result.
+void compute_ScanBuffer(const ComputeBuffer* in, const ComputeBuffer* out, 
+	unsigned int size, bool countNonZero = false);
 
 
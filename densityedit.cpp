@@ -0,0 +1,190 @@
+#include <cfloat>
+#include "common.hh"
+#include "densityedit.hh"
+#include "surfcon.hh"
+#include "mesh.hh"
+#include "task.hh"
+
+////////////////////////////////////////////////////////////////////////////////
+DensityEditor::DensityEditor(float* densityField,
+	unsigned int width, unsigned int height, unsigned int depth,
+	DensityPyramid* pyramid, float isolevel, int contourFlags)
+	: m_densityField(densityField)
+	, m_width(width)
+	, m_height(height)
+	, m_depth(depth)
+	, m_pyramid(pyramid)
+	, m_isolevel(isolevel)
+	// bricks are contoured side by side, and box contouring has no dual methods
+	, m_contourFlags(contourFlags & ~(SURFCON_Parallel | SURFCON_SurfaceNets))
+	, m_inc()
+	, m_startPt()
+	, m_bricksX(pyramid->NumBricksX())
+	, m_bricksY(pyramid->NumBricksY())
+	, m_bricksZ(pyramid->NumBricksZ())
+	, m_meshes(m_bricksX * m_bricksY * m_bricksZ)
+	, m_dirty(m_meshes.size(), true)
+	, m_dirtyList(m_meshes.size())
+{
+	// same placement as the contourers
+	const float smallestSide = Min(Min(width,height),depth);
+	m_inc = 2.0 / smallestSide;
+	m_startPt = -vec3(width,height,depth) / smallestSide;
+
+	for(int i = 0, c = m_dirtyList.size(); i < c; ++i)
+		m_dirtyList[i] = i;
+}
+
+float DensityEditor::Sample(int x, int y, int z) const
+{
+	return m_densityField[x + m_width * (y + m_height * z)];
+}
+
+float DensityEditor::SampleLinear(const vec3& lattice) const
+{
+	const float lx = Clamp(lattice.x, 0.f, float(m_width - 1));
+	const float ly = Clamp(lattice.y, 0.f, float(m_height - 1));
+	const float lz = Clamp(lattice.z, 0.f, float(m_depth - 1));
+	const int x = Min(int(lx), m_width - 2);
+	const int y = Min(int(ly), m_height - 2);
+	const int z = Min(int(lz), m_depth - 2);
+	const float fx = lx - x, fy = ly - y, fz = lz - z;
+
+	const float c00 = Lerp(fx, Sample(x, y, z), Sample(x+1, y, z));
+	const float c10 = Lerp(fx, Sample(x, y+1, z), Sample(x+1, y+1, z));
+	const float c01 = Lerp(fx, Sample(x, y, z+1), Sample(x+1, y, z+1));
+	const float c11 = Lerp(fx, Sample(x, y+1, z+1), Sample(x+1, y+1, z+1));
+	return Lerp(fz, Lerp(fy, c00, c10), Lerp(fy, c01, c11));
+}
+
+void DensityEditor::MarkDirty(int bx, int by, int bz)
+{
+	const int brick = bx + m_bricksX * (by + m_bricksY * bz);
+	if(!m_dirty[brick])
+	{
+		m_dirty[brick] = true;
+		m_dirtyList.push_back(brick);
+	}
+}
+
+void DensityEditor::ApplySphere(const vec3& center, float radius, float amount)
+{
+	if(radius <= 0.f)
+		return;
+
+	const vec3 c = ToLattice(center);
+	const float r = radius / m_inc;
+	const int x0 = Max(0, int(ceilf(c.x - r))), x1 = Min(m_width - 1, int(floorf(c.x + r)));
+	const int y0 = Max(0, int(ceilf(c.y - r))), y1 = Min(m_height - 1, int(floorf(c.y + r)));
+	const int z0 = Max(0, int(ceilf(c.z - r))), z1 = Min(m_depth - 1, int(floorf(c.z + r)));
+	if(x0 > x1 || y0 > y1 || z0 > z1)
+		return;
+
+	for(int z = z0; z <= z1; ++z)
+	for(int y = y0; y <= y1; ++y)
+	for(int x = x0; x <= x1; ++x)
+	{
+		const float t = Length(vec3(x, y, z) - c) / r;
+		if(t >= 1.f)
+			continue;
+		const float falloff = (1.f - t*t) * (1.f - t*t);
+		m_densityField[x + m_width * (y + m_height * z)] -= amount * falloff;
+	}
+
+	// The pyramid's ranges change in every cell using a changed sample. The 
+	// meshes change one cell further out, as normals are central differences
+	// and vertices on the edges of those cells have a changed neighbour.
+	constexpr int kBrickDim = DensityPyramid::kBrickDim;
+	SurfconBox bricks, dirty;
+	const int lo[3] = { x0, y0, z0 };
+	const int hi[3] = { x1, y1, z1 };
+	const int numCells[3] = { m_width - 1, m_height - 1, m_depth - 1 };
+	for(int i = 0; i < 3; ++i)
+	{
+		bricks.m_min[i] = Max(0, lo[i] - 1) / kBrickDim;
+		bricks.m_max[i] = Min(hi[i], numCells[i] - 1) / kBrickDim + 1;
+		dirty.m_min[i] = Max(0, lo[i] - 2) / kBrickDim;
+		dirty.m_max[i] = Min(hi[i] + 1, numCells[i] - 1) / kBrickDim + 1;
+	}
+	m_pyramid->Update(m_densityField, m_width, m_height, m_depth, bricks);
+
+	for(int bz = dirty.m_min[2]; bz < dirty.m_max[2]; ++bz)
+		for(int by = dirty.m_min[1]; by < dirty.m_max[1]; ++by)
+			for(int bx = dirty.m_min[0]; bx < dirty.m_max[0]; ++bx)
+				MarkDirty(bx, by, bz);
+}
+
+bool DensityEditor::Raycast(const vec3& origin, const vec3& dir, vec3& hit) const
+{
+	const float dirLen = Length(dir);
+	if(dirLen <= 0.f)
+		return false;
+	const vec3 d = dir / dirLen;
+
+	// clip to the field's bounds
+	const vec3 boxMax = m_startPt + m_inc * vec3(m_width - 1, m_height - 1, m_depth - 1);
+	const float lo[3] = { m_startPt.x, m_startPt.y, m_startPt.z };
+	const float hi[3] = { boxMax.x, boxMax.y, boxMax.z };
+	const float o[3] = { origin.x, origin.y, origin.z };
+	const float v[3] = { d.x, d.y, d.z };
+	float tEnter = 0.f, tExit = FLT_MAX;
+	for(int i = 0; i < 3; ++i)
+	{
+		if(fabsf(v[i]) < 1e-8f)
+		{
+			if(o[i] < lo[i] || o[i] > hi[i])
+				return false;
+			continue;
+		}
+		float t0 = (lo[i] - o[i]) / v[i];
+		float t1 = (hi[i] - o[i]) / v[i];
+		if(t0 > t1) std::swap(t0, t1);
+		tEnter = Max(tEnter, t0);
+		tExit = Min(tExit, t1);
+	}
+	if(tEnter > tExit)
+		return false;
+
+	// half cell steps, then interpolate between the samples either side
+	const float step = 0.5f * m_inc;
+	float prevT = tEnter;
+	float prev = SampleLinear(ToLattice(origin + prevT * d)) - m_isolevel;
+	for(float t = tEnter + step; t <= tExit + step; t += step)
+	{
+		const float cur = SampleLinear(ToLattice(origin + t * d)) - m_isolevel;
+		if((prev < 0) != (cur < 0))
+		{
+			hit = origin + (prevT + step * prev / (prev - cur)) * d;
+			return true;
+		}
+		prev = cur;
+		prevT = t;
+	}
+	return false;
+}
+
+void DensityEditor::Update(std::vector<int>& changed)
+{
+	constexpr int kBrickDim = DensityPyramid::kBrickDim;
+	task_ParallelFor(m_dirtyList.size(), [&](int i) {
+		const int brick = m_dirtyList[i];
+		const int bx = brick % m_bricksX;
+		const int by = (brick / m_bricksX) % m_bricksY;
+		const int bz = brick / (m_bricksX * m_bricksY);
+		const SurfconBox cells = {
+			{ bx * kBrickDim, by * kBrickDim, bz * kBrickDim },
+			{ (bx + 1) * kBrickDim, (by + 1) * kBrickDim, (bz + 1) * kBrickDim } };
+		std::shared_ptr<TriSoup> mesh = surfcon_CreateMeshFromDensityBox(m_isolevel,
+			m_densityField, m_width, m_height, m_depth, cells, m_contourFlags, m_pyramid);
+		if(mesh->NumFaces() == 0)
+			mesh.reset();
+		// the contourers' normals come from the field, so they match across bricks
+		m_meshes[brick] = mesh;
+	});
+
+	for(int brick: m_dirtyList)
+		m_dirty[brick] = false;
+	changed.insert(changed.end(), m_dirtyList.begin(), m_dirtyList.end());
+	m_dirtyList.clear();
+}
+
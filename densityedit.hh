@@ -0,0 +1,55 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "vec.hh"
+
+class TriSoup;
+class DensityPyramid;
+
+////////////////////////////////////////////////////////////////////////////////
+// DensityEditor
+// Edits a density field with brushes and keeps a mesh per pyramid brick, so
+// an edit only re-contours the bricks it touched. Positions are in the mesh
+// coordinates the contourers use. The field and pyramid are edited in place
+// and must outlive the editor.
+class DensityEditor
+{
+public:
+	DensityEditor(float* densityField,
+		unsigned int width, unsigned int height, unsigned int depth,
+		DensityPyramid* pyramid, float isolevel, int contourFlags);
+
+	int NumBricks() const { return m_meshes.size(); }
+	// null when the brick has no surface
+	const std::shared_ptr<TriSoup>& GetBrickMesh(int brick) const { return m_meshes[brick]; }
+
+	// Smooth sphere brush. A positive amount adds material by pushing the field
+	// below the isolevel, a negative one carves it away.
+	void ApplySphere(const vec3& center, float radius, float amount);
+
+	// Finds where a ray first crosses the surface.
+	bool Raycast(const vec3& origin, const vec3& dir, vec3& hit) const;
+
+	// Re-contours the dirty bricks and appends their indices to changed.
+	// Everything starts dirty.
+	void Update(std::vector<int>& changed);
+private:
+	float Sample(int x, int y, int z) const;
+	float SampleLinear(const vec3& lattice) const;
+	vec3 ToLattice(const vec3& pos) const { return (pos - m_startPt) / m_inc; }
+	void MarkDirty(int bx, int by, int bz);
+
+	float* m_densityField;
+	int m_width, m_height, m_depth;
+	DensityPyramid* m_pyramid;
+	float m_isolevel;
+	int m_contourFlags;
+	float m_inc;
+	vec3 m_startPt;
+	int m_bricksX, m_bricksY, m_bricksZ;
+	std::vector<std::shared_ptr<TriSoup>> m_meshes;
+	std::vector<bool> m_dirty;
+	std::vector<int> m_dirtyList;
+};
+
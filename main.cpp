@@ -27,7 +27,13 @@
 #include "timer.hh"
 #include "compute.hh"
 #include "mesh.hh"
+#include "meshsimplify.hh"
+#include "meshfile.hh"
+#include "assetcache.hh"
 #include "surfcon.hh"
+#include "chunks.hh"
+#include "densityedit.hh"
+#include "clcontour.hh"
 
 ////////////////////////////////////////////////////////////////////////////////
 // types
@@ -87,6 +93,53 @@ public:
 	float m_octaves;
 	float m_noiseAmp;
 	float m_isolevel;
+
+	// true if both would generate the same density field, whatever their isolevels
+	bool SameField(const RockDensityParams& o) const {
+		return m_radius == o.m_radius &&
+			m_noiseScale == o.m_noiseScale &&
+			m_H == o.m_H &&
+			m_lacunarity == o.m_lacunarity &&
+			m_octaves == o.m_octaves &&
+			m_noiseAmp == o.m_noiseAmp;
+	}
+};
+
+class TerrainParams
+{
+public:
+	TerrainParams()
+		: m_heightScale(150.f)
+		, m_noiseScale(0.002f)
+		, m_H(1.f)
+		, m_lacunarity(2.f)
+		, m_octaves(6.f)
+		, m_viewRadius(3)
+		, m_memoryBudgetMB(64)
+	{}
+
+	float m_heightScale;
+	vec3 m_noiseScale;
+	float m_H;
+	float m_lacunarity;
+	float m_octaves;
+	int m_viewRadius; // in chunks
+	int m_memoryBudgetMB;
+};
+
+// last generated density field, kept so an isolevel change only has to re-contour
+class RockDensityField
+{
+public:
+	RockDensityField(const RockDensityParams& params, unsigned int dim)
+		: m_params(params), m_dim(dim), m_field(), m_pyramid(), m_sparse(), m_sculpted(false) {}
+
+	RockDensityParams m_params;
+	unsigned int m_dim;
+	std::vector<float> m_field;
+	std::shared_ptr<DensityPyramid> m_pyramid;
+	std::shared_ptr<SparseDensityField> m_sparse; // instead of m_field and m_pyramid
+	bool m_sculpted;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -149,11 +202,85 @@ std::string g_defaultComputeDevice;
 static constexpr int kShadowTexDim = 1024;
 static Framebuffer g_shadowFbo(kShadowTexDim, kShadowTexDim);
 static constexpr int kRockTextureDim = 1024;
+static constexpr int kRockDensityDim = 32;
+static constexpr int kRockSparseDensityDim = 256;
+static constexpr float kRockSparseBandWidth = 0.02f; // a few cells either side of the isolevel
 static GLuint g_rockTexture;
 static GLuint g_rockHeightTexture;
 static std::shared_ptr<Geom> g_rockGeom;
+static std::shared_ptr<RockDensityField> g_rockDensity;
+// big rocks are drawn as meshlets, ranges of g_rockGeom culled against the camera
+static constexpr int kRockMeshletMinFaces = 65536;
+static std::vector<TriSoup::Meshlet> g_rockMeshlets;
+static std::vector<int> g_rockVisibleMeshlets;
+static int g_rockMeshletCulling = 1;
+
+static constexpr float kRockScale = 100.f;
+
+// Rock geoms have packed vertices, relative to the box the contourers map the
+// field to. g_rockGeomFormat and g_rockGeomBounds are what the current ones 
+// have; the placeholder sphere is floats, and a rock loaded from kRockMeshFile
+// has whatever the file says.
+static constexpr int kRockVertexFormat = TRISOUP_VertexPacked8;
+static const AABB g_rockVertexBounds(vec3(-1.f), vec3(1.f));
+static int g_rockGeomFormat = TRISOUP_VertexFloat;
+static AABB g_rockGeomBounds = g_rockVertexBounds;
+
+// The last generated rock is kept for "save mesh", which writes it to 
+// kRockMeshFile along with the asset key of what made it. If that's there at
+// startup and the key matches the current params, it's drawn instead of 
+// generating a rock, without meshlets or LODs. Rocks without a key, adaptive
+// or sculpted, can't be saved.
+static const char* kRockMeshFile = "rock.mesh";
+static std::shared_ptr<TriSoup> g_rockMesh;
+static uint64_t g_rockMeshKey;
+
+// simplified rocks, drawn instead of g_rockGeom once the main camera is more
+// than m_distance rock radii from the rock's center
+struct RockLod {
+	float m_ratio; // of g_rockGeom's faces
+	float m_distance;
+};
+static const RockLod g_rockLods[] = {
+	{ 0.5f, 3.f },
+	{ 0.15f, 6.f },
+};
+static std::vector<std::shared_ptr<Geom>> g_rockLodGeoms;
+static int g_rockLodsEnabled = 1;
+
+// contouring method for the rock, indexes g_rockContourMethods
+struct RockContourMethod {
+	int m_flags;
+	bool m_adaptive; // octree contouring, LOD relative to the main camera
+	bool m_device; // tetrahedra on the compute device, the field never comes back
+	bool m_sparse; // narrow band field at kRockSparseDensityDim, tetrahedra
+};
+static int g_rockContourMethod;
+static const RockContourMethod g_rockContourMethods[] = {
+	{ 0, false, false, false }, // tetrahedra
+	{ SURFCON_SurfaceNets, false, false, false },
+	{ SURFCON_MarchingCubes, false, false, false },
+	{ 0, true, false, false },
+	{ 0, false, true, false },
+	{ 0, false, false, true },
+};
+static const Limits<int> g_rockContourMethodLimits(0, ARRAY_SIZE(g_rockContourMethods) - 1);
+
+// sculpting, edits g_rockDensity in place and draws a geom per brick instead of g_rockGeom
+static std::shared_ptr<DensityEditor> g_rockEditor;
+static std::vector<std::shared_ptr<Geom>> g_rockBrickGeoms;
+static int g_rockGeomPending; // generateRockGeom tasks in flight, which read g_rockDensity
+static float g_sculptRadius = 0.15f;
+static float g_sculptAmount = 0.05f;
 static RockTextureParams m_rockParams;
 static RockDensityParams m_densityParams;
+
+// terrain chunks, drawn instead of the ground plane when enabled
+static constexpr int kTerrainChunkDim = 33; // samples per side, neighbours share their border samples
+static constexpr float kTerrainChunkSize = 256.f;
+static bool g_terrainEnabled;
+static TerrainParams g_terrainParams;
+static std::shared_ptr<ChunkCache> g_terrainChunks;
 static std::shared_ptr<ComputeProgram> g_rockGenProgram;
 static std::shared_ptr<Geom> g_groundGeom;
 
@@ -166,6 +293,9 @@ enum RockUniformLocType {
 	ROCKBIND_TexDim,
 	ROCKBIND_ShadowMap,
 	ROCKBIND_ShadowMatrix,
+	ROCKBIND_PosOffset,
+	ROCKBIND_PosScale,
+	ROCKBIND_OctNormals,
 };
 
 static const std::vector<CustomShaderAttr> g_rockShaderUniforms = {
@@ -174,10 +304,23 @@ static const std::vector<CustomShaderAttr> g_rockShaderUniforms = {
 	{ ROCKBIND_TexDim, "texDim" },
 	{ ROCKBIND_ShadowMap, "shadowMap" },
 	{ ROCKBIND_ShadowMatrix, "shadowMat" },
+	{ ROCKBIND_PosOffset, "posOffset" },
+	{ ROCKBIND_PosScale, "posScale" },
+	{ ROCKBIND_OctNormals, "octNormals" },
 };
 
 static std::shared_ptr<ShaderInfo> g_rockShader ;
 
+enum ShadowUniformLocType {
+	SHADOWBIND_PosOffset,
+	SHADOWBIND_PosScale,
+};
+
+static const std::vector<CustomShaderAttr> g_shadowShaderUniforms = {
+	{ SHADOWBIND_PosOffset, "posOffset" },
+	{ SHADOWBIND_PosScale, "posScale" },
+};
+
 static std::shared_ptr<ShaderInfo> g_shadowShader ;
 
 enum GroundUniformLocType {
@@ -196,7 +339,9 @@ static std::shared_ptr<ShaderInfo> g_groundShader;
 // forward decls
 static void record_Start();
 static void generateRockTexture();
-static void generateRockGeom();
+static void generateRockGeom(bool useCache = true);
+static void saveRockMesh();
+static void applyTerrainParams();
 
 ////////////////////////////////////////////////////////////////////////////////
 // tweak vars - these are checked into git
@@ -232,6 +377,15 @@ static std::vector<std::shared_ptr<TweakVarBase>> g_tweakVars = {
 	std::make_shared<TweakFloat>("rockdensity.octaves", &m_densityParams.m_octaves, 8.8f),
 	std::make_shared<TweakFloat>("rockdensity.noiseAmplitude", &m_densityParams.m_noiseAmp, 0.01f),
 	std::make_shared<TweakFloat>("rockdensity.isolevel", &m_densityParams.m_isolevel, 0.0f),
+	std::make_shared<TweakInt>("rockgeom.contourMethod", &g_rockContourMethod, 0, 
+		g_rockContourMethodLimits),
+	std::make_shared<TweakFloat>("terrain.heightScale", &g_terrainParams.m_heightScale, 150.f),
+	std::make_shared<TweakVector>("terrain.noiseScale", &g_terrainParams.m_noiseScale, vec3(0.002f)),
+	std::make_shared<TweakFloat>("terrain.H", &g_terrainParams.m_H, 1.f),
+	std::make_shared<TweakFloat>("terrain.lacunarity", &g_terrainParams.m_lacunarity, 2.f),
+	std::make_shared<TweakFloat>("terrain.octaves", &g_terrainParams.m_octaves, 6.f),
+	std::make_shared<TweakInt>("terrain.viewRadius", &g_terrainParams.m_viewRadius, 3),
+	std::make_shared<TweakInt>("terrain.memoryBudgetMB", &g_terrainParams.m_memoryBudgetMB, 64),
 };
 
 static void SaveCurrentCamera()
@@ -246,6 +400,7 @@ static void SaveCurrentCamera()
 static std::vector<std::shared_ptr<TweakVarBase>> g_settingsVars = {
 	std::make_shared<TweakBool>("cam.orbit", &g_orbitCam, false),
 	std::make_shared<TweakBool>("debug.wireframe", &g_wireframe, false),
+	std::make_shared<TweakBool>("terrain.enabled", &g_terrainEnabled, false),
 	std::make_shared<TweakBool>("debug.fpsDisplay", &g_debugDisplay, false),
 	std::make_shared<TweakBool>("debug.draw", 
 			[](){ return dbgdraw_IsEnabled(); },
@@ -300,6 +455,8 @@ static std::shared_ptr<TopMenuItem> MakeMenu()
 	std::vector<std::shared_ptr<MenuItem>> debugMenu = {
 		std::make_shared<ButtonMenuItem>("reload shaders", render_RefreshShaders),
 		std::make_shared<BoolMenuItem>("wireframe", &g_wireframe),
+		std::make_shared<BoolMenuItem>("meshlet culling", &g_rockMeshletCulling),
+		std::make_shared<BoolMenuItem>("rock lods", &g_rockLodsEnabled),
 		std::make_shared<BoolMenuItem>("fps & info", &g_debugDisplay),
 		std::make_shared<BoolMenuItem>("debugcam", camera_GetDebugCamera, camera_SetDebugCamera),
 		std::make_shared<IntSliderMenuItem>("debug texture id", 
@@ -331,7 +488,8 @@ static std::shared_ptr<TopMenuItem> MakeMenu()
 		std::make_shared<ButtonMenuItem>("recompile", [](){ g_rockGenProgram->Recompile(); }),
 	};
 	std::vector<std::shared_ptr<MenuItem>> geomMenu = {
-		std::make_shared<ButtonMenuItem>("regenerate", [](){ generateRockGeom(); }),
+		std::make_shared<ButtonMenuItem>("regenerate", [](){ generateRockGeom(false); }),
+		std::make_shared<ButtonMenuItem>("save mesh", saveRockMesh),
 		std::make_shared<FloatSliderMenuItem>("radius", &m_densityParams.m_radius, 0.1f),
 		std::make_shared<VecSliderMenuItem>("noiseScale", &m_densityParams.m_noiseScale),
 		std::make_shared<FloatSliderMenuItem>("H", &m_densityParams.m_H, 0.1f),
@@ -339,13 +497,32 @@ static std::shared_ptr<TopMenuItem> MakeMenu()
 		std::make_shared<FloatSliderMenuItem>("octaves", &m_densityParams.m_octaves, 1.f),
 		std::make_shared<FloatSliderMenuItem>("noise amplitude", &m_densityParams.m_noiseAmp, 0.01f),
 		std::make_shared<FloatSliderMenuItem>("isolevel", &m_densityParams.m_isolevel, 0.1f),
-		std::make_shared<ButtonMenuItem>("recompile", [](){ g_rockGenProgram->Recompile(); }),
+		std::make_shared<IntSliderMenuItem>("contour method", &g_rockContourMethod, 1,
+			g_rockContourMethodLimits),
+		std::make_shared<FloatSliderMenuItem>("sculpt radius", &g_sculptRadius, 0.01f),
+		std::make_shared<FloatSliderMenuItem>("sculpt amount", &g_sculptAmount, 0.01f),
+		std::make_shared<ButtonMenuItem>("recompile", [](){ 
+			g_rockGenProgram->Recompile(); 
+			g_rockDensity.reset();
+		}),
+	};
+	std::vector<std::shared_ptr<MenuItem>> terrainMenu = {
+		std::make_shared<BoolMenuItem>("enabled", &g_terrainEnabled),
+		std::make_shared<ButtonMenuItem>("regenerate", applyTerrainParams),
+		std::make_shared<FloatSliderMenuItem>("height scale", &g_terrainParams.m_heightScale, 10.f),
+		std::make_shared<VecSliderMenuItem>("noiseScale", &g_terrainParams.m_noiseScale),
+		std::make_shared<FloatSliderMenuItem>("H", &g_terrainParams.m_H, 0.1f),
+		std::make_shared<FloatSliderMenuItem>("lacunarity", &g_terrainParams.m_lacunarity, 0.1f),
+		std::make_shared<FloatSliderMenuItem>("octaves", &g_terrainParams.m_octaves, 1.f),
+		std::make_shared<IntSliderMenuItem>("view radius", &g_terrainParams.m_viewRadius),
+		std::make_shared<IntSliderMenuItem>("memory budget MB", &g_terrainParams.m_memoryBudgetMB, 16),
 	};
 	std::vector<std::shared_ptr<MenuItem>> tweakMenu = {
 		std::make_shared<SubmenuMenuItem>("cam", std::move(cameraMenu)),
 		std::make_shared<SubmenuMenuItem>("lighting", std::move(lightingMenu)),
 		std::make_shared<SubmenuMenuItem>("texture", std::move(textureMenu)),
 		std::make_shared<SubmenuMenuItem>("geom", std::move(geomMenu)),
+		std::make_shared<SubmenuMenuItem>("terrain", std::move(terrainMenu)),
 		std::make_shared<SubmenuMenuItem>("debug", std::move(debugMenu)),
 	};
 	std::vector<std::shared_ptr<MenuItem>> recordMenu = {
@@ -402,12 +579,6 @@ static void record_Advance()
 static void drawGround(const vec3& sundir, const mat4& lightProjView)
 {
 	mat4 projview = g_curCamera->GetProj() * g_curCamera->GetView();
-	mat4 model = MakeTranslation(0,0,-100) * MakeScale(vec3(500));
-	mat4 modelIT = TransposeOfInverse(model);
-	mat4 mvp = projview * model;
-
-	mat4 lightMatrix = MakeCoordinateScale(0.5, 0.5) * lightProjView * model;
-
 	const ShaderInfo* shader = g_groundShader.get();
 
 	GLint mvpLoc = shader->m_uniforms[BIND_Mvp];
@@ -425,21 +596,92 @@ static void drawGround(const vec3& sundir, const mat4& lightProjView)
 	glBindTexture(GL_TEXTURE_2D, g_shadowFbo.GetDepthTexture());
 	glUniform1i(shadowMapLoc, 0);
 
-	glUniformMatrix4fv(mvpLoc, 1, 0, mvp.m);
-	glUniformMatrix4fv(modelLoc, 1, 0, model.m);
-	glUniformMatrix4fv(modelITLoc, 1, 0, modelIT.m);
-	glUniformMatrix4fv(shadowMatrixLoc, 1, 0, lightMatrix.m);
 	glUniform3fv(sundirLoc, 1, &sundir.x);
 	glUniform3fv(sunColorLoc, 1, &g_sunColor.r);
 	glUniform3fv(eyePosLoc, 1, &g_curCamera->GetPos().x);
 
-	g_groundGeom->Render(*shader);
+	auto drawGeom = [&](const mat4& model, Geom& geom) {
+		mat4 modelIT = TransposeOfInverse(model);
+		mat4 mvp = projview * model;
+		mat4 lightMatrix = MakeCoordinateScale(0.5, 0.5) * lightProjView * model;
+
+		glUniformMatrix4fv(mvpLoc, 1, 0, mvp.m);
+		glUniformMatrix4fv(modelLoc, 1, 0, model.m);
+		glUniformMatrix4fv(modelITLoc, 1, 0, modelIT.m);
+		glUniformMatrix4fv(shadowMatrixLoc, 1, 0, lightMatrix.m);
+		geom.Render(*shader);
+	};
+
+	if(g_terrainEnabled)
+		g_terrainChunks->Draw(*g_curCamera, drawGeom);
+	else
+		drawGeom(MakeTranslation(0,0,-100) * MakeScale(vec3(500)), *g_groundGeom);
+}
+
+// Meshlets of g_rockGeom that have a face towards the camera and touch its
+// frustum. The rock's model matrix is a uniform scale, so the camera comes 
+// into model space for the cone test and the spheres go out to world space.
+static void cullRockMeshlets(const Camera& camera, std::vector<int>& outVisible)
+{
+	outVisible.clear();
+	const mat4& view = camera.GetView();
+	const vec3 eye = camera.GetPos() / kRockScale;
+	for(int i = 0; i < int(g_rockMeshlets.size()); ++i)
+	{
+		const TriSoup::Meshlet& meshlet = g_rockMeshlets[i];
+		if(meshlet.IsBackfacing(eye))
+			continue;
+
+		const vec3 viewCenter = TransformPoint(view, meshlet.m_center * kRockScale);
+		const float radius = meshlet.m_radius * kRockScale;
+		bool visible = true;
+		for(int plane = FRUSTUM_Near; visible && plane <= FRUSTUM_Bottom; ++plane)
+			visible = PlaneDist(camera.GetFrustum(plane), viewCenter) >= -radius;
+		if(visible)
+			outVisible.push_back(i);
+	}
+}
+
+// undoes the packing of g_rockGeomFormat in the rock and shadow shaders
+static void setRockVertexDecode(GLint posOffsetLoc, GLint posScaleLoc)
+{
+	const bool packed = g_rockGeomFormat != TRISOUP_VertexFloat;
+	const vec3 offset = packed ? g_rockGeomBounds.m_min : vec3(0.f);
+	const vec3 scale = packed ? g_rockGeomBounds.m_max - g_rockGeomBounds.m_min : vec3(1.f);
+	glUniform3fv(posOffsetLoc, 1, &offset.x);
+	glUniform3fv(posScaleLoc, 1, &scale.x);
 }
 
 static void drawRockGeom(const vec3& sundir, const mat4& matProjView)
 {
-	if(!g_rockGeom) return;
-	mat4 model = MakeScale(vec3(100.0f));
+	if(!g_rockGeom && !g_rockEditor) return;
+	// LODs go by the main camera, like the adaptive contouring
+	const float camDist = Length(g_mainCamera->GetPos()) / kRockScale;
+	Geom* lodGeom = nullptr;
+	for(int i = 0; g_rockLodsEnabled && i < int(g_rockLodGeoms.size()); ++i)
+		if(g_rockLodGeoms[i] && camDist > g_rockLods[i].m_distance)
+			lodGeom = g_rockLodGeoms[i].get();
+
+	// the shadow pass sees what the camera doesn't, so only the camera pass culls
+	auto renderRock = [lodGeom](const ShaderInfo& shader, bool cull) {
+		if(g_rockEditor)
+		{
+			for(auto& geom: g_rockBrickGeoms)
+				if(geom) geom->Render(shader);
+		}
+		else if(lodGeom)
+			lodGeom->Render(shader);
+		else if(cull && !g_rockMeshlets.empty() && g_rockMeshletCulling)
+		{
+			cullRockMeshlets(*g_curCamera, g_rockVisibleMeshlets);
+			g_rockGeom->Bind(shader);
+			g_rockGeom->Submit(g_rockVisibleMeshlets);
+			g_rockGeom->Unbind(shader);
+		}
+		else
+			g_rockGeom->Render(shader);
+	};
+	mat4 model = MakeScale(vec3(kRockScale));
 	mat4 modelIT = TransposeOfInverse(model);
 	mat4 mvp = matProjView * model;
 	mat4 lightProjView = 
@@ -463,10 +705,12 @@ static void drawRockGeom(const vec3& sundir, const mat4& matProjView)
 
 		GLint mvpLoc = shader->m_uniforms[BIND_Mvp];
 		glUniformMatrix4fv(mvpLoc, 1, 0, shadowMat.m);
+		setRockVertexDecode(shader->m_custom[SHADOWBIND_PosOffset], 
+			shader->m_custom[SHADOWBIND_PosScale]);
 
 		glPolygonOffset(2.5f, 10.f);
 		glEnable(GL_POLYGON_OFFSET_FILL);
-		g_rockGeom->Render(*shader);
+		renderRock(*shader, false);
 		glDisable(GL_POLYGON_OFFSET_FILL);
 	}
 
@@ -493,6 +737,8 @@ static void drawRockGeom(const vec3& sundir, const mat4& matProjView)
 	glUniform3fv(sundirLoc, 1, &sundir.x);
 	glUniform3fv(sunColorLoc, 1, &g_sunColor.r);
 	glUniform3fv(eyePosLoc, 1, &g_curCamera->GetPos().x);
+	setRockVertexDecode(shader->m_custom[ROCKBIND_PosOffset], shader->m_custom[ROCKBIND_PosScale]);
+	glUniform1i(shader->m_custom[ROCKBIND_OctNormals], g_rockGeomFormat != TRISOUP_VertexFloat);
 	constexpr float invTexDim = 1.0 / kRockTextureDim;
 	glUniform2f(texDimLoc, invTexDim, invTexDim);
 	
@@ -506,7 +752,7 @@ static void drawRockGeom(const vec3& sundir, const mat4& matProjView)
 	glBindTexture(GL_TEXTURE_2D, g_shadowFbo.GetDepthTexture());
 	glUniform1i(shadowMapLoc, 2);
 
-	g_rockGeom->Render(*shader);
+	renderRock(*shader, true);
 
 	drawGround(sundir, lightProjView);
 
@@ -572,6 +818,15 @@ static void draw(Framedata& frame)
 		const vec3& pos = g_curCamera->GetPos();
 		snprintf(cameraPosStr, sizeof(cameraPosStr) - 1, "eye: %.2f %.2f %.2f", pos.x, pos.y, pos.z);
 		font_Print(g_screen.m_width-180, 40, cameraPosStr, fpsCol, 16.f);
+
+		if(g_terrainEnabled)
+		{
+			char chunkStr[64] = {};
+			snprintf(chunkStr, sizeof(chunkStr) - 1, "chunks: %d (%d pending) %.1fMB", 
+				g_terrainChunks->NumChunks(), g_terrainChunks->NumPending(),
+				g_terrainChunks->GetMemoryUsed() / (1024.f * 1024.f));
+			font_Print(g_screen.m_width-180, 56, chunkStr, fpsCol, 16.f);
+		}
 	}
 
 	task_RenderProgress();
@@ -619,6 +874,77 @@ static void draw(Framedata& frame)
 //	return voronoiObj;
 //}
 
+////////////////////////////////////////////////////////////////////////////////
+// Rock assets are cached by their params and these, the kernels that make them
+// and the device they run on. False if the sources can't be read, and then
+// there's no caching. prefixsum.cl is compute_ScanBuffer's, which the device
+// contourer uses.
+static const char* kRockProgramSources[] = {
+	"programs/rock.cl",
+	"programs/noise.cl",
+	"programs/prefixsum.cl",
+};
+
+// The CPU side isn't hashed, so bump this whenever contouring, simplification,
+// cache sorting or the vertex formats change what a rock comes out as.
+static constexpr int kRockCacheVersion = 2;
+
+static bool addRockProgramKey(AssetKey& key)
+{
+	for(const char* filename: kRockProgramSources)
+		if(!key.AddFile(filename))
+			return false;
+	key.AddString(compute_GetCurrentDeviceName().c_str());
+	return true;
+}
+
+static bool makeRockTextureKey(const RockTextureParams& params, AssetKey& key)
+{
+	key.AddString("rock texture");
+	key.Add(kRockTextureDim);
+	key.Add(params.m_marbleDepth);
+	key.Add(params.m_marbleTurb);
+	key.Add(params.m_baseColor0);
+	key.Add(params.m_baseColor1);
+	key.Add(params.m_baseColor2);
+	key.Add(params.m_darkColor);
+	key.Add(params.m_scale);
+	key.Add(params.m_noiseScaleColor);
+	key.Add(params.m_noiseScaleHeight);
+	key.Add(params.m_noiseScalePt);
+	key.Add(params.m_lacunarity);
+	key.Add(params.m_H);
+	key.Add(params.m_octaves);
+	key.Add(params.m_offset);
+	return addRockProgramKey(key);
+}
+
+// Adaptive meshes depend on where the camera is, so they aren't cached.
+static bool makeRockGeomKey(const RockDensityParams& params, const RockContourMethod& method,
+	unsigned int dim, AssetKey& key)
+{
+	if(method.m_adaptive)
+		return false;
+	key.AddString("rock geom");
+	key.Add(kRockCacheVersion);
+	key.Add(dim);
+	key.Add(params.m_radius);
+	key.Add(params.m_noiseScale);
+	key.Add(params.m_H);
+	key.Add(params.m_lacunarity);
+	key.Add(params.m_octaves);
+	key.Add(params.m_noiseAmp);
+	key.Add(params.m_isolevel);
+	key.Add(method.m_flags);
+	key.Add(method.m_device);
+	key.Add(method.m_sparse);
+	key.Add(kRockVertexFormat);
+	key.Add(kMeshFileVersion);
+	for(const RockLod& lod: g_rockLods)
+		key.Add(lod.m_ratio);
+	return addRockProgramKey(key);
+}
+
 static void generateRockTexture()
 {
 	struct RockGenData 
@@ -633,8 +959,21 @@ static void generateRockTexture()
 	};
 
 	auto data = std::make_shared<RockGenData>();
+	const RockTextureParams params = m_rockParams;
+	AssetKey key;
+	const bool cached = makeRockTextureKey(params, key);
+	const std::string imagePath = cached ? assetcache_GetPath(key, ".rgba") : std::string();
+	const std::string heightPath = cached ? assetcache_GetPath(key, ".height") : std::string();
+
+	auto runFunc = [data, params, cached, imagePath, heightPath]() {
+		if(cached && assetcache_Exists(imagePath) && assetcache_Exists(heightPath))
+		{
+			if(assetcache_ReadBlob(imagePath, &data->hostImageData[0], data->hostImageData.size()) &&
+				assetcache_ReadBlob(heightPath, &data->hostHeightData[0], data->hostHeightData.size()))
+				return;
+			std::cerr << "regenerating the rock texture over its cached copy" << std::endl;
+		}
 
-	auto runFunc = [data]() {
 		auto rockKernel = g_rockGenProgram->CreateKernel("generateRockTexture");
 		if(!rockKernel)
 			return;
@@ -645,20 +984,20 @@ static void generateRockTexture()
 				CL_R, CL_UNORM_INT8);
 		rockKernel->SetArg(0, imageObj.get());
 		rockKernel->SetArg(1, heightObj.get());
-		rockKernel->SetArg(2, &m_rockParams.m_marbleDepth);
-		rockKernel->SetArg(3, &m_rockParams.m_marbleTurb);
-		rockKernel->SetArg(4, &m_rockParams.m_baseColor0);
-		rockKernel->SetArg(5, &m_rockParams.m_baseColor1);
-		rockKernel->SetArg(6, &m_rockParams.m_baseColor2);
-		rockKernel->SetArg(7, &m_rockParams.m_darkColor);
-		rockKernel->SetArg(8, &m_rockParams.m_scale);
-		rockKernel->SetArg(9, &m_rockParams.m_noiseScaleColor);
-		rockKernel->SetArg(10, &m_rockParams.m_noiseScaleHeight);
-		rockKernel->SetArg(11, &m_rockParams.m_noiseScalePt);
-		rockKernel->SetArg(12, &m_rockParams.m_lacunarity);
-		rockKernel->SetArg(13, &m_rockParams.m_H);
-		rockKernel->SetArg(14, &m_rockParams.m_octaves);
-		rockKernel->SetArg(15, &m_rockParams.m_offset);
+		rockKernel->SetArg(2, &params.m_marbleDepth);
+		rockKernel->SetArg(3, &params.m_marbleTurb);
+		rockKernel->SetArg(4, &params.m_baseColor0);
+		rockKernel->SetArg(5, &params.m_baseColor1);
+		rockKernel->SetArg(6, &params.m_baseColor2);
+		rockKernel->SetArg(7, &params.m_darkColor);
+		rockKernel->SetArg(8, &params.m_scale);
+		rockKernel->SetArg(9, &params.m_noiseScaleColor);
+		rockKernel->SetArg(10, &params.m_noiseScaleHeight);
+		rockKernel->SetArg(11, &params.m_noiseScalePt);
+		rockKernel->SetArg(12, &params.m_lacunarity);
+		rockKernel->SetArg(13, &params.m_H);
+		rockKernel->SetArg(14, &params.m_octaves);
+		rockKernel->SetArg(15, &params.m_offset);
 
 		rockKernel->Enqueue(2, (const size_t[]){kRockTextureDim, kRockTextureDim});
 
@@ -672,6 +1011,11 @@ static void generateRockTexture()
 				&data->hostHeightData[0]);
 		compute_Finish();	
 
+		if(cached)
+		{
+			assetcache_WriteBlob(imagePath, &data->hostImageData[0], data->hostImageData.size());
+			assetcache_WriteBlob(heightPath, &data->hostHeightData[0], data->hostHeightData.size());
+		}
 	};
 
 	auto completeFunc = [data]() {
@@ -694,28 +1038,13 @@ static void generateRockTexture()
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-std::vector<float> computeDensityField(unsigned int width, unsigned int height, unsigned int depth)
+// Runs a density kernel that writes one z slice to the buffer in arg 0, with 
+// the slice's z coordinate from sliceZ in arg zArg, into result.
+static void runDensityKernel(const ComputeKernel* densityKernel, 
+	int zArg, const std::function<float(unsigned int)>& sliceZ,
+	unsigned int width, unsigned int height, unsigned int depth, float* result)
 {
-	std::vector<float> result(width*height*depth);
-	auto densityKernel = g_rockGenProgram->CreateKernel("generateRockDensity");
-	if(!densityKernel)
-	{
-		std::cerr << "failed to create generateRockDensity kernel" << std::endl;
-		return result;
-	}
-		
 	const unsigned int densityBufferSliceSize = width*height*sizeof(float);
-		
-	densityKernel->SetArg(1, &m_densityParams.m_radius); // radius
-	float nx = m_densityParams.m_noiseScale.x;
-	float ny = m_densityParams.m_noiseScale.y;
-	float nz = m_densityParams.m_noiseScale.z;
-	densityKernel->SetArg(2, sizeof(cl_float3), (cl_float3[]){{{nx,ny,nz}}});
-	densityKernel->SetArg(3, &m_densityParams.m_H); // H
-	densityKernel->SetArg(4, &m_densityParams.m_lacunarity); // lacunarity
-	densityKernel->SetArg(5, &m_densityParams.m_octaves); // octaves
-	densityKernel->SetArg(6, &m_densityParams.m_noiseAmp); // amplitude  
-
 	auto densityBufferA = compute_CreateBufferRW(densityBufferSliceSize);
 	auto densityBufferB = compute_CreateBufferRW(densityBufferSliceSize);
 
@@ -726,7 +1055,7 @@ std::vector<float> computeDensityField(unsigned int width, unsigned int height,
 	for(unsigned int z = 0; z < depth; ++z)
 	{
 		densityKernel->SetArg(0, buffers[curBuffer]);
-		densityKernel->SetArgVal(7, z / float(depth - 1)); // zCoord
+		densityKernel->SetArgVal(zArg, sliceZ(z)); // zCoord
 		auto taskEv = densityKernel->EnqueueEv(2, 
 				(const size_t[]){width, height},
 				nullptr,
@@ -741,41 +1070,402 @@ std::vector<float> computeDensityField(unsigned int width, unsigned int height,
 
 	ComputeEvent ev = compute_EnqueueMarker();
 	compute_WaitForEvent(ev);
+}
+
+// These run on workers, so they take a snapshot of the params rather than
+// reading m_densityParams, which the menu can change meanwhile.
+static void setRockDensityArgs(const ComputeKernel* densityKernel, const RockDensityParams& params)
+{
+	densityKernel->SetArg(1, &params.m_radius); // radius
+	float nx = params.m_noiseScale.x;
+	float ny = params.m_noiseScale.y;
+	float nz = params.m_noiseScale.z;
+	densityKernel->SetArg(2, sizeof(cl_float3), (cl_float3[]){{{nx,ny,nz}}});
+	densityKernel->SetArg(3, &params.m_H); // H
+	densityKernel->SetArg(4, &params.m_lacunarity); // lacunarity
+	densityKernel->SetArg(5, &params.m_octaves); // octaves
+	densityKernel->SetArg(6, &params.m_noiseAmp); // amplitude  
+}
+
+std::vector<float> computeDensityField(const RockDensityParams& params,
+	unsigned int width, unsigned int height, unsigned int depth)
+{
+	std::vector<float> result(width*height*depth);
+	auto densityKernel = g_rockGenProgram->CreateKernel("generateRockDensity");
+	if(!densityKernel)
+	{
+		std::cerr << "failed to create generateRockDensity kernel" << std::endl;
+		return result;
+	}
+
+	setRockDensityArgs(densityKernel.get(), params);
+	runDensityKernel(densityKernel.get(), 7, [depth](unsigned int z) { return z / float(depth - 1); },
+		width, height, depth, &result[0]);
+	return result;
+}
 
+// The rock's density field kept only near the isolevel, computed a layer of
+// bricks at a time so the dense field never exists. Each layer recomputes the
+// slice it shares with the one below.
+static std::shared_ptr<SparseDensityField> computeSparseDensityField(
+	const RockDensityParams& params,
+	unsigned int width, unsigned int height, unsigned int depth,
+	float isolevel, float bandWidth)
+{
+	auto densityKernel = g_rockGenProgram->CreateKernel("generateRockDensity");
+	if(!densityKernel)
+	{
+		std::cerr << "failed to create generateRockDensity kernel" << std::endl;
+		return nullptr;
+	}
+
+	setRockDensityArgs(densityKernel.get(), params);
+	auto result = std::make_shared<SparseDensityField>(width, height, depth, isolevel, bandWidth);
+	constexpr unsigned int kBrickDim = SparseDensityField::kBrickDim;
+	std::vector<float> layer(width*height*SparseDensityField::kBrickSamples);
+	for(unsigned int zBegin = 0; zBegin + 1 < depth; zBegin += kBrickDim)
+	{
+		const unsigned int numSlices = Min(zBegin + kBrickDim + 1, depth) - zBegin;
+		runDensityKernel(densityKernel.get(), 7, 
+			[zBegin, depth](unsigned int z) { return (zBegin + z) / float(depth - 1); },
+			width, height, numSlices, &layer[0]);
+		result->SetBrickLayer(zBegin / kBrickDim, &layer[0]);
+	}
+
+	std::cout << "sparse density field has " << result->NumDenseBricks() << " of " <<
+		result->NumBricks() << " bricks, " << result->GetMemoryUsed() / (1024*1024) << " MB" << std::endl;
 	return result;
 }
 
-static void generateRockGeom()
+// The rock's density field left on the compute device, for clcontour.
+static std::shared_ptr<ComputeBuffer> computeDensityBuffer(
+	const RockDensityParams& params,
+	unsigned int width, unsigned int height, unsigned int depth)
+{
+	auto densityKernel = g_rockGenProgram->CreateKernel("generateRockDensityVolume");
+	if(!densityKernel)
+	{
+		std::cerr << "failed to create generateRockDensityVolume kernel" << std::endl;
+		return nullptr;
+	}
+
+	auto result = compute_CreateBufferRW(width*height*depth*sizeof(float));
+	densityKernel->SetArg(0, result.get());
+	setRockDensityArgs(densityKernel.get(), params);
+	densityKernel->Enqueue(3, (const size_t[]){width, height, depth});
+	return result;
+}
+
+std::vector<float> computeTerrainDensityField(const TerrainParams& params, 
+	const vec3& origin, float spacing, unsigned int dim)
+{
+	std::vector<float> result(dim*dim*dim);
+	auto densityKernel = g_rockGenProgram->CreateKernel("generateTerrainDensity");
+	if(!densityKernel)
+	{
+		std::cerr << "failed to create generateTerrainDensity kernel" << std::endl;
+		return result;
+	}
+
+	densityKernel->SetArg(1, sizeof(cl_float3), (cl_float3[]){{{origin.x, origin.y, origin.z}}});
+	densityKernel->SetArg(2, &spacing);
+	float nx = params.m_noiseScale.x;
+	float ny = params.m_noiseScale.y;
+	float nz = params.m_noiseScale.z;
+	densityKernel->SetArg(3, sizeof(cl_float3), (cl_float3[]){{{nx,ny,nz}}});
+	densityKernel->SetArg(4, &params.m_H); // H
+	densityKernel->SetArg(5, &params.m_lacunarity); // lacunarity
+	densityKernel->SetArg(6, &params.m_octaves); // octaves
+	densityKernel->SetArg(7, &params.m_heightScale); // height scale
+
+	runDensityKernel(densityKernel.get(), 8, [origin, spacing](unsigned int z) { return origin.z + z * spacing; },
+		dim, dim, dim, &result[0]);
+	return result;
+}
+
+// With useCache, a rock made from the same inputs before is loaded from the
+// asset cache instead. Unless there's already a field for it, it comes without
+// one, so it can't be sculpted until it's regenerated without the cache.
+static void generateRockGeom(bool useCache)
 {
 	struct GeomGenData {
 		GeomGenData()
+			: m_key(0)
 		{}
 
+		std::shared_ptr<RockDensityField> m_density;
 		std::shared_ptr<TriSoup> m_mesh;
+		std::vector<std::shared_ptr<TriSoup>> m_lods;
+		uint64_t m_key; // makeRockGeomKey's, 0 if there isn't one
 	};
 
 	auto data = std::make_shared<GeomGenData>();
+	const RockDensityParams params = m_densityParams;
+	const RockContourMethod& method = 
+		g_rockContourMethods[g_rockContourMethodLimits(g_rockContourMethod)];
+	const int contourFlags = SURFCON_Parallel | method.m_flags;
+	const bool adaptive = method.m_adaptive;
+	const bool device = method.m_device;
+	const bool sparse = method.m_sparse;
+	const unsigned int dim = sparse ? kRockSparseDensityDim : kRockDensityDim;
+	SurfconLodParams lod;
+	lod.m_viewPos = g_mainCamera->GetPos() / kRockScale;
+	if(!device && g_rockDensity && g_rockDensity->m_dim == dim && 
+		g_rockDensity->m_params.SameField(params) &&
+		(sparse ? g_rockDensity->m_sparse && g_rockDensity->m_sparse->CoversIsolevel(params.m_isolevel) :
+			!g_rockDensity->m_field.empty()))
+		data->m_density = g_rockDensity;
+
+	// a sculpted field isn't what the params make, so it's kept out of the cache
+	AssetKey key;
+	std::vector<std::string> cachePaths; // the mesh, then its LODs
+	if(!(data->m_density && data->m_density->m_sculpted) && 
+		makeRockGeomKey(params, method, dim, key))
+	{
+		data->m_key = key.Get();
+		cachePaths.push_back(assetcache_GetPath(key, ".mesh"));
+		for(int i = 0; i < int(ARRAY_SIZE(g_rockLods)); ++i)
+			cachePaths.push_back(assetcache_GetPath(key, (".lod" + std::to_string(i) + ".mesh").c_str()));
+	}
+
+	auto contourFunc = [data, params, contourFlags, adaptive, device, sparse, dim, lod]() {
+		if(device)
+		{
+			// no host copy of the field, so nothing for isolevel changes or sculpting to reuse
+			auto densityBuffer = computeDensityBuffer(params, 
+				kRockDensityDim, kRockDensityDim, kRockDensityDim);
+			if(densityBuffer)
+				data->m_mesh = clcontour_CreateMeshFromDensityBuffer(g_rockGenProgram.get(), 
+					densityBuffer.get(), params.m_isolevel,
+					kRockDensityDim, kRockDensityDim, kRockDensityDim);
+			return;
+		}
+
+		if(sparse)
+		{
+			if(!data->m_density)
+			{
+				auto density = std::make_shared<RockDensityField>(params, dim);
+				density->m_sparse = computeSparseDensityField(params, dim, dim, dim, 
+					params.m_isolevel, kRockSparseBandWidth);
+				if(!density->m_sparse)
+					return;
+				data->m_density = density;
+			}
+			data->m_mesh = surfcon_CreateMeshFromSparseField(params.m_isolevel,
+				*data->m_density->m_sparse, contourFlags);
+			return;
+		}
+
+		if(!data->m_density)
+		{
+			// Create the density texture
+			auto density = std::make_shared<RockDensityField>(params, kRockDensityDim);
+			density->m_field = computeDensityField(params, 
+				kRockDensityDim, kRockDensityDim, kRockDensityDim);
+			density->m_pyramid = std::make_shared<DensityPyramid>(&density->m_field[0],
+				kRockDensityDim, kRockDensityDim, kRockDensityDim, SURFCON_Parallel);
+			data->m_density = density;
+		}
 
-	auto runFunc = [data]() {
-		// Create the density texture
-		constexpr int kDensityDim = 32;
-		std::vector<float> densityField = computeDensityField(kDensityDim, kDensityDim, kDensityDim);
-
-		data->m_mesh = surfcon_CreateMeshFromDensityField(
-			m_densityParams.m_isolevel, 
-			&densityField[0], 
-			kDensityDim, kDensityDim, kDensityDim);
-		//data->m_mesh->CacheSort(32);
-		data->m_mesh->ComputeNormals();
+		const RockDensityField* density = data->m_density.get();
+		if(adaptive)
+			data->m_mesh = surfcon_CreateAdaptiveMeshFromDensityField(
+				params.m_isolevel, 
+				&density->m_field[0], 
+				kRockDensityDim, kRockDensityDim, kRockDensityDim,
+				lod,
+				density->m_pyramid.get());
+		else
+			data->m_mesh = surfcon_CreateMeshFromDensityField(
+				params.m_isolevel, 
+				&density->m_field[0], 
+				kRockDensityDim, kRockDensityDim, kRockDensityDim,
+				contourFlags,
+				density->m_pyramid.get());
+	};
+
+	// a hit needs all of the files, a miss writes them all
+	auto loadCachedFunc = [data, cachePaths]() {
+		for(const std::string& path: cachePaths)
+			if(!assetcache_Exists(path))
+				return false;
+		std::vector<std::shared_ptr<TriSoup>> meshes;
+		for(const std::string& path: cachePaths)
+		{
+			meshes.push_back(TriSoup::Load(path.c_str()));
+			if(!meshes.back())
+			{
+				std::cerr << "regenerating the rock over its cached copy, " << path << 
+					" couldn't be loaded" << std::endl;
+				return false;
+			}
+		}
+		data->m_mesh = meshes[0];
+		data->m_lods.assign(meshes.begin() + 1, meshes.end());
+		return true;
+	};
+
+	auto runFunc = [data, contourFunc, loadCachedFunc, cachePaths, useCache]() {
+		if(useCache && !cachePaths.empty() && loadCachedFunc())
+			return;
+
+		contourFunc();
+		if(!data->m_mesh)
+			return;
+		const TriSoup::CacheSortStats cacheStats = data->m_mesh->CacheSort(32);
+		std::cout << "rock cache sort: acmr " << cacheStats.m_before.m_acmr << " -> " << 
+			cacheStats.m_after.m_acmr << std::endl;
+
+		std::vector<float> ratios;
+		for(const RockLod& lod: g_rockLods)
+			ratios.push_back(lod.m_ratio);
+		data->m_lods = mesh_CreateLodChain(*data->m_mesh, ratios);
+		for(auto& lod: data->m_lods)
+			lod->CacheSort(32);
+
+		if(!cachePaths.empty() && data->m_lods.size() + 1 == cachePaths.size())
+		{
+			data->m_mesh->Save(cachePaths[0].c_str(), kRockVertexFormat, &g_rockVertexBounds);
+			for(size_t i = 0; i < data->m_lods.size(); ++i)
+				data->m_lods[i]->Save(cachePaths[i + 1].c_str(), kRockVertexFormat, &g_rockVertexBounds);
+		}
 	};
 
 	auto completeFunc = [data]() {
-		g_rockGeom = data->m_mesh->CreateGeom();
+		--g_rockGeomPending;
+		if(!data->m_mesh)
+			return;
+		g_rockDensity = data->m_density;
+		if(data->m_mesh->NumFaces() >= kRockMeshletMinFaces)
+			g_rockGeom = data->m_mesh->CreateMeshletGeom(g_rockMeshlets, 
+				kRockVertexFormat, &g_rockVertexBounds);
+		else
+		{
+			g_rockMeshlets.clear();
+			g_rockGeom = data->m_mesh->CreateGeom(kRockVertexFormat, &g_rockVertexBounds);
+		}
+		g_rockLodGeoms.clear();
+		for(auto& lod: data->m_lods)
+			g_rockLodGeoms.push_back(lod->CreateGeom(kRockVertexFormat, &g_rockVertexBounds));
+		g_rockGeomFormat = kRockVertexFormat;
+		g_rockGeomBounds = g_rockVertexBounds;
+		g_rockMesh = data->m_mesh;
+		g_rockMeshKey = data->m_key;
+		g_rockEditor.reset();
+		g_rockBrickGeoms.clear();
 	};
 
+	++g_rockGeomPending;
 	task_AppendTask(std::make_shared<Task>(nullptr, completeFunc, runFunc));
 }
 
+static void saveRockMesh()
+{
+	if(!g_rockMesh)
+		return;
+	if(!g_rockMeshKey)
+	{
+		std::cerr << "adaptive and sculpted rocks depend on more than their params, " <<
+			"so they can't be saved" << std::endl;
+		return;
+	}
+	if(g_rockMesh->Save(kRockMeshFile, kRockVertexFormat, &g_rockVertexBounds, g_rockMeshKey))
+		std::cout << "saved rock to " << kRockMeshFile << std::endl;
+}
+
+// Uploads kRockMeshFile as it's mapped, if there is one and it was made from
+// the current params.
+static bool loadRockMesh()
+{
+	// no file is the usual case, and not worth an error
+	struct stat st;
+	if(stat(kRockMeshFile, &st) != 0)
+		return false;
+	std::shared_ptr<MeshFileMapping> file = meshfile_Map(kRockMeshFile);
+	if(!file)
+		return false;
+
+	const RockContourMethod& method = 
+		g_rockContourMethods[g_rockContourMethodLimits(g_rockContourMethod)];
+	const unsigned int dim = method.m_sparse ? kRockSparseDensityDim : kRockDensityDim;
+	AssetKey key;
+	if(!makeRockGeomKey(m_densityParams, method, dim, key) || 
+		file->GetHeader().m_key != key.Get())
+	{
+		std::cout << "ignoring " << kRockMeshFile << ", it was made from other params" << std::endl;
+		return false;
+	}
+	std::shared_ptr<Geom> geom = meshfile_CreateGeom(*file);
+	if(!geom)
+		return false;
+	g_rockGeom = geom;
+	g_rockGeomFormat = file->GetHeader().m_vertexFormat;
+	g_rockGeomBounds = file->GetBounds();
+	return true;
+}
+
+// Adds (or with carve, removes) material where the main camera looks at the rock.
+static void sculptRock(bool carve)
+{
+	// generateRockGeom reads the field on a worker, so leave it alone until that's done.
+	// Sparse fields only have bricks near the surface, so they can't be sculpted.
+	if(g_rockGeomPending > 0 || !g_rockDensity || g_rockDensity->m_field.empty())
+		return;
+
+	if(!g_rockEditor)
+	{
+		const RockContourMethod& method = 
+			g_rockContourMethods[g_rockContourMethodLimits(g_rockContourMethod)];
+		RockDensityField& density = *g_rockDensity;
+		g_rockEditor = std::make_shared<DensityEditor>(&density.m_field[0],
+			density.m_dim, density.m_dim, density.m_dim,
+			density.m_pyramid.get(), density.m_params.m_isolevel, method.m_flags);
+		g_rockBrickGeoms.clear();
+		g_rockBrickGeoms.resize(g_rockEditor->NumBricks());
+	}
+
+	vec3 hit;
+	const vec3 origin = g_mainCamera->GetPos() / kRockScale;
+	if(g_rockEditor->Raycast(origin, g_mainCamera->GetViewframe().m_fwd, hit))
+	{
+		g_rockEditor->ApplySphere(hit, g_sculptRadius, carve ? -g_sculptAmount : g_sculptAmount);
+		g_rockDensity->m_sculpted = true;
+	}
+
+	std::vector<int> changed;
+	g_rockEditor->Update(changed);
+	for(int brick: changed)
+	{
+		const std::shared_ptr<TriSoup>& mesh = g_rockEditor->GetBrickMesh(brick);
+		if(mesh)
+			g_rockBrickGeoms[brick] = mesh->CreateGeom(g_rockGeomFormat, &g_rockGeomBounds);
+		else
+			g_rockBrickGeoms[brick].reset();
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+static ChunkCache::GenerateFunc makeTerrainGenerator()
+{
+	// chunks are generated on workers, so they get a snapshot of the params
+	const TerrainParams params = g_terrainParams;
+	return [params](const vec3& origin, float chunkSize) {
+		const float spacing = chunkSize / (kTerrainChunkDim - 1);
+		std::vector<float> field = computeTerrainDensityField(params, origin, spacing, kTerrainChunkDim);
+		// chunks are contoured side by side on the workers, so each one is serial
+		std::shared_ptr<TriSoup> mesh = surfcon_CreateMeshFromDensityField(0.f, &field[0], 
+			kTerrainChunkDim, kTerrainChunkDim, kTerrainChunkDim, SURFCON_MarchingCubes);
+		return mesh;
+	};
+}
+
+static void applyTerrainParams()
+{
+	g_terrainChunks->SetGenerateFunc(makeTerrainGenerator());
+	g_terrainChunks->Clear();
+}
+
 ////////////////////////////////////////////////////////////////////////////////	
 static void initialize()
 {
@@ -793,13 +1483,18 @@ static void initialize()
 	g_defaultComputeDevice = compute_GetCurrentDeviceName();
 	g_rockGenProgram = compute_CompileProgram("programs/rock.cl");
 	g_rockShader = render_CompileShader("shaders/rock.glsl", g_rockShaderUniforms);
-	g_shadowShader = render_CompileShader("shaders/shadow.glsl");
+	g_shadowShader = render_CompileShader("shaders/shadow.glsl", g_shadowShaderUniforms);
 	generateRockTexture();
-	// placeholder geom while it's being generated.
-	g_rockGeom = render_GenerateSphereGeom(10,10);
-	generateRockGeom();
+	if(!loadRockMesh())
+	{
+		// placeholder geom while it's being generated.
+		g_rockGeom = render_GenerateSphereGeom(10,10);
+		generateRockGeom();
+	}
 	g_groundGeom = render_GeneratePlaneGeom();
 	g_groundShader = render_CompileShader("shaders/ground.glsl", g_groundUniforms);
+	g_terrainChunks = std::make_shared<ChunkCache>(kTerrainChunkSize, kTerrainChunkDim, 
+		makeTerrainGenerator());
 
 	g_mainCamera = std::make_shared<Camera>(30.f, g_screen.m_aspect);
 	g_debugCamera = std::make_shared<Camera>(30.f, g_screen.m_aspect);
@@ -870,6 +1565,13 @@ static void update(Framedata& frame)
 	gputask_Join();
 	gputask_Kick();
 
+	if(g_terrainEnabled)
+	{
+		g_terrainChunks->SetViewRadius(g_terrainParams.m_viewRadius);
+		g_terrainChunks->SetMemoryBudget(size_t(Max(0, g_terrainParams.m_memoryBudgetMB)) << 20);
+		g_terrainChunks->Update(g_mainCamera->GetPos());
+	}
+
 	task_Update();
 }
 
@@ -989,6 +1691,12 @@ int main(void)
 									if(event.key.keysym.mod & KMOD_SHIFT)
 										g_screenshotRequested = true;
 									break;
+								case SDLK_e:
+									sculptRock(false);
+									break;
+								case SDLK_q:
+									sculptRock(true);
+									break;
 
 								default: break;
 							}
@@ -0,0 +1,316 @@
+#pragma once
+
+// Marching cubes case tables, indexed by a cube index with bit i set when
+// corner i is below the isolevel. Corner and edge numbering:
+//   corners: 0 (0,0,0)  1 (1,0,0)  2 (1,1,0)  3 (0,1,0)
+//            4 (0,0,1)  5 (1,0,1)  6 (1,1,1)  7 (0,1,1)
+//   edges:   0 0-1  1 1-2  2 2-3  3 3-0  4 4-5  5 5-6  6 6-7  7 7-4
+//            8 0-4  9 1-5  10 2-6  11 3-7
+// Ambiguous faces always keep the corners below the isolevel apart. The choice
+// only depends on the face's own corners, so neighbouring cubes agree on it and
+// the surface stays closed. Each loop is triangulated so no triangle or inner
+// edge lies in a cube face, where the neighbouring cube could make the same
+// one turned over and leave the surface non-manifold.
+
+static const int g_mcCubeEdges[12][2] =
+{
+	{ 0, 1 }, { 1, 2 }, { 2, 3 }, { 3, 0 },
+	{ 4, 5 }, { 5, 6 }, { 6, 7 }, { 7, 4 },
+	{ 0, 4 }, { 1, 5 }, { 2, 6 }, { 3, 7 },
+};
+
+static const unsigned short g_mcEdgeTable[256] =
+{
+	0x000, 0x109, 0x203, 0x30A, 0x406, 0x50F, 0x605, 0x70C,
+	0x80C, 0x905, 0xA0F, 0xB06, 0xC0A, 0xD03, 0xE09, 0xF00,
+	0x190, 0x099, 0x393, 0x29A, 0x596, 0x49F, 0x795, 0x69C,
+	0x99C, 0x895, 0xB9F, 0xA96, 0xD9A, 0xC93, 0xF99, 0xE90,
+	0x230, 0x339, 0x033, 0x13A, 0x636, 0x73F, 0x435, 0x53C,
+	0xA3C, 0xB35, 0x83F, 0x936, 0xE3A, 0xF33, 0xC39, 0xD30,
+	0x3A0, 0x2A9, 0x1A3, 0x0AA, 0x7A6, 0x6AF, 0x5A5, 0x4AC,
+	0xBAC, 0xAA5, 0x9AF, 0x8A6, 0xFAA, 0xEA3, 0xDA9, 0xCA0,
+	0x460, 0x569, 0x663, 0x76A, 0x066, 0x16F, 0x265, 0x36C,
+	0xC6C, 0xD65, 0xE6F, 0xF66, 0x86A, 0x963, 0xA69, 0xB60,
+	0x5F0, 0x4F9, 0x7F3, 0x6FA, 0x1F6, 0x0FF, 0x3F5, 0x2FC,
+	0xDFC, 0xCF5, 0xFFF, 0xEF6, 0x9FA, 0x8F3, 0xBF9, 0xAF0,
+	0x650, 0x759, 0x453, 0x55A, 0x256, 0x35F, 0x055, 0x15C,
+	0xE5C, 0xF55, 0xC5F, 0xD56, 0xA5A, 0xB53, 0x859, 0x950,
+	0x7C0, 0x6C9, 0x5C3, 0x4CA, 0x3C6, 0x2CF, 0x1C5, 0x0CC,
+	0xFCC, 0xEC5, 0xDCF, 0xCC6, 0xBCA, 0xAC3, 0x9C9, 0x8C0,
+	0x8C0, 0x9C9, 0xAC3, 0xBCA, 0xCC6, 0xDCF, 0xEC5, 0xFCC,
+	0x0CC, 0x1C5, 0x2CF, 0x3C6, 0x4CA, 0x5C3, 0x6C9, 0x7C0,
+	0x950, 0x859, 0xB53, 0xA5A, 0xD56, 0xC5F, 0xF55, 0xE5C,
+	0x15C, 0x055, 0x35F, 0x256, 0x55A, 0x453, 0x759, 0x650,
+	0xAF0, 0xBF9, 0x8F3, 0x9FA, 0xEF6, 0xFFF, 0xCF5, 0xDFC,
+	0x2FC, 0x3F5, 0x0FF, 0x1F6, 0x6FA, 0x7F3, 0x4F9, 0x5F0,
+	0xB60, 0xA69, 0x963, 0x86A, 0xF66, 0xE6F, 0xD65, 0xC6C,
+	0x36C, 0x265, 0x16F, 0x066, 0x76A, 0x663, 0x569, 0x460,
+	0xCA0, 0xDA9, 0xEA3, 0xFAA, 0x8A6, 0x9AF, 0xAA5, 0xBAC,
+	0x4AC, 0x5A5, 0x6AF, 0x7A6, 0x0AA, 0x1A3, 0x2A9, 0x3A0,
+	0xD30, 0xC39, 0xF33, 0xE3A, 0x936, 0x83F, 0xB35, 0xA3C,
+	0x53C, 0x435, 0x73F, 0x636, 0x13A, 0x033, 0x339, 0x230,
+	0xE90, 0xF99, 0xC93, 0xD9A, 0xA96, 0xB9F, 0x895, 0x99C,
+	0x69C, 0x795, 0x49F, 0x596, 0x29A, 0x393, 0x099, 0x190,
+	0xF00, 0xE09, 0xD03, 0xC0A, 0xB06, 0xA0F, 0x905, 0x80C,
+	0x70C, 0x605, 0x50F, 0x406, 0x30A, 0x203, 0x109, 0x000,
+};
+
+static const signed char g_mcTriTable[256][16] =
+{
+	{ -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  3,  8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  9,  1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  1,  3,  8,  1,  8,  9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  1, 10,  2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  3,  8,  1, 10,  2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  9, 10,  0, 10,  2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  2,  3,  8,  2,  8,  9,  2,  9, 10, -1, -1, -1, -1, -1, -1, -1 },
+	{  2, 11,  3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  2, 11,  0, 11,  8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  9,  1,  2, 11,  3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  1,  2, 11,  1, 11,  8,  1,  8,  9, -1, -1, -1, -1, -1, -1, -1 },
+	{  1, 10, 11,  1, 11,  3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  1, 10,  0, 10, 11,  0, 11,  8, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  9, 10,  0, 10, 11,  0, 11,  3, -1, -1, -1, -1, -1, -1, -1 },
+	{  8,  9, 10,  8, 10, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  4,  8,  7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  3,  7,  0,  7,  4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  9,  1,  4,  8,  7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  1,  3,  7,  1,  7,  4,  1,  4,  9, -1, -1, -1, -1, -1, -1, -1 },
+	{  1, 10,  2,  4,  8,  7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  3,  7,  0,  7,  4,  1, 10,  2, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  9, 10,  0, 10,  2,  4,  8,  7, -1, -1, -1, -1, -1, -1, -1 },
+	{  2,  3,  7,  2,  7,  4,  2,  4,  9,  2,  9, 10, -1, -1, -1, -1 },
+	{  2, 11,  3,  4,  8,  7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  2, 11,  0, 11,  7,  0,  7,  4, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  9,  1,  2, 11,  3,  4,  8,  7, -1, -1, -1, -1, -1, -1, -1 },
+	{  1,  2, 11,  1, 11,  7,  1,  7,  4,  1,  4,  9, -1, -1, -1, -1 },
+	{  1, 10, 11,  1, 11,  3,  4,  8,  7, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  1, 10,  0, 10, 11,  0, 11,  7,  0,  7,  4, -1, -1, -1, -1 },
+	{  0,  9, 10,  0, 10, 11,  0, 11,  3,  4,  8,  7, -1, -1, -1, -1 },
+	{  4,  9, 10,  4, 10, 11,  4, 11,  7, -1, -1, -1, -1, -1, -1, -1 },
+	{  4,  5,  9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  3,  8,  4,  5,  9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  4,  5,  0,  5,  1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  1,  3,  8,  1,  8,  4,  1,  4,  5, -1, -1, -1, -1, -1, -1, -1 },
+	{  1, 10,  2,  4,  5,  9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  3,  8,  1, 10,  2,  4,  5,  9, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  4,  5,  0,  5, 10,  0, 10,  2, -1, -1, -1, -1, -1, -1, -1 },
+	{  2,  3,  8,  2,  8,  4,  2,  4,  5,  2,  5, 10, -1, -1, -1, -1 },
+	{  2, 11,  3,  4,  5,  9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  2, 11,  0, 11,  8,  4,  5,  9, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  4,  5,  0,  5,  1,  2, 11,  3, -1, -1, -1, -1, -1, -1, -1 },
+	{  1,  2, 11,  1, 11,  8,  1,  8,  4,  1,  4,  5, -1, -1, -1, -1 },
+	{  1, 10, 11,  1, 11,  3,  4,  5,  9, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  1, 10,  0, 10, 11,  0, 11,  8,  4,  5,  9, -1, -1, -1, -1 },
+	{  0,  4,  5,  0,  5, 10,  0, 10, 11,  0, 11,  3, -1, -1, -1, -1 },
+	{  4,  5, 10,  4, 10, 11,  4, 11,  8, -1, -1, -1, -1, -1, -1, -1 },
+	{  5,  9,  8,  5,  8,  7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  3,  7,  0,  7,  5,  0,  5,  9, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  8,  7,  0,  7,  5,  0,  5,  1, -1, -1, -1, -1, -1, -1, -1 },
+	{  1,  3,  7,  1,  7,  5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  1, 10,  2,  5,  9,  8,  5,  8,  7, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  3,  7,  0,  7,  5,  0,  5,  9,  1, 10,  2, -1, -1, -1, -1 },
+	{  0,  8,  7,  0,  7,  5,  0,  5, 10,  0, 10,  2, -1, -1, -1, -1 },
+	{  2,  3,  7,  2,  7,  5,  2,  5, 10, -1, -1, -1, -1, -1, -1, -1 },
+	{  2, 11,  3,  5,  9,  8,  5,  8,  7, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  2, 11,  0, 11,  7,  0,  7,  5,  0,  5,  9, -1, -1, -1, -1 },
+	{  0,  8,  7,  0,  7,  5,  0,  5,  1,  2, 11,  3, -1, -1, -1, -1 },
+	{  1,  2, 11,  1, 11,  7,  1,  7,  5, -1, -1, -1, -1, -1, -1, -1 },
+	{  1, 10, 11,  1, 11,  3,  5,  9,  8,  5,  8,  7, -1, -1, -1, -1 },
+	{  0,  1, 10,  0, 10, 11,  0, 11,  7,  0,  7,  5,  0,  5,  9, -1 },
+	{  0,  8,  7,  0,  7,  5,  0,  5, 10,  0, 10, 11,  0, 11,  3, -1 },
+	{  5, 10, 11,  5, 11,  7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  5,  6, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  3,  8,  5,  6, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  9,  1,  5,  6, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  1,  3,  8,  1,  8,  9,  5,  6, 10, -1, -1, -1, -1, -1, -1, -1 },
+	{  1,  5,  6,  1,  6,  2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  3,  8,  1,  5,  6,  1,  6,  2, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  9,  5,  0,  5,  6,  0,  6,  2, -1, -1, -1, -1, -1, -1, -1 },
+	{  2,  3,  8,  2,  8,  9,  2,  9,  5,  2,  5,  6, -1, -1, -1, -1 },
+	{  2, 11,  3,  5,  6, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  2, 11,  0, 11,  8,  5,  6, 10, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  9,  1,  2, 11,  3,  5,  6, 10, -1, -1, -1, -1, -1, -1, -1 },
+	{  1,  2, 11,  1, 11,  8,  1,  8,  9,  5,  6, 10, -1, -1, -1, -1 },
+	{  1,  5,  6,  1,  6, 11,  1, 11,  3, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  1,  5,  0,  5,  6,  0,  6, 11,  0, 11,  8, -1, -1, -1, -1 },
+	{  0,  9,  5,  0,  5,  6,  0,  6, 11,  0, 11,  3, -1, -1, -1, -1 },
+	{  5,  6, 11,  5, 11,  8,  5,  8,  9, -1, -1, -1, -1, -1, -1, -1 },
+	{  4,  8,  7,  5,  6, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  3,  7,  0,  7,  4,  5,  6, 10, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  9,  1,  4,  8,  7,  5,  6, 10, -1, -1, -1, -1, -1, -1, -1 },
+	{  1,  3,  7,  1,  7,  4,  1,  4,  9,  5,  6, 10, -1, -1, -1, -1 },
+	{  1,  5,  6,  1,  6,  2,  4,  8,  7, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  3,  7,  0,  7,  4,  1,  5,  6,  1,  6,  2, -1, -1, -1, -1 },
+	{  0,  9,  5,  0,  5,  6,  0,  6,  2,  4,  8,  7, -1, -1, -1, -1 },
+	{  2,  3,  7,  2,  7,  4,  2,  4,  9,  2,  9,  5,  2,  5,  6, -1 },
+	{  2, 11,  3,  4,  8,  7,  5,  6, 10, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  2, 11,  0, 11,  7,  0,  7,  4,  5,  6, 10, -1, -1, -1, -1 },
+	{  0,  9,  1,  2, 11,  3,  4,  8,  7,  5,  6, 10, -1, -1, -1, -1 },
+	{  1,  2, 11,  1, 11,  7,  1,  7,  4,  1,  4,  9,  5,  6, 10, -1 },
+	{  1,  5,  6,  1,  6, 11,  1, 11,  3,  4,  8,  7, -1, -1, -1, -1 },
+	{  0,  1,  5,  0,  5,  6,  0,  6, 11,  0, 11,  7,  0,  7,  4, -1 },
+	{  0,  9,  5,  0,  5,  6,  0,  6, 11,  0, 11,  3,  4,  8,  7, -1 },
+	{  9,  5,  6,  9,  6, 11,  9, 11,  7,  9,  7,  4, -1, -1, -1, -1 },
+	{  4,  6, 10,  4, 10,  9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  3,  8,  4,  6, 10,  4, 10,  9, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  4,  6,  0,  6, 10,  0, 10,  1, -1, -1, -1, -1, -1, -1, -1 },
+	{  1,  3,  8,  1,  8,  4,  1,  4,  6,  1,  6, 10, -1, -1, -1, -1 },
+	{  1,  9,  4,  1,  4,  6,  1,  6,  2, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  3,  8,  1,  9,  4,  1,  4,  6,  1,  6,  2, -1, -1, -1, -1 },
+	{  0,  4,  6,  0,  6,  2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  2,  3,  8,  2,  8,  4,  2,  4,  6, -1, -1, -1, -1, -1, -1, -1 },
+	{  2, 11,  3,  4,  6, 10,  4, 10,  9, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  2, 11,  0, 11,  8,  4,  6, 10,  4, 10,  9, -1, -1, -1, -1 },
+	{  0,  4,  6,  0,  6, 10,  0, 10,  1,  2, 11,  3, -1, -1, -1, -1 },
+	{  1,  2, 11,  1, 11,  8,  1,  8,  4,  1,  4,  6,  1,  6, 10, -1 },
+	{  1,  9,  4,  1,  4,  6,  1,  6, 11,  1, 11,  3, -1, -1, -1, -1 },
+	{  1,  9,  4,  1,  4,  6,  1,  6, 11,  1, 11,  8,  1,  8,  0, -1 },
+	{  0,  4,  6,  0,  6, 11,  0, 11,  3, -1, -1, -1, -1, -1, -1, -1 },
+	{  4,  6, 11,  4, 11,  8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  6, 10,  9,  6,  9,  8,  6,  8,  7, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  3,  7,  0,  7,  6,  0,  6, 10,  0, 10,  9, -1, -1, -1, -1 },
+	{  0,  8,  7,  0,  7,  6,  0,  6, 10,  0, 10,  1, -1, -1, -1, -1 },
+	{  1,  3,  7,  1,  7,  6,  1,  6, 10, -1, -1, -1, -1, -1, -1, -1 },
+	{  1,  9,  8,  1,  8,  7,  1,  7,  6,  1,  6,  2, -1, -1, -1, -1 },
+	{  7,  6,  2,  7,  2,  1,  7,  1,  9,  7,  9,  0,  7,  0,  3, -1 },
+	{  0,  8,  7,  0,  7,  6,  0,  6,  2, -1, -1, -1, -1, -1, -1, -1 },
+	{  2,  3,  7,  2,  7,  6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  2, 11,  3,  6, 10,  9,  6,  9,  8,  6,  8,  7, -1, -1, -1, -1 },
+	{  0,  2, 11,  0, 11,  7,  0,  7,  6,  0,  6, 10,  0, 10,  9, -1 },
+	{  0,  8,  7,  0,  7,  6,  0,  6, 10,  0, 10,  1,  2, 11,  3, -1 },
+	{  1,  2, 11,  1, 11,  7,  1,  7,  6,  1,  6, 10, -1, -1, -1, -1 },
+	{  1,  9,  8,  1,  8,  7,  1,  7,  6,  1,  6, 11,  1, 11,  3, -1 },
+	{  0,  1,  9,  6, 11,  7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  8,  7,  0,  7,  6,  0,  6, 11,  0, 11,  3, -1, -1, -1, -1 },
+	{  6, 11,  7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  6,  7, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  3,  8,  6,  7, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  9,  1,  6,  7, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  1,  3,  8,  1,  8,  9,  6,  7, 11, -1, -1, -1, -1, -1, -1, -1 },
+	{  1, 10,  2,  6,  7, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  3,  8,  1, 10,  2,  6,  7, 11, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  9, 10,  0, 10,  2,  6,  7, 11, -1, -1, -1, -1, -1, -1, -1 },
+	{  2,  3,  8,  2,  8,  9,  2,  9, 10,  6,  7, 11, -1, -1, -1, -1 },
+	{  2,  6,  7,  2,  7,  3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  2,  6,  0,  6,  7,  0,  7,  8, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  9,  1,  2,  6,  7,  2,  7,  3, -1, -1, -1, -1, -1, -1, -1 },
+	{  1,  2,  6,  1,  6,  7,  1,  7,  8,  1,  8,  9, -1, -1, -1, -1 },
+	{  1, 10,  6,  1,  6,  7,  1,  7,  3, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  1, 10,  0, 10,  6,  0,  6,  7,  0,  7,  8, -1, -1, -1, -1 },
+	{  0,  9, 10,  0, 10,  6,  0,  6,  7,  0,  7,  3, -1, -1, -1, -1 },
+	{  6,  7,  8,  6,  8,  9,  6,  9, 10, -1, -1, -1, -1, -1, -1, -1 },
+	{  4,  8, 11,  4, 11,  6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  3, 11,  0, 11,  6,  0,  6,  4, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  9,  1,  4,  8, 11,  4, 11,  6, -1, -1, -1, -1, -1, -1, -1 },
+	{  1,  3, 11,  1, 11,  6,  1,  6,  4,  1,  4,  9, -1, -1, -1, -1 },
+	{  1, 10,  2,  4,  8, 11,  4, 11,  6, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  3, 11,  0, 11,  6,  0,  6,  4,  1, 10,  2, -1, -1, -1, -1 },
+	{  0,  9, 10,  0, 10,  2,  4,  8, 11,  4, 11,  6, -1, -1, -1, -1 },
+	{  3, 11,  6,  3,  6,  4,  3,  4,  9,  3,  9, 10,  3, 10,  2, -1 },
+	{  2,  6,  4,  2,  4,  8,  2,  8,  3, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  2,  6,  0,  6,  4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  9,  1,  2,  6,  4,  2,  4,  8,  2,  8,  3, -1, -1, -1, -1 },
+	{  1,  2,  6,  1,  6,  4,  1,  4,  9, -1, -1, -1, -1, -1, -1, -1 },
+	{  1, 10,  6,  1,  6,  4,  1,  4,  8,  1,  8,  3, -1, -1, -1, -1 },
+	{  0,  1, 10,  0, 10,  6,  0,  6,  4, -1, -1, -1, -1, -1, -1, -1 },
+	{ 10,  6,  4, 10,  4,  8, 10,  8,  3, 10,  3,  0, 10,  0,  9, -1 },
+	{  4,  9, 10,  4, 10,  6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  4,  5,  9,  6,  7, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  3,  8,  4,  5,  9,  6,  7, 11, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  4,  5,  0,  5,  1,  6,  7, 11, -1, -1, -1, -1, -1, -1, -1 },
+	{  1,  3,  8,  1,  8,  4,  1,  4,  5,  6,  7, 11, -1, -1, -1, -1 },
+	{  1, 10,  2,  4,  5,  9,  6,  7, 11, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  3,  8,  1, 10,  2,  4,  5,  9,  6,  7, 11, -1, -1, -1, -1 },
+	{  0,  4,  5,  0,  5, 10,  0, 10,  2,  6,  7, 11, -1, -1, -1, -1 },
+	{  2,  3,  8,  2,  8,  4,  2,  4,  5,  2,  5, 10,  6,  7, 11, -1 },
+	{  2,  6,  7,  2,  7,  3,  4,  5,  9, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  2,  6,  0,  6,  7,  0,  7,  8,  4,  5,  9, -1, -1, -1, -1 },
+	{  0,  4,  5,  0,  5,  1,  2,  6,  7,  2,  7,  3, -1, -1, -1, -1 },
+	{  1,  2,  6,  1,  6,  7,  1,  7,  8,  1,  8,  4,  1,  4,  5, -1 },
+	{  1, 10,  6,  1,  6,  7,  1,  7,  3,  4,  5,  9, -1, -1, -1, -1 },
+	{  0,  1, 10,  0, 10,  6,  0,  6,  7,  0,  7,  8,  4,  5,  9, -1 },
+	{  0,  4,  5,  0,  5, 10,  0, 10,  6,  0,  6,  7,  0,  7,  3, -1 },
+	{ 10,  6,  7, 10,  7,  8, 10,  8,  4, 10,  4,  5, -1, -1, -1, -1 },
+	{  5,  9,  8,  5,  8, 11,  5, 11,  6, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  3, 11,  0, 11,  6,  0,  6,  5,  0,  5,  9, -1, -1, -1, -1 },
+	{  0,  8, 11,  0, 11,  6,  0,  6,  5,  0,  5,  1, -1, -1, -1, -1 },
+	{  1,  3, 11,  1, 11,  6,  1,  6,  5, -1, -1, -1, -1, -1, -1, -1 },
+	{  1, 10,  2,  5,  9,  8,  5,  8, 11,  5, 11,  6, -1, -1, -1, -1 },
+	{  0,  3, 11,  0, 11,  6,  0,  6,  5,  0,  5,  9,  1, 10,  2, -1 },
+	{  0,  8, 11,  0, 11,  6,  0,  6,  5,  0,  5, 10,  0, 10,  2, -1 },
+	{  3, 11,  6,  3,  6,  5,  3,  5, 10,  3, 10,  2, -1, -1, -1, -1 },
+	{  2,  6,  5,  2,  5,  9,  2,  9,  8,  2,  8,  3, -1, -1, -1, -1 },
+	{  0,  2,  6,  0,  6,  5,  0,  5,  9, -1, -1, -1, -1, -1, -1, -1 },
+	{  8,  3,  2,  8,  2,  6,  8,  6,  5,  8,  5,  1,  8,  1,  0, -1 },
+	{  1,  2,  6,  1,  6,  5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  6,  5,  9,  6,  9,  8,  6,  8,  3,  6,  3,  1,  6,  1, 10, -1 },
+	{  0,  1, 10,  0, 10,  6,  0,  6,  5,  0,  5,  9, -1, -1, -1, -1 },
+	{  0,  8,  3,  5, 10,  6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  5, 10,  6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  5,  7, 11,  5, 11, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  3,  8,  5,  7, 11,  5, 11, 10, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  9,  1,  5,  7, 11,  5, 11, 10, -1, -1, -1, -1, -1, -1, -1 },
+	{  1,  3,  8,  1,  8,  9,  5,  7, 11,  5, 11, 10, -1, -1, -1, -1 },
+	{  1,  5,  7,  1,  7, 11,  1, 11,  2, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  3,  8,  1,  5,  7,  1,  7, 11,  1, 11,  2, -1, -1, -1, -1 },
+	{  0,  9,  5,  0,  5,  7,  0,  7, 11,  0, 11,  2, -1, -1, -1, -1 },
+	{  2,  3,  8,  2,  8,  9,  2,  9,  5,  2,  5,  7,  2,  7, 11, -1 },
+	{  2, 10,  5,  2,  5,  7,  2,  7,  3, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  2, 10,  0, 10,  5,  0,  5,  7,  0,  7,  8, -1, -1, -1, -1 },
+	{  0,  9,  1,  2, 10,  5,  2,  5,  7,  2,  7,  3, -1, -1, -1, -1 },
+	{  2, 10,  5,  2,  5,  7,  2,  7,  8,  2,  8,  9,  2,  9,  1, -1 },
+	{  1,  5,  7,  1,  7,  3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  1,  5,  0,  5,  7,  0,  7,  8, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  9,  5,  0,  5,  7,  0,  7,  3, -1, -1, -1, -1, -1, -1, -1 },
+	{  5,  7,  8,  5,  8,  9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  4,  8, 11,  4, 11, 10,  4, 10,  5, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  3, 11,  0, 11, 10,  0, 10,  5,  0,  5,  4, -1, -1, -1, -1 },
+	{  0,  9,  1,  4,  8, 11,  4, 11, 10,  4, 10,  5, -1, -1, -1, -1 },
+	{  3, 11, 10,  3, 10,  5,  3,  5,  4,  3,  4,  9,  3,  9,  1, -1 },
+	{  1,  5,  4,  1,  4,  8,  1,  8, 11,  1, 11,  2, -1, -1, -1, -1 },
+	{ 11,  2,  1, 11,  1,  5, 11,  5,  4, 11,  4,  0, 11,  0,  3, -1 },
+	{  5,  4,  8,  5,  8, 11,  5, 11,  2,  5,  2,  0,  5,  0,  9, -1 },
+	{  2,  3, 11,  4,  9,  5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  2, 10,  5,  2,  5,  4,  2,  4,  8,  2,  8,  3, -1, -1, -1, -1 },
+	{  0,  2, 10,  0, 10,  5,  0,  5,  4, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  9,  1,  2, 10,  5,  2,  5,  4,  2,  4,  8,  2,  8,  3, -1 },
+	{  2, 10,  5,  2,  5,  4,  2,  4,  9,  2,  9,  1, -1, -1, -1, -1 },
+	{  1,  5,  4,  1,  4,  8,  1,  8,  3, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  1,  5,  0,  5,  4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  5,  4,  8,  5,  8,  3,  5,  3,  0,  5,  0,  9, -1, -1, -1, -1 },
+	{  4,  9,  5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  4,  7, 11,  4, 11, 10,  4, 10,  9, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  3,  8,  4,  7, 11,  4, 11, 10,  4, 10,  9, -1, -1, -1, -1 },
+	{  0,  4,  7,  0,  7, 11,  0, 11, 10,  0, 10,  1, -1, -1, -1, -1 },
+	{  1,  3,  8,  1,  8,  4,  1,  4,  7,  1,  7, 11,  1, 11, 10, -1 },
+	{  1,  9,  4,  1,  4,  7,  1,  7, 11,  1, 11,  2, -1, -1, -1, -1 },
+	{  0,  3,  8,  1,  9,  4,  1,  4,  7,  1,  7, 11,  1, 11,  2, -1 },
+	{  0,  4,  7,  0,  7, 11,  0, 11,  2, -1, -1, -1, -1, -1, -1, -1 },
+	{  2,  3,  8,  2,  8,  4,  2,  4,  7,  2,  7, 11, -1, -1, -1, -1 },
+	{  2, 10,  9,  2,  9,  4,  2,  4,  7,  2,  7,  3, -1, -1, -1, -1 },
+	{  2, 10,  9,  2,  9,  4,  2,  4,  7,  2,  7,  8,  2,  8,  0, -1 },
+	{  4,  7,  3,  4,  3,  2,  4,  2, 10,  4, 10,  1,  4,  1,  0, -1 },
+	{  1,  2, 10,  4,  7,  8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  1,  9,  4,  1,  4,  7,  1,  7,  3, -1, -1, -1, -1, -1, -1, -1 },
+	{  1,  9,  4,  1,  4,  7,  1,  7,  8,  1,  8,  0, -1, -1, -1, -1 },
+	{  0,  4,  7,  0,  7,  3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  4,  7,  8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  8, 11, 10,  8, 10,  9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  3, 11,  0, 11, 10,  0, 10,  9, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  8, 11,  0, 11, 10,  0, 10,  1, -1, -1, -1, -1, -1, -1, -1 },
+	{  1,  3, 11,  1, 11, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  1,  9,  8,  1,  8, 11,  1, 11,  2, -1, -1, -1, -1, -1, -1, -1 },
+	{ 11,  2,  1, 11,  1,  9, 11,  9,  0, 11,  0,  3, -1, -1, -1, -1 },
+	{  0,  8, 11,  0, 11,  2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  2,  3, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  2, 10,  9,  2,  9,  8,  2,  8,  3, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  2, 10,  0, 10,  9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  8,  3,  2,  8,  2, 10,  8, 10,  1,  8,  1,  0, -1, -1, -1, -1 },
+	{  1,  2, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  1,  9,  8,  1,  8,  3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  1,  9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{  0,  8,  3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{ -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+};
@@ -1,8 +1,10 @@
 #include "common.hh"
 #include "mesh.hh"
+#include "task.hh"
 #include <algorithm>
+#include <cstddef>
+#include <cstring>
 #include <limits>
-#include "render.hh"
 
 ////////////////////////////////////////////////////////////////////////////////
 	TriSoup::TriSoup()
@@ -24,6 +26,13 @@ int TriSoup::AddVertex(const vec3& pos)
 	return idx;
 }
 
+int TriSoup::AddVertex(const vec3& pos, const vec3& normal)
+{
+	int idx = m_vertices.size();
+	m_vertices.emplace_back(pos, normal);
+	return idx;
+}
+
 int TriSoup::AddFace(int v0, int v1, int v2)
 {
 	int idx = m_faces.size();
@@ -49,6 +58,11 @@ const vec3& TriSoup::GetVertexNormal(int index) const
 	return m_vertices[index].m_normal;
 }
 
+void TriSoup::SetVertexNormal(int index, const vec3& normal)
+{
+	m_vertices[index].m_normal = normal;
+}
+
 void TriSoup::GetFace(int index, int (&indices)[3]) const
 {
 	const Face& face = m_faces[index];
@@ -57,353 +71,137 @@ void TriSoup::GetFace(int index, int (&indices)[3]) const
 }
 
 // Cache sorting
-// See: http://home.comcast.net/~tom_forsyth/papers/fast_vert_cache_opt.html
+// Tipsify, from Sander, Nehab & Barczak, "Fast Triangle Reordering for Vertex
+// Locality and Reduced Overdraw". It walks the mesh fanning out around one 
+// vertex at a time, picking the next fan's vertex from those just emitted by
+// whether it's still in a FIFO cache, and falls back to a stack of recently 
+// used vertices, then a scan, at dead ends. Every step is bounded by the 
+// adjacency it visits, so the whole sort is linear.
 
 ////////////////////////////////////////////////////////////////////////////////
-// Resorting part
-// Finds a draw list using reindexing. Will put vertices in order of appearance
-// int the draw list, remapping the indices as it goes. 
-// The contents of the part will be overwritten.
-void TriSoup::CacheSort(int lruSize)
+// Reorders faces for the post transform cache, then puts vertices in order of
+// first use in the new face order.
+TriSoup::CacheSortStats TriSoup::CacheSort(int cacheSize)
 {
+	CacheSortStats stats;
+	stats.m_before = ComputeCacheStats(cacheSize);
 	std::vector<int> faceOrder;
-	ReindexTriangles(lruSize, faceOrder);
+	ReindexTriangles(cacheSize, faceOrder);
 	RemapData(faceOrder);
+	stats.m_after = ComputeCacheStats(cacheSize);
+	return stats;
 }
 
-////////////////////////////////////////////////////////////////////////////////
-// LRU cache model for verts
-namespace CacheSort
+// Misses of a FIFO cache of cacheSize vertices, per face (ACMR) and per vertex
+// (ATVR). 0.5 and 1 are the best a large regular mesh can do.
+TriSoup::CacheStats TriSoup::ComputeCacheStats(int cacheSize) const
 {
-	////////////////////////////////////////////////////////////////////////////////        
-	// Constnats
-	static const float kInitialScore = 0.75f;
-	static const float kLruScorePower = 1.5f; // exponential score, dampens small values a little faster than linear
-	static const float kValencyScale = 2.f;
-	static const float kValencyPower = -0.5f; // scales small numbers a lot
-
-	////////////////////////////////////////////////////////////////////////////////
-	// Helper structures
-
-	////////////////////////////////////////////////////////////////////////////////        
-	struct Vertex
-	{
-		Vertex() ;
-
-		float m_score;
-		mutable int m_cacheIndex;
-		int m_valency;
-		int m_numFaces;
-		std::vector<int> m_clientFaces;
-
-		void InitClientFaces(int size);
-		void ComputeScore(int lruSize);
-	};
-
-	Vertex::Vertex() 
-		: m_score(0.f)
-		, m_cacheIndex(-1)
-		, m_valency(0)
-		, m_numFaces(0)
-		, m_clientFaces()
-	{
-	}
-	void Vertex::InitClientFaces(int size) 
-	{
-		m_clientFaces.resize(size);
-		std::fill(m_clientFaces.begin(), m_clientFaces.end(), -1);
-	}
-
-	void Vertex::ComputeScore(int cacheSize)
-	{
-		float score = 0.f;
-		if(m_cacheIndex >= 0)   
-		{
-			if(m_cacheIndex < 3) {
-				score = kInitialScore;
-			} else {
-				float t = 1.f - (( m_cacheIndex - 3) / float(cacheSize - 3));
-				score = powf(t, kLruScorePower);
-			}
-		} 
-
-		float valencyBoost = kValencyScale * powf( (float)m_valency, kValencyPower );
-		score += valencyBoost;
-
-		m_score = score;
-	}
-
-	////////////////////////////////////////////////////////////////////////////////        
-	struct Face
-	{
-		Face();
-
-		static void RemoveConnections(int myIndex, std::vector<Vertex>& verts, std::vector<Face>& faces);
-
-		int m_indices[3];
-		bool m_drawn;
-	};
-
-	Face::Face()
-		: m_indices{0,0,0}
-		, m_drawn(false)
-	{
-	}
-
-	void Face::RemoveConnections(int myIndex, std::vector<Vertex>& verts, std::vector<Face>& faces)
-	{
-		for(int i = 0; i < 3; ++i) 
-		{
-			int idxVert = faces[myIndex].m_indices[i];
-			// remove the curFace from the client faces of each vertex touching this face
-			for(int j = 0; j < verts[idxVert].m_valency; ++j)
-			{
-				int idxFace = verts[idxVert].m_clientFaces[j] ;
-				if( idxFace == myIndex )
-				{
-					int last = verts[idxVert].m_valency - 1;
-					verts[idxVert].m_clientFaces[j] = 
-						verts[idxVert].m_clientFaces[last];
-					verts[ idxVert ].m_valency = last;
-					break;
-				}
-			}
-			ASSERT(verts[idxVert].m_valency >= 0);
-		}
-	}
-	////////////////////////////////////////////////////////////////////////////////        
-	class VertexLRU
-	{
-		int m_maxCacheSize;
-		std::vector<int> m_cache;
-		std::vector<int> m_cacheOther;
-
-		int FindVert(int vertId )
-		{
-			for(int i = 0; i < m_maxCacheSize; ++i) {
-				if(m_cache[i] == vertId)
-					return i;
-			}
-			return -1;
-		}
-
-		void AddVert(const std::vector<Vertex>& verts, int vertIdx, int faceVertIdx)
-		{
-			ASSERT(faceVertIdx >= 0 && faceVertIdx < 3);
-			const Vertex* vert = &verts[vertIdx];
-			if(vert->m_cacheIndex >= 0)
-			{
-				ASSERT(vert->m_cacheIndex < m_maxCacheSize);
-				m_cache[vert->m_cacheIndex] = -1;
-			}
-			m_cacheOther[faceVertIdx] = vertIdx;
-			vert->m_cacheIndex = faceVertIdx;       // it'll be one of the first 3 indices so assigning the
-			// face vert index is reasonable.
-		}
-
-	public:
-		VertexLRU(int size)
-			: m_maxCacheSize(size)
-			, m_cache(size, -1)
-			, m_cacheOther(size, -1)
-		{
-		}
-		void AddFace(Face* f, std::vector<Vertex>& verts) 
-		{       
-			ASSERT(!f->m_drawn);
-			f->m_drawn = true;
-			for(int i = 0; i < 3; ++i) {
-				int vertIdx = f->m_indices[i];
-				AddVert(verts, vertIdx, i);
-			}
-
-			int srcIdx = 0;
-			int destIdx = 3;
-			while( srcIdx < m_maxCacheSize && destIdx < m_maxCacheSize)
-			{
-				// A vert has been moved if it was added when already in the cache, so skip over those.
-				if(m_cache[srcIdx] >= 0) {
-					m_cacheOther[destIdx] = m_cache[srcIdx];
-					verts[m_cacheOther[destIdx]].m_cacheIndex = destIdx;
-					++destIdx;
-				}
-				++srcIdx;
-			}
-
-			// Let the verts that have been pushed out of the cache know that they're no longer there.
-			for(int j = srcIdx; j < m_maxCacheSize; ++j) {
-				if(m_cache[j] >= 0) {
-					verts[m_cache[j]].m_cacheIndex = -1;
-				}
-			}
-
-			m_cache.swap(m_cacheOther);
-		}
-
-		void Truncate(int size, std::vector<Vertex>& verts) 
-		{
-			for(int i = size; i < m_maxCacheSize; ++i) {
-				if(m_cache[i] >= 0) {
-					verts[m_cache[i]].m_cacheIndex = -1;
-				}
-				m_cache[i] = -1;
-			}
-		}
-
-		const int* GetVertexCache() const { return &m_cache[0]; }
-		int GetCacheSize() const { return m_maxCacheSize; }
-	};
-	////////////////////////////////////////////////////////////////////////////////
-	// Sorting code
-
-	// Return the best face, disregarding the LRU. Used for initialization.
-	int FindBestFaceGlobal(std::vector<Vertex>& verts, std::vector<Face>& faces)
-	{
-		for(int i = 0, c = verts.size(); i < c; ++i)
-			verts[i].ComputeScore(0);
-
-		int bestFaceIdx = -1;
-		float bestScore = 0.f;
-
-		for(int i = 0, c = faces.size(); i < c; ++i)
-		{
-			// If this is the first time, no faces will have been drawn, but in case this funtion
-			// gets used for something else, later...
-			if(!faces[i].m_drawn)
-			{
-				float faceScore = 
-					verts[faces[i].m_indices[0]].m_score +
-					verts[faces[i].m_indices[1]].m_score +
-					verts[faces[i].m_indices[2]].m_score ;
-
-				if(faceScore > bestScore) {
-					bestFaceIdx = i;
-					bestScore = faceScore;
-				}
-			}
-
-		}
-
-		return bestFaceIdx;
-	}
-	void InitValence(std::vector<Vertex>& verts, std::vector<Face>& faces)
+	std::vector<int> cacheTime(NumVertices(), -cacheSize - 1);
+	int time = 0;
+	for(const auto& face: m_faces)
 	{
-		for(int i = 0, c = verts.size(); i < c; ++i) 
-			verts[i].m_numFaces = 0;
-
-		for(int i = 0, c = faces.size(); i < c; ++i)
+		for(int vert: face.m_vertices)
 		{
-			for(int j = 0; j < 3; ++j)
-			{
-				int vertIdx = faces[i].m_indices[j] ; 
-				if(vertIdx >= (int)verts.size()) {
-					std::cerr << "vert idx " << vertIdx << " is out of range (# verts " <<
-						verts.size() << ")" << std::endl;
-					exit(1);
-				}
-				Vertex& vert = verts[vertIdx];
-				++vert.m_numFaces;
-			}
-		}
-
-		for(int i = 0, c = verts.size(); i < c; ++i)
-		{
-			Vertex& vert = verts[i];
-			vert.m_valency = 0;
-			vert.InitClientFaces( vert.m_numFaces );
-		}
-
-		for(int i = 0, c = faces.size(); i < c; ++i)
-		{
-			for(int j = 0; j < 3; ++j)
-			{
-				Vertex& vert = verts[ faces[i].m_indices[j] ];
-				vert.m_clientFaces[ vert.m_valency++ ] = i;
-			}
+			if(time - cacheTime[vert] > cacheSize)
+				cacheTime[vert] = time++;
 		}
 	}
 
+	CacheStats stats;
+	stats.m_acmr = m_faces.empty() ? 0.f : time / float(NumFaces());
+	stats.m_atvr = m_vertices.empty() ? 0.f : time / float(NumVertices());
+	return stats;
 }
 
-void TriSoup::ReindexTriangles(int lruSize, std::vector<int>& outFaceOrder)
+void TriSoup::ReindexTriangles(int cacheSize, std::vector<int>& outFaceOrder)
 {
-	////////////////////////////////////////        
-	// Init vert and face arrays.
 	const int numVerts = NumVertices();
 	const int numTris = NumFaces();
 
-	std::vector<CacheSort::Vertex> verts(numVerts);
-	std::vector<CacheSort::Face> faces(numTris);
-
-	for(int i = 0, c = NumFaces(); i < c; ++i)
+	// faces of vertex v are vertFaces[firstFace[v]] .. vertFaces[firstFace[v + 1] - 1]
+	std::vector<int> firstFace(numVerts + 1, 0);
+	for(const auto& face: m_faces)
+		for(int vert: face.m_vertices)
+			++firstFace[vert + 1];
+	for(int i = 0; i < numVerts; ++i)
+		firstFace[i + 1] += firstFace[i];
+	std::vector<int> vertFaces(3 * numTris);
 	{
-		faces[i].m_indices[0] = m_faces[i].m_vertices[0];
-		faces[i].m_indices[1] = m_faces[i].m_vertices[1];
-		faces[i].m_indices[2] = m_faces[i].m_vertices[2];
+		std::vector<int> cursor(firstFace.begin(), firstFace.end() - 1);
+		for(int i = 0; i < numTris; ++i)
+			for(int vert: m_faces[i].m_vertices)
+				vertFaces[cursor[vert]++] = i;
 	}
 
-	CacheSort::InitValence(verts, faces);
-
-	outFaceOrder = std::vector<int>(numTris, -1);
-
-	////////////////////////////////////////        
-	// Finished init. now start the main loop
-	CacheSort::VertexLRU lru(lruSize+3); // 3 extra to hold up to 3 verts which get pushed off.
-	const int *cache = lru.GetVertexCache();
-	int cacheSize = lru.GetCacheSize();
-
-	int idxDrawList = 0;
+	std::vector<int> liveFaces(numVerts);
+	for(int i = 0; i < numVerts; ++i)
+		liveFaces[i] = firstFace[i + 1] - firstFace[i];
+	std::vector<int> cacheTime(numVerts, 0);
+	std::vector<bool> emitted(numTris, false);
+	std::vector<int> deadEnds;
+	std::vector<int> candidates;
+	int time = cacheSize + 1;
+	int scan = 0;
+
+	outFaceOrder.clear();
+	outFaceOrder.reserve(numTris);
+
+	// next fan vertex after a dead end: a recently used one if any still has 
+	// faces left, otherwise the next one in index order that does
+	auto skipDeadEnd = [&]() {
+		while(!deadEnds.empty())
+		{
+			const int vert = deadEnds.back();
+			deadEnds.pop_back();
+			if(liveFaces[vert] > 0)
+				return vert;
+		}
+		for(; scan < numVerts; ++scan)
+			if(liveFaces[scan] > 0)
+				return scan;
+		return -1;
+	};
 
-	int curFace = CacheSort::FindBestFaceGlobal(verts, faces);
-	while(curFace >= 0) 
+	int fan = numVerts > 0 ? 0 : -1;
+	while(fan >= 0)
 	{
-		ASSERT( idxDrawList < numTris );
-
-		// Add this face to the draw list.
-		outFaceOrder[idxDrawList++] = curFace;
-		lru.AddFace(&faces[curFace], verts);
-
-		// decrement current valency so we don't keep computing scores for already drawn faces
-		CacheSort::Face::RemoveConnections(curFace, verts, faces);
-
-		// Recompute scores of all verts in the LRU
-		for(int i = 0; i < cacheSize && cache[i] >= 0; ++i)
+		candidates.clear();
+		for(int i = firstFace[fan]; i < firstFace[fan + 1]; ++i)
 		{
-			int idxVert = cache[i];
-			verts[idxVert].ComputeScore(cacheSize);
+			const int faceIdx = vertFaces[i];
+			if(emitted[faceIdx])
+				continue;
+			emitted[faceIdx] = true;
+			outFaceOrder.push_back(faceIdx);
+			for(int vert: m_faces[faceIdx].m_vertices)
+			{
+				deadEnds.push_back(vert);
+				candidates.push_back(vert);
+				--liveFaces[vert];
+				if(time - cacheTime[vert] > cacheSize)
+					cacheTime[vert] = time++;
+			}
 		}
 
-		int bestFace = -1;
-		float bestFaceScore = 0.f;
-
-		// Recompute scores of all faces whose scores would change due to changes in the LRU
-		for(int i = 0; i < cacheSize && cache[i] >= 0; ++i)
+		// prefer the candidate that's been in the cache longest, as long as
+		// its remaining faces won't push it out
+		int best = -1, bestPriority = -1;
+		for(int vert: candidates)
 		{
-			int idxVert = cache[i];
-			for(int j = 0; j < verts[idxVert].m_valency; ++j) 
+			if(liveFaces[vert] <= 0)
+				continue;
+			int priority = 0;
+			if(time - cacheTime[vert] + 2 * liveFaces[vert] <= cacheSize)
+				priority = time - cacheTime[vert];
+			if(priority > bestPriority)
 			{
-				int idxFace = verts[idxVert].m_clientFaces[j];
-				float faceScore = 
-					verts[ faces[idxFace].m_indices[0] ].m_score +
-					verts[ faces[idxFace].m_indices[1] ].m_score +
-					verts[ faces[idxFace].m_indices[2] ].m_score ;
-
-				if (faceScore > bestFaceScore) {
-					bestFace = idxFace;
-					bestFaceScore = faceScore;
-				}
+				best = vert;
+				bestPriority = priority;
 			}
 		}
-		// Truncate the extra 3 verts. This just means if the next face includes one of the removed verts, it will be added instead of
-		// swapped, which will push more verts off. Also it means those 3 verts will NOT be included in scoring next iteration.
-		lru.Truncate(lruSize, verts);
-
-		// If for some reason the valency information doesn't link adjacent faces, then just pick the best global face again.
-		if( bestFace < 0 ) 
-			curFace = CacheSort::FindBestFaceGlobal(verts, faces);
-		else
-			curFace = bestFace;
+		fan = best >= 0 ? best : skipDeadEnd();
 	}
+	ASSERT(int(outFaceOrder.size()) == numTris);
 }
 
 void TriSoup::RemapData( const std::vector<int>& faceOrder )
@@ -449,7 +247,7 @@ void TriSoup::Merge(const TriSoup* other)
 	const int prevNumVerts = NumVertices();
 
 	for(int i = 0, c = other->NumVertices(); i < c; ++i)
-		AddVertex(other->m_vertices[i].m_pos);
+		AddVertex(other->m_vertices[i].m_pos, other->m_vertices[i].m_normal);
 
 	for(int i = 0, c = other->NumFaces(); i < c; ++i)
 	{
@@ -461,162 +259,476 @@ void TriSoup::Merge(const TriSoup* other)
 	}
 }
 	
+// The serial scatter from faces into their vertices, split up so it can run
+// in parallel without sharing. Vertices are split into fixed size buckets, and
+// each face is listed in the buckets of its vertices, in face order. Each 
+// bucket then scatters only into its own vertices, so every vertex sums its 
+// faces in face order, the same additions the serial scatter made, and the 
+// normals don't depend on how many threads there are.
 void TriSoup::ComputeNormals()
 {
-	for(auto& vtx: m_vertices)
-		vtx.m_normal = vec3(0);
+	constexpr int kChunkSize = 16 * 1024; // faces per chunk, and vertices per bucket
+	const int numVerts = NumVertices();
+	const int numFaces = NumFaces();
+	const int numChunks = (numFaces + kChunkSize - 1) / kChunkSize;
+	const int numBuckets = (numVerts + kChunkSize - 1) / kChunkSize;
+
+	// the distinct buckets of a face's vertices
+	auto faceBuckets = [](const Face& face, int (&buckets)[3]) {
+		const int b0 = face.m_vertices[0] / kChunkSize;
+		const int b1 = face.m_vertices[1] / kChunkSize;
+		const int b2 = face.m_vertices[2] / kChunkSize;
+		int count = 0;
+		buckets[count++] = b0;
+		if(b1 != b0) buckets[count++] = b1;
+		if(b2 != b0 && b2 != b1) buckets[count++] = b2;
+		return count;
+	};
 
-	for(const auto& face: m_faces)
+	// how many faces each chunk lists in each bucket
+	std::vector<int> bucketOffsets(numChunks * numBuckets, 0);
+	task_ParallelFor(numChunks, [&](int chunk) {
+		int* counts = &bucketOffsets[chunk * numBuckets];
+		for(int i = chunk * kChunkSize, c = Min(i + kChunkSize, numFaces); i < c; ++i)
+		{
+			int buckets[3];
+			for(int j = 0, n = faceBuckets(m_faces[i], buckets); j < n; ++j)
+				++counts[buckets[j]];
+		}
+	});
+
+	// bucket lists are stored one after another, each in chunk order
+	std::vector<int> bucketBegin(numBuckets + 1);
+	int total = 0;
+	for(int bucket = 0; bucket < numBuckets; ++bucket)
 	{
-		vec3 v0 = m_vertices[face.m_vertices[0]].m_pos;
-		vec3 v1 = m_vertices[face.m_vertices[1]].m_pos;
-		vec3 v2 = m_vertices[face.m_vertices[2]].m_pos;
+		bucketBegin[bucket] = total;
+		for(int chunk = 0; chunk < numChunks; ++chunk)
+		{
+			int& offset = bucketOffsets[chunk * numBuckets + bucket];
+			const int count = offset;
+			offset = total;
+			total += count;
+		}
+	}
+	bucketBegin[numBuckets] = total;
 
-		vec3 n = (Cross(v1-v0,v2-v0));
+	std::vector<int> bucketFaces(total);
+	task_ParallelFor(numChunks, [&](int chunk) {
+		int* offsets = &bucketOffsets[chunk * numBuckets];
+		for(int i = chunk * kChunkSize, c = Min(i + kChunkSize, numFaces); i < c; ++i)
+		{
+			int buckets[3];
+			for(int j = 0, n = faceBuckets(m_faces[i], buckets); j < n; ++j)
+				bucketFaces[offsets[buckets[j]]++] = i;
+		}
+	});
 
-		m_vertices[face.m_vertices[0]].m_normal += n;
-		m_vertices[face.m_vertices[1]].m_normal += n;
-		m_vertices[face.m_vertices[2]].m_normal += n;
-	}
+	task_ParallelFor(numBuckets, [&](int bucket) {
+		const int vertBegin = bucket * kChunkSize;
+		const int vertEnd = Min(vertBegin + kChunkSize, numVerts);
+		for(int i = vertBegin; i < vertEnd; ++i)
+			m_vertices[i].m_normal = vec3(0);
+
+		// faces in several buckets work out their normal in each
+		for(int i = bucketBegin[bucket]; i < bucketBegin[bucket + 1]; ++i)
+		{
+			const Face& face = m_faces[bucketFaces[i]];
+			vec3 v0 = m_vertices[face.m_vertices[0]].m_pos;
+			vec3 v1 = m_vertices[face.m_vertices[1]].m_pos;
+			vec3 v2 = m_vertices[face.m_vertices[2]].m_pos;
+			vec3 n = (Cross(v1-v0,v2-v0));
+			for(int vert: face.m_vertices)
+				if(vert >= vertBegin && vert < vertEnd)
+					m_vertices[vert].m_normal += n;
+		}
 
-	for(auto& vtx: m_vertices)
-		vtx.m_normal.Normalize();
+		for(int i = vertBegin; i < vertEnd; ++i)
+			m_vertices[i].m_normal.Normalize();
+	});
 }
 
-template<typename IndexType>
-std::shared_ptr<Geom> TriSoup::CreateGeom(const TriSoup& soup)
+// Vertex and index data, the GL-free half of CreateGeom
+static_assert(sizeof(vec3) == 3 * sizeof(float), "vertices must be tightly packed floats");
+
+const float* TriSoup::GetVertexData() const
 {
-	std::vector<IndexType> indices(3 * soup.NumFaces());
-	std::vector<float> vertexData(6 * soup.NumVertices());
+	static_assert(sizeof(Vertex) == kVertexFloats * sizeof(float) &&
+		offsetof(Vertex, m_normal) == 3 * sizeof(float), "vertex layout changed");
+	return m_vertices.empty() ? nullptr : &m_vertices[0].m_pos.x;
+}
 
-	const int vtxStride = 6 * sizeof(float);
-	unsigned int offset = 0;
-	const unsigned int numVertices = 
-		Min<unsigned int>(soup.m_vertices.size(), std::numeric_limits<IndexType>::max());
-	for(unsigned int i = 0; i < numVertices; ++i)
-	{
-		const auto& vtx = soup.m_vertices[i];
-		vertexData[offset++] = vtx.m_pos.x;
-		vertexData[offset++] = vtx.m_pos.y;
-		vertexData[offset++] = vtx.m_pos.z;
-		vertexData[offset++] = vtx.m_normal.x;
-		vertexData[offset++] = vtx.m_normal.y;
-		vertexData[offset++] = vtx.m_normal.z;
-	}
+const unsigned int* TriSoup::GetIndexData() const
+{
+	static_assert(sizeof(Face) == 3 * sizeof(int), "face layout changed");
+	return m_faces.empty() ? nullptr : 
+		reinterpret_cast<const unsigned int*>(&m_faces[0].m_vertices[0]);
+}
 
-	offset = 0;
-	for(const auto& face: soup.m_faces)
+// faces using a vertex past 16 bits are left out
+void TriSoup::PackIndices(std::vector<unsigned short>& out) const
+{
+	out.resize(3 * m_faces.size());
+	unsigned int offset = 0;
+	for(const auto& face: m_faces)
 	{
 		if(std::any_of(face.m_vertices, face.m_vertices+3, 
-			[](int val) { return (unsigned int)val > std::numeric_limits<IndexType>::max(); }))
+			[](int val) { return (unsigned int)val > std::numeric_limits<unsigned short>::max(); }))
 			continue;
 		
-		indices[offset++] = face.m_vertices[0];
-		indices[offset++] = face.m_vertices[1];
-		indices[offset++] = face.m_vertices[2];
+		out[offset++] = face.m_vertices[0];
+		out[offset++] = face.m_vertices[1];
+		out[offset++] = face.m_vertices[2];
 	}
-	const unsigned int numIndices = offset;
-
-	return std::make_shared<Geom>(
-		numVertices, &vertexData[0],
-		numIndices, &indices[0],
-		vtxStride, GL_TRIANGLES,
-		std::vector<GeomBindPair>{
-			{GEOM_Pos, 3, 0},
-			{GEOM_Normal, 3, 3 * sizeof(float)},
-		});
+	out.resize(offset);
 }
 
-std::shared_ptr<Geom> TriSoup::CreateGeom() const
+
+AABB TriSoup::ComputeBounds() const
 {
-	if(NumVertices() > std::numeric_limits<unsigned short>::max())
-		return CreateGeom<unsigned int>(*this);
-	else
-		return CreateGeom<unsigned short>(*this);
+	AABB bounds;
+	for(const auto& vert: m_vertices)
+		bounds.Extend(vert.m_pos);
+	return bounds;
 }
 
-////////////////////////////////////////////////////////////////////////////////
-PointGrid::PointGrid(const AABB& bounds, float bucketDim)
-	: m_bounds(bounds)
-	, m_cellsx( ceilf(bounds.Width() / bucketDim) )
-	, m_cellsy( ceilf(bounds.Height() / bucketDim) )
-	, m_cellsz( ceilf(bounds.Depth() / bucketDim) )
-	, m_grid( m_cellsx * m_cellsy * m_cellsz )
-	, m_dim(bucketDim)
+// 10 bits of x spread out to every third bit
+static unsigned int mesh_SpreadBits(unsigned int x)
 {
+	x = (x | (x << 16)) & 0x030000ff;
+	x = (x | (x << 8)) & 0x0300f00f;
+	x = (x | (x << 4)) & 0x030c30c3;
+	x = (x | (x << 2)) & 0x09249249;
+	return x;
 }
 
-int PointGrid::Find(const vec3& pt) const
+// Faces are taken in Morton order of their centroids and cut into runs of at 
+// most maxVertices distinct vertices and maxFaces faces, so each submesh is a
+// compact piece of the surface. Within a submesh faces keep their order, and with it whatever 
+// CacheSort did. Vertices on a cut are copied into both submeshes.
+void TriSoup::PackSubmeshes(int maxVertices, int maxFaces, std::vector<float>& outVertices,
+	std::vector<unsigned short>& outIndices, std::vector<Submesh>& outSubmeshes) const
 {
-	float invBucketDim = 1.f/m_dim;
-	vec3 lo = pt - vec3(kEpsilon) - m_bounds.m_min;
-	vec3 hi = pt + vec3(kEpsilon) - m_bounds.m_min;
-	lo *= invBucketDim;
-	hi *= invBucketDim;
-	int startZ = int(lo.z), endZ = int(hi.z);
-	int startY = int(lo.y), endY = int(hi.y);
-	int startX = int(lo.x), endX = int(hi.x);
-	startZ = Clamp(startZ, 0, m_cellsz - 1);
-	endZ = Clamp(endZ, 0, m_cellsz - 1);
-	startY = Clamp(startY, 0, m_cellsy - 1);
-	endY = Clamp(endY, 0, m_cellsy - 1);
-	startX = Clamp(startX, 0, m_cellsx - 1);
-	endX = Clamp(endX, 0, m_cellsx - 1);
-
-	const int pitch = m_cellsx;
-	const int slicePitch = m_cellsx * m_cellsy;
-	for(int z = startZ; z <= endZ; ++z)
+	ASSERT(maxVertices >= 3 && maxVertices <= std::numeric_limits<unsigned short>::max() + 1);
+	ASSERT(maxFaces >= 1);
+	const int numTris = NumFaces();
+	outVertices.clear();
+	outIndices.clear();
+	outSubmeshes.clear();
+	if(numTris == 0)
+		return;
+
+	const AABB bounds = ComputeBounds();
+	const vec3 extent = bounds.m_max - bounds.m_min;
+	const vec3 scale(
+		extent.x > 0.f ? 1023.f / extent.x : 0.f,
+		extent.y > 0.f ? 1023.f / extent.y : 0.f,
+		extent.z > 0.f ? 1023.f / extent.z : 0.f);
+	std::vector<std::pair<unsigned int, int>> order(numTris);
+	for(int i = 0; i < numTris; ++i)
+	{
+		const int (&verts)[3] = m_faces[i].m_vertices;
+		const vec3 centroid = (m_vertices[verts[0]].m_pos + m_vertices[verts[1]].m_pos + 
+			m_vertices[verts[2]].m_pos) / 3.f;
+		const vec3 rel = centroid - bounds.m_min;
+		const unsigned int code = mesh_SpreadBits(Clamp(int(rel.x * scale.x), 0, 1023)) |
+			(mesh_SpreadBits(Clamp(int(rel.y * scale.y), 0, 1023)) << 1) |
+			(mesh_SpreadBits(Clamp(int(rel.z * scale.z), 0, 1023)) << 2);
+		order[i] = std::make_pair(code, i);
+	}
+	std::sort(order.begin(), order.end());
+
+	// the last submesh each vertex was counted in, and its index there
+	std::vector<int> owner(NumVertices(), -1);
+	std::vector<int> local(NumVertices());
+	std::vector<int> faceSubmesh(numTris);
+	int numSubmeshes = 1;
+	int submeshVerts = 0;
+	int submeshTris = 0;
+	auto countNew = [&](const int (&verts)[3]) {
+		int added = 0;
+		for(int i = 0; i < 3; ++i)
+			if(owner[verts[i]] != numSubmeshes - 1 && 
+				std::find(verts, verts + i, verts[i]) == verts + i)
+				++added;
+		return added;
+	};
+	for(const auto& entry: order)
 	{
-		for(int y = startY; y <= endY; ++y)
+		const int (&verts)[3] = m_faces[entry.second].m_vertices;
+		int added = countNew(verts);
+		if(submeshVerts + added > maxVertices || submeshTris == maxFaces)
 		{
-			for(int x = startX; x <= endX; ++x)
+			++numSubmeshes;
+			submeshVerts = 0;
+			submeshTris = 0;
+			added = countNew(verts);
+		}
+		for(int vert: verts)
+			owner[vert] = numSubmeshes - 1;
+		submeshVerts += added;
+		++submeshTris;
+		faceSubmesh[entry.second] = numSubmeshes - 1;
+	}
+
+	// faces of each submesh in their original order
+	std::vector<int> firstFace(numSubmeshes + 1, 0);
+	for(int submesh: faceSubmesh)
+		++firstFace[submesh + 1];
+	for(int i = 0; i < numSubmeshes; ++i)
+		firstFace[i + 1] += firstFace[i];
+	std::vector<int> submeshFaces(numTris);
+	{
+		std::vector<int> cursor(firstFace.begin(), firstFace.end() - 1);
+		for(int i = 0; i < numTris; ++i)
+			submeshFaces[cursor[faceSubmesh[i]]++] = i;
+	}
+
+	std::fill(owner.begin(), owner.end(), -1);
+	outIndices.reserve(3 * numTris);
+	outSubmeshes.resize(numSubmeshes);
+	for(int submesh = 0; submesh < numSubmeshes; ++submesh)
+	{
+		Submesh& out = outSubmeshes[submesh];
+		out.m_firstIndex = outIndices.size();
+		out.m_baseVertex = outVertices.size() / kVertexFloats;
+		int numVerts = 0;
+		for(int i = firstFace[submesh]; i < firstFace[submesh + 1]; ++i)
+		{
+			for(int vert: m_faces[submeshFaces[i]].m_vertices)
 			{
-				const VecListType* list = m_grid[x + y * pitch + z * slicePitch].get();
-				if(list)
+				if(owner[vert] != submesh)
 				{
-					for(const auto& pair: *list)
-					{
-						vec3 diff = pair.vec - pt;
-						if(LengthSq(diff) < kEpsilonSq) {
-							return pair.index;
-						}
-					}
+					owner[vert] = submesh;
+					local[vert] = numVerts++;
+					const float* data = &m_vertices[vert].m_pos.x;
+					outVertices.insert(outVertices.end(), data, data + kVertexFloats);
 				}
+				outIndices.push_back(local[vert]);
 			}
 		}
+		ASSERT(numVerts <= maxVertices);
+		out.m_numIndices = outIndices.size() - out.m_firstIndex;
 	}
-
-	return -1;
 }
 
-void PointGrid::Add(int index, const vec3& pt)
+// Meshlets are small submeshes with bounds for culling: a sphere around their
+// vertices, and a cone holding all their face normals. The cone's cutoff is 
+// the sine of its half angle; it's 1, so never culls, when the normals spread
+// over a hemisphere or more.
+void TriSoup::BuildMeshlets(int maxVertices, int maxFaces, std::vector<float>& outVertices,
+	std::vector<unsigned short>& outIndices, std::vector<Meshlet>& outMeshlets) const
 {
-	vec3 gridCell = (pt - m_bounds.m_min) / m_dim;
-	int x = int(gridCell.x),
-		y = int(gridCell.y),
-		z = int(gridCell.z);
-
-	z = Clamp(z, 0, m_cellsz - 1);
-	y = Clamp(y, 0, m_cellsy - 1);
-	x = Clamp(x, 0, m_cellsx - 1);
-	const int pitch = m_cellsx;
-	const int slicePitch = m_cellsx * m_cellsy;
-	unsigned int offset = x + y * pitch + z * slicePitch;
-	if(!m_grid[offset])
-		m_grid[offset] = std::make_shared<VecListType>();
-
-	VecListType *list = m_grid[offset].get();
-	list->emplace_back(pt, index);
+	std::vector<Submesh> submeshes;
+	PackSubmeshes(maxVertices, maxFaces, outVertices, outIndices, submeshes);
+	outMeshlets.resize(submeshes.size());
+	task_ParallelFor(submeshes.size(), [&](int index) {
+		const Submesh& submesh = submeshes[index];
+		const unsigned short* indices = &outIndices[submesh.m_firstIndex];
+		auto pos = [&](int i) {
+			return *reinterpret_cast<const vec3*>(&outVertices[(submesh.m_baseVertex + i) * kVertexFloats]);
+		};
+
+		AABB bounds;
+		vec3 normalSum(0.f);
+		for(int i = 0; i < submesh.m_numIndices; i += 3)
+		{
+			const vec3 v0 = pos(indices[i]), v1 = pos(indices[i+1]), v2 = pos(indices[i+2]);
+			bounds.Extend(v0);
+			bounds.Extend(v1);
+			bounds.Extend(v2);
+			const vec3 n = Cross(v1 - v0, v2 - v0);
+			if(LengthSq(n) > 0.f)
+				normalSum += Normalize(n);
+		}
+
+		Meshlet& meshlet = outMeshlets[index];
+		meshlet.m_submesh = submesh;
+		meshlet.m_center = 0.5f * (bounds.m_min + bounds.m_max);
+		float radiusSq = 0.f;
+		float minDot = 1.f;
+		const vec3 axis = LengthSq(normalSum) > 0.f ? Normalize(normalSum) : vec3(0.f, 0.f, 1.f);
+		for(int i = 0; i < submesh.m_numIndices; i += 3)
+		{
+			const vec3 v0 = pos(indices[i]), v1 = pos(indices[i+1]), v2 = pos(indices[i+2]);
+			radiusSq = Max(radiusSq, Max(DistSq(meshlet.m_center, v0), 
+				Max(DistSq(meshlet.m_center, v1), DistSq(meshlet.m_center, v2))));
+			const vec3 n = Cross(v1 - v0, v2 - v0);
+			if(LengthSq(n) > 0.f)
+				minDot = Min(minDot, Dot(axis, Normalize(n)));
+		}
+		meshlet.m_radius = sqrtf(radiusSq);
+		meshlet.m_coneAxis = axis;
+		meshlet.m_coneCutoff = minDot > 0.f ? sqrtf(1.f - minDot * minDot) : 1.f;
+	});
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-int UniqueAddVertex(TriSoup* mesh, PointGrid& grid, const vec3& pt)
+// Packed vertex formats
+
+int TriSoup::VertexSize(int format)
+{
+	switch(format)
+	{
+		case TRISOUP_VertexPacked16: return 6 * sizeof(unsigned short);
+		case TRISOUP_VertexPacked8: return 3 * sizeof(unsigned short) + 2;
+		default: return kVertexFloats * sizeof(float);
+	}
+}
+
+static unsigned int mesh_PackUnorm(float val, unsigned int maxVal)
+{
+	return (unsigned int)(Clamp(val, 0.f, 1.f) * maxVal + 0.5f);
+}
+
+// Projects the normal onto the octahedron |x|+|y|+|z| = 1 and unfolds the
+// lower half over the upper, giving a point in [-1,1]^2, then maps it to [0,1].
+static void mesh_OctEncode(const vec3& n, float (&out)[2])
 {
-	int index = grid.Find(pt);
-	if(index < 0) {
-		index = mesh->AddVertex(pt);
-		grid.Add(index, pt);
+	const float l1 = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+	float u = l1 > 0.f ? n.x / l1 : 0.f;
+	float v = l1 > 0.f ? n.y / l1 : 0.f;
+	if(n.z < 0.f)
+	{
+		const float foldU = (1.f - fabsf(v)) * (u >= 0.f ? 1.f : -1.f);
+		const float foldV = (1.f - fabsf(u)) * (v >= 0.f ? 1.f : -1.f);
+		u = foldU;
+		v = foldV;
 	}
-	return index;
+	out[0] = 0.5f * u + 0.5f;
+	out[1] = 0.5f * v + 0.5f;
 }
 
+void TriSoup::PackVertices(const float* vertices, int numVerts, int format, 
+	const AABB& bounds, std::vector<unsigned char>& out)
+{
+	ASSERT(format == TRISOUP_VertexPacked16 || format == TRISOUP_VertexPacked8);
+	const int vertexSize = VertexSize(format);
+	out.resize(size_t(numVerts) * vertexSize);
+
+	const vec3 extent = bounds.m_max - bounds.m_min;
+	const vec3 invExtent(
+		extent.x > 0.f ? 1.f / extent.x : 0.f,
+		extent.y > 0.f ? 1.f / extent.y : 0.f,
+		extent.z > 0.f ? 1.f / extent.z : 0.f);
+	task_ParallelFor((numVerts + 0xffff) >> 16, [&](int chunk) {
+		const int end = Min(numVerts, (chunk + 1) << 16);
+		for(int i = chunk << 16; i < end; ++i)
+		{
+			const float* vert = &vertices[size_t(i) * kVertexFloats];
+			unsigned short pos[4] = {
+				(unsigned short)mesh_PackUnorm((vert[0] - bounds.m_min.x) * invExtent.x, 0xffff),
+				(unsigned short)mesh_PackUnorm((vert[1] - bounds.m_min.y) * invExtent.y, 0xffff),
+				(unsigned short)mesh_PackUnorm((vert[2] - bounds.m_min.z) * invExtent.z, 0xffff),
+				0,
+			};
+			float oct[2];
+			mesh_OctEncode(vec3(vert[3], vert[4], vert[5]), oct);
+
+			unsigned char* dest = &out[size_t(i) * vertexSize];
+			if(format == TRISOUP_VertexPacked16)
+			{
+				const unsigned short normal[2] = {
+					(unsigned short)mesh_PackUnorm(oct[0], 0xffff),
+					(unsigned short)mesh_PackUnorm(oct[1], 0xffff),
+				};
+				memcpy(dest, pos, sizeof(pos));
+				memcpy(dest + sizeof(pos), normal, sizeof(normal));
+			}
+			else
+			{
+				const unsigned char normal[2] = {
+					(unsigned char)mesh_PackUnorm(oct[0], 0xff),
+					(unsigned char)mesh_PackUnorm(oct[1], 0xff),
+				};
+				memcpy(dest, pos, 3 * sizeof(pos[0]));
+				memcpy(dest + 3 * sizeof(pos[0]), normal, sizeof(normal));
+			}
+		}
+	});
+}
+
+// inverse of mesh_OctEncode
+static vec3 mesh_OctDecode(float x, float y)
+{
+	vec3 n(2.f * x - 1.f, 2.f * y - 1.f, 0.f);
+	n.z = 1.f - fabsf(n.x) - fabsf(n.y);
+	if(n.z < 0.f)
+	{
+		const float foldX = (1.f - fabsf(n.y)) * (n.x >= 0.f ? 1.f : -1.f);
+		const float foldY = (1.f - fabsf(n.x)) * (n.y >= 0.f ? 1.f : -1.f);
+		n.x = foldX;
+		n.y = foldY;
+	}
+	return Normalize(n);
+}
+
+void TriSoup::UnpackVertices(const void* vertices, int numVerts, int format,
+	const AABB& bounds, std::vector<float>& out)
+{
+	out.resize(size_t(numVerts) * kVertexFloats);
+	if(format == TRISOUP_VertexFloat)
+	{
+		memcpy(&out[0], vertices, out.size() * sizeof(float));
+		return;
+	}
+
+	const int vertexSize = VertexSize(format);
+	const vec3 scale = (bounds.m_max - bounds.m_min) / 65535.f;
+	for(int i = 0; i < numVerts; ++i)
+	{
+		const unsigned char* src = static_cast<const unsigned char*>(vertices) + size_t(i) * vertexSize;
+		unsigned short pos[3];
+		memcpy(pos, src, sizeof(pos));
+		vec3 normal;
+		if(format == TRISOUP_VertexPacked16)
+		{
+			unsigned short oct[2];
+			memcpy(oct, src + 4 * sizeof(unsigned short), sizeof(oct));
+			normal = mesh_OctDecode(oct[0] / 65535.f, oct[1] / 65535.f);
+		}
+		else
+		{
+			const unsigned char* oct = src + sizeof(pos);
+			normal = mesh_OctDecode(oct[0] / 255.f, oct[1] / 255.f);
+		}
+
+		float* dest = &out[size_t(i) * kVertexFloats];
+		dest[0] = bounds.m_min.x + pos[0] * scale.x;
+		dest[1] = bounds.m_min.y + pos[1] * scale.y;
+		dest[2] = bounds.m_min.z + pos[2] * scale.z;
+		dest[3] = normal.x;
+		dest[4] = normal.y;
+		dest[5] = normal.z;
+	}
+}
+
+void TriSoup::BuildGeomData(int format, const AABB* bounds, GeomData& out) const
+{
+	out.m_format = format;
+	out.m_bounds = bounds ? *bounds : 
+		format != TRISOUP_VertexFloat ? ComputeBounds() : AABB();
+	out.m_floatStorage.clear();
+	out.m_packedStorage.clear();
+	out.m_submeshes.clear();
+
+	const int maxVertices = std::numeric_limits<unsigned short>::max();
+	const float* vertices = GetVertexData();
+	out.m_numVertices = NumVertices();
+	if(NumVertices() <= maxVertices)
+		PackIndices(out.m_indices);
+	else
+	{
+		PackSubmeshes(maxVertices, NumFaces(), out.m_floatStorage, out.m_indices, out.m_submeshes);
+		vertices = &out.m_floatStorage[0];
+		out.m_numVertices = out.m_floatStorage.size() / kVertexFloats;
+	}
+
+	out.m_vertices = vertices;
+	if(format != TRISOUP_VertexFloat && out.m_numVertices > 0)
+	{
+		PackVertices(vertices, out.m_numVertices, format, out.m_bounds, out.m_packedStorage);
+		out.m_vertices = &out.m_packedStorage[0];
+		std::vector<float>().swap(out.m_floatStorage);
+	}
+}
@@ -2,11 +2,21 @@
 
 #include <vector>
 #include <memory>
+#include <cstdint>
 #include "vec.hh"
 #include "commonmath.hh"
 
 class Geom;
 
+// Vertex formats CreateGeom can upload. Packed positions are 16 bit unsigned
+// normalized across a box, so decode as box.m_min + pos * (box.m_max - box.m_min).
+// Packed normals are octahedral, unsigned normalized; see shaders/rock.glsl.
+enum TriSoupVertexFormatType {
+	TRISOUP_VertexFloat, // 3 float position, 3 float normal: 24 bytes
+	TRISOUP_VertexPacked16, // 3 x 16 bit position (and one spare), 2 x 16 bit normal: 12 bytes
+	TRISOUP_VertexPacked8, // 3 x 16 bit position, 2 x 8 bit normal: 8 bytes
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 // TriSoup
 // triangle mesh with no topology info or guarantees. Just a bunch of tris.
@@ -18,6 +28,7 @@ public:
 
 	// Creation functions
 	int AddVertex(const vec3& pos);
+	int AddVertex(const vec3& pos, const vec3& normal);
 	int AddFace(int v0, int v1, int v2);
 
 	// Modification functions
@@ -30,16 +41,106 @@ public:
 
 	const vec3& GetVertexPos(int index) const;
 	const vec3& GetVertexNormal(int index) const;
+	void SetVertexNormal(int index, const vec3& normal);
 	void GetFace(int index, int (&indices)[3]) const;
 
-	void CacheSort(int lruCacheSize);
+	// Post transform vertex cache efficiency, as misses per face and per vertex.
+	struct CacheStats {
+		float m_acmr;
+		float m_atvr;
+	};
+	CacheStats ComputeCacheStats(int cacheSize) const;
+	// reorders the faces and vertices for a cache of cacheSize, and returns 
+	// the stats from before and after
+	struct CacheSortStats {
+		CacheStats m_before;
+		CacheStats m_after;
+	};
+	CacheSortStats CacheSort(int cacheSize);
 	void Merge(const TriSoup* other);
 
 	void ComputeNormals();
-	std::shared_ptr<Geom> CreateGeom() const;
-private:
-	template<typename T> static std::shared_ptr<Geom> CreateGeom(const TriSoup&);
 
+	// Vertices are stored interleaved, position then normal, and faces as 
+	// three indices, which is how CreateGeom uploads them. Only 16 bit indices 
+	// have to be packed first.
+	static constexpr int kVertexFloats = 6;
+	const float* GetVertexData() const;
+	const unsigned int* GetIndexData() const;
+	void PackIndices(std::vector<unsigned short>& out) const;
+
+	// Meshes too big for 16 bit indices are split into submeshes of at most 
+	// maxVertices vertices each, with their vertices copied out contiguously 
+	// and indexed from m_baseVertex. No faces are dropped.
+	struct Submesh {
+		int m_firstIndex;
+		int m_numIndices;
+		int m_baseVertex;
+	};
+	void PackSubmeshes(int maxVertices, int maxFaces, std::vector<float>& outVertices,
+		std::vector<unsigned short>& outIndices, std::vector<Submesh>& outSubmeshes) const;
+
+	// Submeshes small enough to cull one by one, with their bounds.
+	static constexpr int kMeshletMaxVertices = 64;
+	static constexpr int kMeshletMaxFaces = 124;
+	struct Meshlet {
+		Submesh m_submesh;
+		vec3 m_center;
+		float m_radius;
+		vec3 m_coneAxis;
+		float m_coneCutoff;
+
+		// true when every face points away from eye
+		bool IsBackfacing(const vec3& eye) const {
+			const vec3 toCenter = m_center - eye;
+			return Dot(toCenter, m_coneAxis) >= m_coneCutoff * Length(toCenter) + m_radius;
+		}
+	};
+	void BuildMeshlets(int maxVertices, int maxFaces, std::vector<float>& outVertices,
+		std::vector<unsigned short>& outIndices, std::vector<Meshlet>& outMeshlets) const;
+
+	AABB ComputeBounds() const;
+
+	// Packs interleaved float vertices, as from GetVertexData or PackSubmeshes, 
+	// to a TriSoupVertexFormatType with positions relative to bounds.
+	static int VertexSize(int format);
+	static void PackVertices(const float* vertices, int numVerts, int format, 
+		const AABB& bounds, std::vector<unsigned char>& out);
+	// and back to floats
+	static void UnpackVertices(const void* vertices, int numVerts, int format,
+		const AABB& bounds, std::vector<float>& out);
+
+	// What CreateGeom uploads: the vertices in a format, and 16 bit indices, 
+	// split into submeshes when there are too many vertices for them.
+	// m_vertices points into the storage, or at the mesh's own vertices.
+	struct GeomData {
+		int m_format;
+		AABB m_bounds;
+		int m_numVertices;
+		const void* m_vertices;
+		std::vector<float> m_floatStorage;
+		std::vector<unsigned char> m_packedStorage;
+		std::vector<unsigned short> m_indices;
+		std::vector<Submesh> m_submeshes; // empty to draw all the indices at once
+	};
+	void BuildGeomData(int format, const AABB* bounds, GeomData& out) const;
+
+	// Binary mesh files, in meshfile.cpp. They hold GeomData as it is, so 
+	// meshfile_CreateGeom can upload a mapped file without going through a 
+	// TriSoup. key goes in the header for readers to check the file was made
+	// from what they expect. Both report failures to std::cerr.
+	bool Save(const char* filename, int format = TRISOUP_VertexFloat, 
+		const AABB* bounds = nullptr, uint64_t key = 0) const;
+	static std::shared_ptr<TriSoup> Load(const char* filename);
+
+	// needs GL, in meshgeom.cpp. Packed formats are relative to bounds, or to
+	// ComputeBounds() without them.
+	std::shared_ptr<Geom> CreateGeom(int format = TRISOUP_VertexFloat, 
+		const AABB* bounds = nullptr) const;
+	// a range per meshlet, in the same order as outMeshlets
+	std::shared_ptr<Geom> CreateMeshletGeom(std::vector<Meshlet>& outMeshlets,
+		int format = TRISOUP_VertexFloat, const AABB* bounds = nullptr) const;
+private:
 	////////////////////////////////////////////////////////////////////////////////        
 	struct Face {
 		Face() {}
@@ -49,42 +150,16 @@ private:
 	struct Vertex {
 		Vertex() {}
 		Vertex(const vec3& pos) : m_pos(pos), m_normal() {}
+		Vertex(const vec3& pos, const vec3& normal) : m_pos(pos), m_normal(normal) {}
 		vec3 m_pos;
 		vec3 m_normal;
 	};
 
 	////////////////////////////////////////////////////////////////////////////////        
 	void RemapData( const std::vector<int>& faceOrder );
-	void ReindexTriangles(int lruSize, std::vector<int>& outIndexBuffer);
+	void ReindexTriangles(int cacheSize, std::vector<int>& outFaceOrder);
 	
 	////////////////////////////////////////////////////////////////////////////////        
 	std::vector<Face> m_faces;
 	std::vector<Vertex> m_vertices;
 };
-
-class PointGrid
-{
-public:
-	PointGrid(const AABB &bounds, float bucketDim);
-
-	int Find(const vec3& pt) const;
-	void Add(int index, const vec3& pt);
-private:
-	struct VecPair {
-		VecPair(const vec3& pt, int i) : vec(pt), index(i) {}
-		vec3 vec;
-		int index;
-	};
-	typedef std::vector<VecPair> VecListType;
-	AABB m_bounds;
-	int m_cellsx;
-	int m_cellsy;
-	int m_cellsz;
-	std::vector<std::shared_ptr<VecListType>> m_grid;
-	float m_dim;
-
-	constexpr static float kEpsilon = 1e-3f;
-	constexpr static float kEpsilonSq = kEpsilon * kEpsilon;
-};
-
-int UniqueAddVertex(TriSoup* mesh, PointGrid& grid, const vec3& pt);
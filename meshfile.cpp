@@ -0,0 +1,260 @@
+#include "meshfile.hh"
+#include "mesh.hh"
+#include "common.hh"
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char kMeshFileMagic[4] = { 'R', 'K', 'M', 'S' };
+
+////////////////////////////////////////////////////////////////////////////////
+MeshFileMapping::MeshFileMapping(void* mapping, size_t size)
+	: m_mapping(mapping)
+	, m_size(size)
+{
+}
+
+MeshFileMapping::~MeshFileMapping()
+{
+	munmap(m_mapping, m_size);
+}
+
+AABB MeshFileMapping::GetBounds() const
+{
+	const MeshFileHeader& header = GetHeader();
+	return AABB(vec3(header.m_boundsMin[0], header.m_boundsMin[1], header.m_boundsMin[2]),
+		vec3(header.m_boundsMax[0], header.m_boundsMax[1], header.m_boundsMax[2]));
+}
+
+// whether [offset, offset + count * elemSize) is inside the file
+static bool meshfile_BlockFits(uint64_t offset, uint64_t count, uint64_t elemSize, uint64_t fileSize)
+{
+	return offset <= fileSize && count <= (fileSize - offset) / elemSize;
+}
+
+static bool meshfile_CheckHeader(const MeshFileHeader& header, size_t fileSize)
+{
+	if(memcmp(header.m_magic, kMeshFileMagic, sizeof(kMeshFileMagic)) != 0 ||
+		header.m_version != kMeshFileVersion)
+		return false;
+	if(header.m_fileSize != fileSize ||
+		header.m_vertexFormat > TRISOUP_VertexPacked8 ||
+		int(header.m_vertexSize) != TriSoup::VertexSize(header.m_vertexFormat) ||
+		header.m_indexSize != sizeof(unsigned short) ||
+		header.m_numIndices % 3 != 0)
+		return false;
+	if(header.m_vertexOffset % kMeshFileAlignment != 0 ||
+		header.m_indexOffset % kMeshFileAlignment != 0 ||
+		header.m_rangeOffset % kMeshFileAlignment != 0)
+		return false;
+	return meshfile_BlockFits(header.m_vertexOffset, header.m_numVertices, header.m_vertexSize, fileSize) &&
+		meshfile_BlockFits(header.m_indexOffset, header.m_numIndices, header.m_indexSize, fileSize) &&
+		meshfile_BlockFits(header.m_rangeOffset, header.m_numRanges, sizeof(MeshFileRange), fileSize);
+}
+
+// Ranges are few, so unlike the indices they're checked up front.
+static bool meshfile_CheckRanges(const MeshFileMapping& file)
+{
+	const MeshFileHeader& header = file.GetHeader();
+	const MeshFileRange* ranges = file.GetRanges();
+	for(uint32_t i = 0; i < header.m_numRanges; ++i)
+	{
+		const MeshFileRange& range = ranges[i];
+		if(range.m_firstIndex < 0 || range.m_numIndices < 0 || range.m_baseVertex < 0 ||
+			uint64_t(range.m_firstIndex) + range.m_numIndices > header.m_numIndices ||
+			uint32_t(range.m_baseVertex) > header.m_numVertices)
+			return false;
+	}
+	return true;
+}
+
+std::shared_ptr<MeshFileMapping> meshfile_Map(const char* filename)
+{
+	const int fd = open(filename, O_RDONLY);
+	if(fd < 0)
+	{
+		std::cerr << "failed to open mesh " << filename << std::endl;
+		return nullptr;
+	}
+	struct stat st;
+	if(fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(MeshFileHeader))
+	{
+		std::cerr << "mesh " << filename << " is too small for a header" << std::endl;
+		close(fd);
+		return nullptr;
+	}
+	const size_t size = st.st_size;
+	void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(mapping == MAP_FAILED)
+	{
+		std::cerr << "failed to map mesh " << filename << std::endl;
+		return nullptr;
+	}
+
+	auto file = std::make_shared<MeshFileMapping>(mapping, size);
+	if(!meshfile_CheckHeader(file->GetHeader(), size) || !meshfile_CheckRanges(*file))
+	{
+		std::cerr << "mesh " << filename << " is corrupt, or not a version " <<
+			kMeshFileVersion << " mesh file" << std::endl;
+		return nullptr;
+	}
+	// it's all going to be read, once, front to back, so start reading it now
+	madvise(mapping, size, MADV_SEQUENTIAL);
+	madvise(mapping, size, MADV_WILLNEED);
+	return file;
+}
+
+bool meshfile_CheckIndices(const MeshFileMapping& file)
+{
+	const MeshFileHeader& header = file.GetHeader();
+	const MeshFileRange wholeRange = { 0, int32_t(header.m_numIndices), 0 };
+	const MeshFileRange* ranges = header.m_numRanges > 0 ? file.GetRanges() : &wholeRange;
+	const int numRanges = Max<int>(1, header.m_numRanges);
+	const unsigned short* indices = file.GetIndexData();
+	for(int i = 0; i < numRanges; ++i)
+	{
+		const MeshFileRange& range = ranges[i];
+		// meshfile_Map checked the base vertex is at most the vertex count
+		const uint32_t numVertices = header.m_numVertices - range.m_baseVertex;
+		unsigned short maxIndex = 0;
+		for(int j = range.m_firstIndex, end = range.m_firstIndex + range.m_numIndices; j < end; ++j)
+			maxIndex = Max(maxIndex, indices[j]);
+		if(range.m_numIndices > 0 && maxIndex >= numVertices)
+			return false;
+	}
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+static uint64_t meshfile_Align(uint64_t offset)
+{
+	return (offset + kMeshFileAlignment - 1) & ~(kMeshFileAlignment - 1);
+}
+
+static bool meshfile_WriteBlock(FILE* fp, uint64_t offset, const void* data, size_t size)
+{
+	static const char kPadding[kMeshFileAlignment] = {};
+	uint64_t pos = ftell(fp);
+	while(pos < offset)
+	{
+		const size_t pad = Min<uint64_t>(offset - pos, sizeof(kPadding));
+		if(fwrite(kPadding, 1, pad, fp) != pad)
+			return false;
+		pos += pad;
+	}
+	return size == 0 || fwrite(data, 1, size, fp) == size;
+}
+
+// Writes to a temporary next to filename and renames it over, so readers never
+// see half a file.
+bool TriSoup::Save(const char* filename, int format, const AABB* bounds, uint64_t key) const
+{
+	GeomData data;
+	BuildGeomData(format, bounds, data);
+
+	std::vector<MeshFileRange> ranges;
+	ranges.reserve(data.m_submeshes.size());
+	for(const Submesh& submesh: data.m_submeshes)
+		ranges.push_back(MeshFileRange{submesh.m_firstIndex, submesh.m_numIndices, submesh.m_baseVertex});
+
+	MeshFileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.m_magic, kMeshFileMagic, sizeof(kMeshFileMagic));
+	header.m_version = kMeshFileVersion;
+	header.m_vertexFormat = format;
+	header.m_vertexSize = VertexSize(format);
+	header.m_numVertices = data.m_numVertices;
+	header.m_indexSize = sizeof(unsigned short);
+	header.m_numIndices = data.m_indices.size();
+	header.m_numRanges = ranges.size();
+	const vec3& boundsMin = data.m_bounds.m_min;
+	const vec3& boundsMax = data.m_bounds.m_max;
+	const float boundsData[6] = { boundsMin.x, boundsMin.y, boundsMin.z, boundsMax.x, boundsMax.y, boundsMax.z };
+	memcpy(header.m_boundsMin, boundsData, sizeof(header.m_boundsMin));
+	memcpy(header.m_boundsMax, boundsData + 3, sizeof(header.m_boundsMax));
+
+	const size_t vertexBytes = size_t(header.m_numVertices) * header.m_vertexSize;
+	const size_t indexBytes = data.m_indices.size() * sizeof(unsigned short);
+	const size_t rangeBytes = ranges.size() * sizeof(MeshFileRange);
+	header.m_vertexOffset = meshfile_Align(sizeof(header));
+	header.m_indexOffset = meshfile_Align(header.m_vertexOffset + vertexBytes);
+	header.m_rangeOffset = meshfile_Align(header.m_indexOffset + indexBytes);
+	header.m_fileSize = header.m_rangeOffset + rangeBytes;
+	header.m_key = key;
+
+	const std::string tempName = std::string(filename) + ".tmp";
+	FILE* fp = fopen(tempName.c_str(), "wb");
+	if(!fp)
+	{
+		std::cerr << "failed to open " << tempName << " for writing" << std::endl;
+		return false;
+	}
+	bool ok = meshfile_WriteBlock(fp, 0, &header, sizeof(header)) &&
+		meshfile_WriteBlock(fp, header.m_vertexOffset, data.m_vertices, vertexBytes) &&
+		meshfile_WriteBlock(fp, header.m_indexOffset, data.m_indices.empty() ? nullptr : &data.m_indices[0], indexBytes) &&
+		meshfile_WriteBlock(fp, header.m_rangeOffset, ranges.empty() ? nullptr : &ranges[0], rangeBytes);
+	ok = fclose(fp) == 0 && ok;
+	if(!ok || rename(tempName.c_str(), filename) != 0)
+	{
+		std::cerr << "failed to write mesh " << filename << std::endl;
+		remove(tempName.c_str());
+		return false;
+	}
+	return true;
+}
+
+// Submeshes each have their own copies of the vertices they share with others,
+// and those stay separate in the TriSoup.
+std::shared_ptr<TriSoup> TriSoup::Load(const char* filename)
+{
+	std::shared_ptr<MeshFileMapping> file = meshfile_Map(filename);
+	if(!file)
+		return nullptr;
+	const MeshFileHeader& header = file->GetHeader();
+
+	std::vector<float> vertices;
+	if(header.m_numVertices > 0)
+		UnpackVertices(file->GetVertexData(), header.m_numVertices, header.m_vertexFormat,
+			file->GetBounds(), vertices);
+
+	auto result = std::make_shared<TriSoup>();
+	result->m_vertices.reserve(header.m_numVertices);
+	for(uint32_t i = 0; i < header.m_numVertices; ++i)
+	{
+		const float* vert = &vertices[size_t(i) * kVertexFloats];
+		result->AddVertex(vec3(vert[0], vert[1], vert[2]), vec3(vert[3], vert[4], vert[5]));
+	}
+
+	const MeshFileRange wholeRange = { 0, int32_t(header.m_numIndices), 0 };
+	const MeshFileRange* ranges = header.m_numRanges > 0 ? file->GetRanges() : &wholeRange;
+	const int numRanges = Max<int>(1, header.m_numRanges);
+	const unsigned short* indices = file->GetIndexData();
+	result->m_faces.reserve(header.m_numIndices / 3);
+	for(int i = 0; i < numRanges; ++i)
+	{
+		const MeshFileRange& range = ranges[i];
+		const int end = range.m_firstIndex + range.m_numIndices - range.m_numIndices % 3;
+		for(int j = range.m_firstIndex; j < end; j += 3)
+		{
+			int face[3];
+			for(int k = 0; k < 3; ++k)
+			{
+				face[k] = range.m_baseVertex + indices[j + k];
+				if(face[k] >= result->NumVertices())
+				{
+					std::cerr << "mesh " << filename << " has an index past its vertices" << std::endl;
+					return nullptr;
+				}
+			}
+			result->AddFace(face[0], face[1], face[2]);
+		}
+	}
+	return result;
+}
+
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include "commonmath.hh"
+class Geom;
+
+////////////////////////////////////////////////////////////////////////////////
+// Binary mesh files
+// TriSoup::GeomData as it is uploaded: a header, then the vertex, index and
+// range blocks, each starting on a kMeshFileAlignment boundary so a mapped
+// file can be handed to glBufferData without parsing. Written by
+// TriSoup::Save; the files are in the host's byte order, and anything with
+// another magic or version is rejected rather than converted.
+
+static constexpr uint32_t kMeshFileVersion = 2;
+static constexpr uint64_t kMeshFileAlignment = 4096;
+
+struct MeshFileHeader
+{
+	char m_magic[4]; // "RKMS"
+	uint32_t m_version;
+	uint32_t m_vertexFormat; // TriSoupVertexFormatType
+	uint32_t m_vertexSize;
+	uint32_t m_numVertices;
+	uint32_t m_indexSize; // always 16 bit for now
+	uint32_t m_numIndices;
+	uint32_t m_numRanges; // 0 to draw all the indices at once
+	float m_boundsMin[3]; // what packed positions are relative to
+	float m_boundsMax[3];
+	uint64_t m_vertexOffset;
+	uint64_t m_indexOffset;
+	uint64_t m_rangeOffset;
+	uint64_t m_fileSize;
+	uint64_t m_key; // whatever the writer identifies the mesh's inputs by, 0 if nothing
+};
+
+// a TriSoup::Submesh, with its layout pinned down
+struct MeshFileRange
+{
+	int32_t m_firstIndex;
+	int32_t m_numIndices;
+	int32_t m_baseVertex;
+};
+
+// A read-only mapping of a mesh file, unmapped when it's destroyed. Create
+// them with meshfile_Map.
+class MeshFileMapping
+{
+public:
+	MeshFileMapping(void* mapping, size_t size);
+	~MeshFileMapping();
+
+	const MeshFileHeader& GetHeader() const { return *static_cast<const MeshFileHeader*>(m_mapping); }
+	const void* GetVertexData() const { return GetBlock(GetHeader().m_vertexOffset); }
+	const unsigned short* GetIndexData() const {
+		return static_cast<const unsigned short*>(GetBlock(GetHeader().m_indexOffset)); }
+	const MeshFileRange* GetRanges() const {
+		return static_cast<const MeshFileRange*>(GetBlock(GetHeader().m_rangeOffset)); }
+	AABB GetBounds() const;
+private:
+	MeshFileMapping(const MeshFileMapping&) = delete;
+	MeshFileMapping& operator=(const MeshFileMapping&) = delete;
+	const void* GetBlock(uint64_t offset) const { return static_cast<const char*>(m_mapping) + offset; }
+
+	void* m_mapping;
+	size_t m_size;
+};
+
+// Maps filename and checks the header and that the blocks fit in the file.
+// Reports failures to std::cerr and returns nullptr.
+std::shared_ptr<MeshFileMapping> meshfile_Map(const char* filename);
+
+// Whether every index that's drawn, plus its range's base vertex, is one of
+// the file's vertices. meshfile_Map leaves this to whoever reads the indices,
+// as it's a pass over all of them.
+bool meshfile_CheckIndices(const MeshFileMapping& file);
+
+// Uploads a mapped file straight to a Geom, in meshgeom.cpp. Checks the 
+// indices first, so a corrupt file can't have the GPU read past the vertices;
+// reports a bad one to std::cerr and returns nullptr.
+std::shared_ptr<Geom> meshfile_CreateGeom(const MeshFileMapping& file);
+
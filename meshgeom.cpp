@@ -0,0 +1,100 @@
+#include <iostream>
+#include "mesh.hh"
+#include "meshfile.hh"
+#include "render.hh"
+
+////////////////////////////////////////////////////////////////////////////////
+// TriSoup's GL half, kept apart so mesh.cpp builds without a GL context.
+// Meshes that fit 16 bit indices upload their vertices as they're stored, 
+// unless they're packed; bigger ones are split into 16 bit submeshes, drawn as
+// ranges of one Geom. Meshlets are the same, with a range each. Mesh files
+// hold what CreateGeom would upload, so they're uploaded as they're mapped.
+static std::vector<GeomBindPair> mesh_VertexElements(int format)
+{
+	switch(format)
+	{
+		case TRISOUP_VertexPacked16:
+			return std::vector<GeomBindPair>{
+				{GEOM_Pos, 3, 0, GL_UNSIGNED_SHORT, true},
+				{GEOM_Normal, 2, 4 * sizeof(unsigned short), GL_UNSIGNED_SHORT, true},
+			};
+		case TRISOUP_VertexPacked8:
+			return std::vector<GeomBindPair>{
+				{GEOM_Pos, 3, 0, GL_UNSIGNED_SHORT, true},
+				{GEOM_Normal, 2, 3 * sizeof(unsigned short), GL_UNSIGNED_BYTE, true},
+			};
+		default:
+			return std::vector<GeomBindPair>{
+				{GEOM_Pos, 3, 0},
+				{GEOM_Normal, 3, 3 * sizeof(float)},
+			};
+	}
+}
+
+static std::shared_ptr<Geom> mesh_CreateGeom(const void* vertices, int numVerts, int format, 
+	const unsigned short* indices, int numIndices, const std::vector<GeomRange>& ranges)
+{
+	if(numIndices == 0)
+		return nullptr;
+	return std::make_shared<Geom>(numVerts, vertices, numIndices, indices, 
+		TriSoup::VertexSize(format), GL_TRIANGLES, mesh_VertexElements(format), ranges);
+}
+
+std::shared_ptr<Geom> TriSoup::CreateGeom(int format, const AABB* bounds) const
+{
+	GeomData data;
+	BuildGeomData(format, bounds, data);
+	std::vector<GeomRange> ranges;
+	ranges.reserve(data.m_submeshes.size());
+	for(const Submesh& submesh: data.m_submeshes)
+		ranges.emplace_back(submesh.m_firstIndex, submesh.m_numIndices, submesh.m_baseVertex);
+	return mesh_CreateGeom(data.m_vertices, data.m_numVertices, format, 
+		data.m_indices.empty() ? nullptr : &data.m_indices[0], data.m_indices.size(), ranges);
+}
+
+std::shared_ptr<Geom> TriSoup::CreateMeshletGeom(std::vector<Meshlet>& outMeshlets,
+	int format, const AABB* bounds) const
+{
+	const AABB box = bounds ? *bounds : 
+		format != TRISOUP_VertexFloat ? ComputeBounds() : AABB();
+
+	std::vector<float> vertices;
+	std::vector<unsigned short> indices;
+	BuildMeshlets(kMeshletMaxVertices, kMeshletMaxFaces, vertices, indices, outMeshlets);
+	std::vector<GeomRange> ranges;
+	ranges.reserve(outMeshlets.size());
+	for(const Meshlet& meshlet: outMeshlets)
+		ranges.emplace_back(meshlet.m_submesh.m_firstIndex, meshlet.m_submesh.m_numIndices, 
+			meshlet.m_submesh.m_baseVertex);
+	if(indices.empty())
+		return nullptr;
+
+	const int numVerts = vertices.size() / kVertexFloats;
+	const void* vertexData = &vertices[0];
+	std::vector<unsigned char> packed;
+	if(format != TRISOUP_VertexFloat)
+	{
+		PackVertices(&vertices[0], numVerts, format, box, packed);
+		vertexData = &packed[0];
+	}
+	return mesh_CreateGeom(vertexData, numVerts, format, &indices[0], indices.size(), ranges);
+}
+
+// Nothing to unpack, the blocks go to the buffers straight from the mapping.
+std::shared_ptr<Geom> meshfile_CreateGeom(const MeshFileMapping& file)
+{
+	const MeshFileHeader& header = file.GetHeader();
+	if(!meshfile_CheckIndices(file))
+	{
+		std::cerr << "mesh file has indices past its vertices" << std::endl;
+		return nullptr;
+	}
+	std::vector<GeomRange> ranges;
+	ranges.reserve(header.m_numRanges);
+	const MeshFileRange* fileRanges = file.GetRanges();
+	for(uint32_t i = 0; i < header.m_numRanges; ++i)
+		ranges.emplace_back(fileRanges[i].m_firstIndex, fileRanges[i].m_numIndices, 
+			fileRanges[i].m_baseVertex);
+	return mesh_CreateGeom(file.GetVertexData(), header.m_numVertices, header.m_vertexFormat,
+		file.GetIndexData(), header.m_numIndices, ranges);
+}
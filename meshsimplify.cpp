@@ -0,0 +1,598 @@
+#include <algorithm>
+#include <cmath>
+#include <queue>
+#include "common.hh"
+#include "mesh.hh"
+#include "meshsimplify.hh"
+#include "task.hh"
+
+////////////////////////////////////////////////////////////////////////////////
+// faces per partition of the parallel pass; smaller meshes skip it
+static constexpr int kPartitionFaces = 32768;
+
+////////////////////////////////////////////////////////////////////////////////
+// Sum of squared distances to a set of planes, as the symmetric 4x4 matrix
+// [A b; b' c] stored upper triangle first.
+struct Quadric
+{
+	double m[10];
+
+	Quadric() { std::fill(m, m + 10, 0.0); }
+	Quadric(const vec3& n, float d, float weight)
+	{
+		const double a = n.x, b = n.y, c = n.z, e = d;
+		m[0] = a*a; m[1] = a*b; m[2] = a*c; m[3] = a*e;
+		m[4] = b*b; m[5] = b*c; m[6] = b*e;
+		m[7] = c*c; m[8] = c*e;
+		m[9] = e*e;
+		for(double& val: m)
+			val *= weight;
+	}
+
+	Quadric& operator+=(const Quadric& r) { for(int i = 0; i < 10; ++i) m[i] += r.m[i]; return *this; }
+	Quadric& operator-=(const Quadric& r) { for(int i = 0; i < 10; ++i) m[i] -= r.m[i]; return *this; }
+	Quadric operator+(const Quadric& r) const { Quadric q = *this; return q += r; }
+
+	double Evaluate(const vec3& p) const
+	{
+		const double x = p.x, y = p.y, z = p.z;
+		return m[0]*x*x + 2*m[1]*x*y + 2*m[2]*x*z + 2*m[3]*x +
+			m[4]*y*y + 2*m[5]*y*z + 2*m[6]*y +
+			m[7]*z*z + 2*m[8]*z +
+			m[9];
+	}
+
+	// The point minimizing the error, unless A is close to singular, as it
+	// is for flat or creased patches where a line or plane of points ties.
+	bool Minimize(vec3& out) const
+	{
+		const double a00 = m[0], a01 = m[1], a02 = m[2];
+		const double a11 = m[4], a12 = m[5], a22 = m[7];
+		const double c0 = a11*a22 - a12*a12;
+		const double c1 = a02*a12 - a01*a22;
+		const double c2 = a01*a12 - a02*a11;
+		const double det = a00*c0 + a01*c1 + a02*c2;
+		const double trace = a00 + a11 + a22;
+		if(!(fabs(det) > 1e-3 * trace * trace * trace / 27.0))
+			return false;
+
+		const double b0 = -m[3], b1 = -m[6], b2 = -m[8];
+		const double invDet = 1.0 / det;
+		out.x = float((c0*b0 + c1*b1 + c2*b2) * invDet);
+		out.y = float((c1*b0 + (a00*a22 - a02*a02)*b1 + (a01*a02 - a00*a12)*b2) * invDet);
+		out.z = float((c2*b0 + (a01*a02 - a00*a12)*b1 + (a00*a11 - a01*a01)*b2) * invDet);
+		return true;
+	}
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Collapses edges cheapest first. Candidates are only queued, never updated;
+// a collapse bumps its vertices' versions, and stale candidates are dropped
+// when they come off the queue.
+class MeshSimplifier
+{
+public:
+	MeshSimplifier(std::vector<vec3>& positions, std::vector<int>& indices,
+		std::vector<Quadric>& quadrics, std::vector<bool>& locked);
+
+	void Run(int targetFaces);
+	int NumFaces() const { return m_numFaces; }
+
+	// live vertices and faces, packed. outVertexMap gives each output vertex's
+	// index in the input.
+	void Extract(std::vector<vec3>& outPositions, std::vector<int>& outIndices,
+		std::vector<Quadric>& outQuadrics, std::vector<bool>& outLocked, 
+		std::vector<int>& outVertexMap) const;
+	std::shared_ptr<TriSoup> CreateMesh() const;
+private:
+	struct Candidate {
+		double m_cost;
+		int m_verts[2]; // m_verts[1] goes into m_verts[0]
+		int m_versions[2];
+		bool operator<(const Candidate& r) const { return m_cost > r.m_cost; }
+	};
+
+	bool FaceAlive(int face) const { return m_indices[3 * face] >= 0; }
+	vec3 CollapsePos(int v0, int v1) const;
+	void PushEdge(int v0, int v1);
+	bool CanCollapse(int v0, int v1, const vec3& pos);
+	void Collapse(int v0, int v1, const vec3& pos);
+
+	std::vector<vec3> m_pos;
+	std::vector<int> m_indices; // 3 per face, the first is -1 once it's gone
+	std::vector<Quadric> m_quadrics;
+	std::vector<bool> m_locked;
+	std::vector<bool> m_removed;
+	std::vector<int> m_versions;
+	std::vector<std::vector<int>> m_vertFaces; // may hold dead faces
+	std::priority_queue<Candidate> m_queue;
+	int m_numFaces;
+
+	// CanCollapse scratch
+	std::vector<int> m_neighbors0;
+	std::vector<int> m_neighbors1;
+};
+
+MeshSimplifier::MeshSimplifier(std::vector<vec3>& positions, std::vector<int>& indices,
+	std::vector<Quadric>& quadrics, std::vector<bool>& locked)
+	: m_numFaces(indices.size() / 3)
+{
+	m_pos.swap(positions);
+	m_indices.swap(indices);
+	m_quadrics.swap(quadrics);
+	m_locked.swap(locked);
+	const int numVerts = m_pos.size();
+	m_removed.resize(numVerts, false);
+	m_versions.resize(numVerts, 0);
+	m_vertFaces.resize(numVerts);
+	for(int face = 0; face < m_numFaces; ++face)
+		for(int i = 0; i < 3; ++i)
+			m_vertFaces[m_indices[3 * face + i]].push_back(face);
+
+	// edges are queued from the face that has them in increasing order, once
+	// each on a consistently wound mesh
+	for(int face = 0; face < m_numFaces; ++face)
+	{
+		for(int i = 0; i < 3; ++i)
+		{
+			const int v0 = m_indices[3 * face + i], v1 = m_indices[3 * face + (i + 1) % 3];
+			if(v0 < v1)
+				PushEdge(v0, v1);
+		}
+	}
+}
+
+vec3 MeshSimplifier::CollapsePos(int v0, int v1) const
+{
+	if(m_locked[v0])
+		return m_pos[v0];
+
+	const Quadric q = m_quadrics[v0] + m_quadrics[v1];
+	const vec3 mid = 0.5f * (m_pos[v0] + m_pos[v1]);
+	vec3 pos;
+	if(q.Minimize(pos) && DistSq(pos, mid) <= DistSq(m_pos[v0], m_pos[v1]))
+		return pos;
+
+	const vec3 choices[] = { mid, m_pos[v0], m_pos[v1] };
+	int best = 0;
+	double bestCost = q.Evaluate(choices[0]);
+	for(int i = 1; i < 3; ++i)
+	{
+		const double cost = q.Evaluate(choices[i]);
+		if(cost < bestCost)
+		{
+			best = i;
+			bestCost = cost;
+		}
+	}
+	return choices[best];
+}
+
+void MeshSimplifier::PushEdge(int v0, int v1)
+{
+	if(m_locked[v1])
+		std::swap(v0, v1);
+	if(m_locked[v1])
+		return;
+
+	const vec3 pos = CollapsePos(v0, v1);
+	Candidate candidate;
+	candidate.m_cost = Max(0.0, (m_quadrics[v0] + m_quadrics[v1]).Evaluate(pos));
+	candidate.m_verts[0] = v0;
+	candidate.m_verts[1] = v1;
+	candidate.m_versions[0] = m_versions[v0];
+	candidate.m_versions[1] = m_versions[v1];
+	m_queue.push(candidate);
+}
+
+// Rejects collapses that would pinch the surface (the edge's endpoints share
+// a neighbor other than through the faces on the edge), or turn a face over.
+bool MeshSimplifier::CanCollapse(int v0, int v1, const vec3& pos)
+{
+	auto gatherNeighbors = [&](int vert, std::vector<int>& out) {
+		out.clear();
+		for(int face: m_vertFaces[vert])
+		{
+			if(!FaceAlive(face))
+				continue;
+			for(int i = 0; i < 3; ++i)
+				if(m_indices[3 * face + i] != vert)
+					out.push_back(m_indices[3 * face + i]);
+		}
+		std::sort(out.begin(), out.end());
+		out.erase(std::unique(out.begin(), out.end()), out.end());
+	};
+	gatherNeighbors(v0, m_neighbors0);
+	gatherNeighbors(v1, m_neighbors1);
+
+	int sharedFaces = 0;
+	for(int face: m_vertFaces[v0])
+	{
+		if(!FaceAlive(face))
+			continue;
+		const int* verts = &m_indices[3 * face];
+		if(verts[0] == v1 || verts[1] == v1 || verts[2] == v1)
+			++sharedFaces;
+	}
+	if(sharedFaces == 0)
+		return false;
+
+	int sharedNeighbors = 0;
+	for(auto i0 = m_neighbors0.begin(), i1 = m_neighbors1.begin();
+		i0 != m_neighbors0.end() && i1 != m_neighbors1.end(); )
+	{
+		if(*i0 < *i1) ++i0;
+		else if(*i1 < *i0) ++i1;
+		else { ++sharedNeighbors; ++i0; ++i1; }
+	}
+	if(sharedNeighbors != sharedFaces)
+		return false;
+
+	for(int vert: {v0, v1})
+	{
+		for(int face: m_vertFaces[vert])
+		{
+			if(!FaceAlive(face))
+				continue;
+			const int* verts = &m_indices[3 * face];
+			vec3 before[3], after[3];
+			bool onEdge = false;
+			for(int i = 0; i < 3; ++i)
+			{
+				before[i] = m_pos[verts[i]];
+				after[i] = before[i];
+				if(verts[i] == v0 || verts[i] == v1)
+				{
+					onEdge = onEdge || verts[i] != vert;
+					after[i] = pos;
+				}
+			}
+			if(onEdge)
+				continue;
+
+			const vec3 n0 = Cross(before[1] - before[0], before[2] - before[0]);
+			const vec3 n1 = Cross(after[1] - after[0], after[2] - after[0]);
+			const float lenSq0 = LengthSq(n0), lenSq1 = LengthSq(n1);
+			if(lenSq1 <= 0.f || Dot(n0, n1) <= 0.2f * sqrtf(lenSq0 * lenSq1))
+				return false;
+		}
+	}
+	return true;
+}
+
+void MeshSimplifier::Collapse(int v0, int v1, const vec3& pos)
+{
+	std::vector<int>& faces0 = m_vertFaces[v0];
+	for(int face: m_vertFaces[v1])
+	{
+		if(!FaceAlive(face))
+			continue;
+		int* verts = &m_indices[3 * face];
+		if(verts[0] == v0 || verts[1] == v0 || verts[2] == v0)
+		{
+			verts[0] = -1;
+			--m_numFaces;
+			continue;
+		}
+		for(int i = 0; i < 3; ++i)
+			if(verts[i] == v1)
+				verts[i] = v0;
+		faces0.push_back(face);
+	}
+	faces0.erase(std::remove_if(faces0.begin(), faces0.end(),
+		[this](int face) { return !FaceAlive(face); }), faces0.end());
+	std::vector<int>().swap(m_vertFaces[v1]);
+
+	m_pos[v0] = pos;
+	m_quadrics[v0] += m_quadrics[v1];
+	m_removed[v1] = true;
+	++m_versions[v0];
+	++m_versions[v1];
+
+	for(int face: faces0)
+		for(int i = 0; i < 3; ++i)
+			if(m_indices[3 * face + i] != v0)
+				PushEdge(v0, m_indices[3 * face + i]);
+}
+
+void MeshSimplifier::Run(int targetFaces)
+{
+	while(m_numFaces > targetFaces && !m_queue.empty())
+	{
+		const Candidate candidate = m_queue.top();
+		m_queue.pop();
+		const int v0 = candidate.m_verts[0], v1 = candidate.m_verts[1];
+		if(m_removed[v0] || m_removed[v1] ||
+			m_versions[v0] != candidate.m_versions[0] ||
+			m_versions[v1] != candidate.m_versions[1])
+			continue;
+
+		const vec3 pos = CollapsePos(v0, v1);
+		if(CanCollapse(v0, v1, pos))
+			Collapse(v0, v1, pos);
+	}
+}
+
+void MeshSimplifier::Extract(std::vector<vec3>& outPositions, std::vector<int>& outIndices,
+	std::vector<Quadric>& outQuadrics, std::vector<bool>& outLocked, 
+	std::vector<int>& outVertexMap) const
+{
+	std::vector<int> remap(m_pos.size(), -1);
+	outPositions.clear();
+	outIndices.clear();
+	outQuadrics.clear();
+	outLocked.clear();
+	outVertexMap.clear();
+	for(int face = 0; face < int(m_indices.size() / 3); ++face)
+	{
+		if(!FaceAlive(face))
+			continue;
+		for(int i = 0; i < 3; ++i)
+		{
+			const int vert = m_indices[3 * face + i];
+			if(remap[vert] < 0)
+			{
+				remap[vert] = outPositions.size();
+				outPositions.push_back(m_pos[vert]);
+				outQuadrics.push_back(m_quadrics[vert]);
+				outLocked.push_back(m_locked[vert]);
+				outVertexMap.push_back(vert);
+			}
+			outIndices.push_back(remap[vert]);
+		}
+	}
+}
+
+std::shared_ptr<TriSoup> MeshSimplifier::CreateMesh() const
+{
+	std::vector<int> remap(m_pos.size(), -1);
+	auto mesh = std::make_shared<TriSoup>();
+	for(int face = 0; face < int(m_indices.size() / 3); ++face)
+	{
+		if(!FaceAlive(face))
+			continue;
+		int verts[3];
+		for(int i = 0; i < 3; ++i)
+		{
+			const int vert = m_indices[3 * face + i];
+			if(remap[vert] < 0)
+				remap[vert] = mesh->AddVertex(m_pos[vert]);
+			verts[i] = remap[vert];
+		}
+		mesh->AddFace(verts[0], verts[1], verts[2]);
+	}
+	mesh->ComputeNormals();
+	return mesh;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Vertices on an edge with other than two faces are held in place.
+static std::vector<bool> mesh_FindBoundaryVertices(int numVerts, const std::vector<int>& indices)
+{
+	std::vector<std::pair<int, int>> edges;
+	edges.reserve(indices.size());
+	for(size_t face = 0; face < indices.size(); face += 3)
+	{
+		for(int i = 0; i < 3; ++i)
+		{
+			const int v0 = indices[face + i], v1 = indices[face + (i + 1) % 3];
+			edges.push_back(std::make_pair(Min(v0, v1), Max(v0, v1)));
+		}
+	}
+	std::sort(edges.begin(), edges.end());
+
+	std::vector<bool> boundary(numVerts, false);
+	for(size_t i = 0; i < edges.size(); )
+	{
+		size_t end = i + 1;
+		while(end < edges.size() && edges[end] == edges[i])
+			++end;
+		if(end - i != 2)
+			boundary[edges[i].first] = boundary[edges[i].second] = true;
+		i = end;
+	}
+	return boundary;
+}
+
+// Each vertex starts with the planes of its faces, weighted by their areas.
+static std::vector<Quadric> mesh_ComputeQuadrics(const std::vector<vec3>& positions,
+	const std::vector<int>& indices)
+{
+	std::vector<Quadric> quadrics(positions.size());
+	for(size_t face = 0; face < indices.size(); face += 3)
+	{
+		const vec3& p0 = positions[indices[face]];
+		const vec3 n = Cross(positions[indices[face + 1]] - p0, positions[indices[face + 2]] - p0);
+		const float len = Length(n);
+		if(len <= 0.f)
+			continue;
+		const vec3 unitN = n / len;
+		const Quadric q(unitN, -Dot(unitN, p0), 0.5f * len);
+		for(int i = 0; i < 3; ++i)
+			quadrics[indices[face + i]] += q;
+	}
+	return quadrics;
+}
+
+// The parallel pass: faces go to a grid of partitions by centroid, and each
+// partition is simplified to targetRatio of its faces on its own, with any vertex used by
+// another partition locked. Their results are joined back up through those
+// vertices, which keep their global indices.
+static void mesh_SimplifyPartitions(std::vector<vec3>& positions, std::vector<int>& indices,
+	std::vector<Quadric>& quadrics, std::vector<bool>& locked, float targetRatio)
+{
+	const int numTris = indices.size() / 3;
+	const int numVerts = positions.size();
+	const int gridDim = int(cbrtf(float(numTris) / kPartitionFaces) + 0.5f);
+	if(gridDim < 2)
+		return;
+
+	AABB bounds;
+	for(const vec3& pos: positions)
+		bounds.Extend(pos);
+	const vec3 extent = bounds.m_max - bounds.m_min;
+	auto cellOf = [&](float val, float lo, float size) {
+		return size > 0.f ? Clamp(int((val - lo) / size * gridDim), 0, gridDim - 1) : 0;
+	};
+
+	const int numPartitions = gridDim * gridDim * gridDim;
+	std::vector<int> facePartition(numTris);
+	std::vector<int> vertPartition(numVerts, -1); // -2 when shared
+	for(int face = 0; face < numTris; ++face)
+	{
+		const vec3 centroid = (positions[indices[3*face]] + positions[indices[3*face + 1]] +
+			positions[indices[3*face + 2]]) / 3.f;
+		const int partition = cellOf(centroid.x, bounds.m_min.x, extent.x) +
+			gridDim * (cellOf(centroid.y, bounds.m_min.y, extent.y) +
+			gridDim * cellOf(centroid.z, bounds.m_min.z, extent.z));
+		facePartition[face] = partition;
+		for(int i = 0; i < 3; ++i)
+		{
+			int& owner = vertPartition[indices[3*face + i]];
+			if(owner == -1)
+				owner = partition;
+			else if(owner != partition)
+				owner = -2;
+		}
+	}
+
+	std::vector<int> firstFace(numPartitions + 1, 0);
+	for(int partition: facePartition)
+		++firstFace[partition + 1];
+	for(int i = 0; i < numPartitions; ++i)
+		firstFace[i + 1] += firstFace[i];
+	std::vector<int> partitionFaces(numTris);
+	{
+		std::vector<int> cursor(firstFace.begin(), firstFace.end() - 1);
+		for(int face = 0; face < numTris; ++face)
+			partitionFaces[cursor[facePartition[face]]++] = face;
+	}
+
+	struct PartitionResult {
+		std::vector<int> m_globalVerts; // local vertex -> global, for the input
+		std::vector<vec3> m_positions;
+		std::vector<int> m_indices;
+		std::vector<Quadric> m_quadrics;
+		std::vector<bool> m_locked;
+		std::vector<int> m_vertexMap;
+	};
+	std::vector<PartitionResult> results(numPartitions);
+	task_ParallelFor(numPartitions, [&](int partition) {
+		PartitionResult& result = results[partition];
+		const int begin = firstFace[partition], end = firstFace[partition + 1];
+		if(begin == end)
+			return;
+
+		std::vector<int>& globalVerts = result.m_globalVerts;
+		for(int i = begin; i < end; ++i)
+			for(int j = 0; j < 3; ++j)
+				globalVerts.push_back(indices[3 * partitionFaces[i] + j]);
+		std::sort(globalVerts.begin(), globalVerts.end());
+		globalVerts.erase(std::unique(globalVerts.begin(), globalVerts.end()), globalVerts.end());
+
+		std::vector<vec3> localPositions(globalVerts.size());
+		std::vector<Quadric> localQuadrics(globalVerts.size());
+		std::vector<bool> localLocked(globalVerts.size());
+		for(size_t i = 0; i < globalVerts.size(); ++i)
+		{
+			const int vert = globalVerts[i];
+			localPositions[i] = positions[vert];
+			localQuadrics[i] = quadrics[vert];
+			localLocked[i] = locked[vert] || vertPartition[vert] == -2;
+		}
+		std::vector<int> localIndices;
+		localIndices.reserve(3 * (end - begin));
+		for(int i = begin; i < end; ++i)
+			for(int j = 0; j < 3; ++j)
+				localIndices.push_back(std::lower_bound(globalVerts.begin(), globalVerts.end(),
+					indices[3 * partitionFaces[i] + j]) - globalVerts.begin());
+
+		MeshSimplifier simplifier(localPositions, localIndices, localQuadrics, localLocked);
+		simplifier.Run(int(targetRatio * (end - begin)));
+		simplifier.Extract(result.m_positions, result.m_indices, result.m_quadrics, 
+			result.m_locked, result.m_vertexMap);
+	});
+
+	// Shared vertices pick up the quadrics of whatever each partition
+	// collapsed into them.
+	std::vector<int> sharedOut(numVerts, -1);
+	std::vector<vec3> outPositions;
+	std::vector<int> outIndices;
+	std::vector<Quadric> outQuadrics;
+	std::vector<bool> outLocked;
+	for(const PartitionResult& result: results)
+	{
+		std::vector<int> remap(result.m_positions.size());
+		for(size_t i = 0; i < result.m_positions.size(); ++i)
+		{
+			const int vert = result.m_globalVerts[result.m_vertexMap[i]];
+			if(vertPartition[vert] != -2)
+			{
+				remap[i] = outPositions.size();
+				outPositions.push_back(result.m_positions[i]);
+				outQuadrics.push_back(result.m_quadrics[i]);
+				outLocked.push_back(locked[vert]);
+				continue;
+			}
+
+			if(sharedOut[vert] < 0)
+			{
+				sharedOut[vert] = outPositions.size();
+				outPositions.push_back(positions[vert]);
+				outQuadrics.push_back(quadrics[vert]);
+				outLocked.push_back(locked[vert]);
+			}
+			remap[i] = sharedOut[vert];
+			outQuadrics[remap[i]] += result.m_quadrics[i];
+			outQuadrics[remap[i]] -= quadrics[vert];
+		}
+		for(int index: result.m_indices)
+			outIndices.push_back(remap[index]);
+	}
+
+	positions.swap(outPositions);
+	indices.swap(outIndices);
+	quadrics.swap(outQuadrics);
+	locked.swap(outLocked);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+std::vector<std::shared_ptr<TriSoup>> mesh_CreateLodChain(const TriSoup& mesh,
+	const std::vector<float>& ratios)
+{
+	std::vector<std::shared_ptr<TriSoup>> lods;
+	if(ratios.empty())
+		return lods;
+
+	const int numTris = mesh.NumFaces();
+	std::vector<vec3> positions(mesh.NumVertices());
+	for(int i = 0; i < mesh.NumVertices(); ++i)
+		positions[i] = mesh.GetVertexPos(i);
+	std::vector<int> indices(mesh.GetIndexData(), mesh.GetIndexData() + 3 * numTris);
+	std::vector<Quadric> quadrics = mesh_ComputeQuadrics(positions, indices);
+	std::vector<bool> locked = mesh_FindBoundaryVertices(positions.size(), indices);
+
+	// each step of the chain gets its own parallel pass, then the serial one
+	// only has the partitions' seams left to do
+	std::vector<int> vertexMap;
+	for(float ratio: ratios)
+	{
+		const int targetFaces = int(ratio * numTris);
+		const int numFaces = indices.size() / 3;
+		if(numFaces > 0)
+			mesh_SimplifyPartitions(positions, indices, quadrics, locked, 
+				float(targetFaces) / numFaces);
+
+		MeshSimplifier simplifier(positions, indices, quadrics, locked);
+		simplifier.Run(targetFaces);
+		lods.push_back(simplifier.CreateMesh());
+		simplifier.Extract(positions, indices, quadrics, locked, vertexMap);
+	}
+	return lods;
+}
+
+std::shared_ptr<TriSoup> mesh_Simplify(const TriSoup& mesh, float ratio)
+{
+	return mesh_CreateLodChain(mesh, std::vector<float>(1, ratio))[0];
+}
+
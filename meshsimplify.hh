@@ -0,0 +1,22 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+class TriSoup;
+
+////////////////////////////////////////////////////////////////////////////////
+// Mesh simplification
+// Quadric error edge collapses (Garland & Heckbert, "Surface Simplification
+// Using Quadric Error Metrics"). Vertices on open boundaries never move, so
+// pieces of a bigger surface still line up after they're simplified. Big
+// meshes are first simplified a spatial partition at a time across all cores,
+// holding the vertices partitions share in place, then finished as a whole.
+
+// About ratio of mesh's faces, with normals recomputed.
+std::shared_ptr<TriSoup> mesh_Simplify(const TriSoup& mesh, float ratio);
+
+// A mesh per ratio, which should be decreasing, each carrying on from the
+// collapses of the one before.
+std::vector<std::shared_ptr<TriSoup>> mesh_CreateLodChain(const TriSoup& mesh,
+	const std::vector<float>& ratios);
+
@@ -50,3 +50,37 @@ __kernel void mergeSumBlock(
 	outData[index] = odata;
 }
 
+
+// Exclusive scan of each work group's part of inData, which has num elements.
+// The group's total goes to blockSums, for scanning the groups in turn. With
+// countNonZero each nonzero element counts as 1, which gives the slots of a
+// stream compaction.
+__kernel void scanBlocksExclusive(
+	__global uint *outData,
+	__global const uint *inData,
+	__global uint *blockSums,
+	unsigned int num,
+	unsigned int countNonZero,
+	__local unsigned int *temp)
+{
+	uint index = get_global_id(0);
+	uint data = index < num ? inData[index] : 0;
+	if(countNonZero)
+		data = data ? 1 : 0;
+
+	uint sum = scan1Inclusive(data, temp, get_local_size(0));
+	if(index < num)
+		outData[index] = sum - data;
+	if(get_local_id(0) == get_local_size(0) - 1)
+		blockSums[get_group_id(0)] = sum;
+}
+
+__kernel void addBlockSums(
+	__global uint *data,
+	__global const uint *blockOffsets,
+	unsigned int num)
+{
+	uint index = get_global_id(0);
+	if(index < num)
+		data[index] += blockOffsets[get_group_id(0)];
+}
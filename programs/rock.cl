@@ -83,6 +83,18 @@ __kernel void generateVoronoiTexture(
 	write_imagef(outputImage, coords, (float4)(bestVal));
 }
 
+// Rock density at a point of the unit cube, negative inside the rock.
+float rockDensity(float3 pt, float radius, float3 noiseScale, float H, 
+	float lacunarity, float octaves, float noiseAmp)
+{
+	const float3 center = (float3)(0.5,0.5,0.5);
+	float3 diff = pt - center;
+	float len = length(diff);
+
+	len += noiseAmp * fbmNoise3(pt * noiseScale, H, lacunarity, octaves);
+	return len - radius;
+}
+
 __kernel void generateRockDensity(
 	__write_only __global float *outDensity,
 	float radius,
@@ -98,14 +110,295 @@ __kernel void generateRockDensity(
 	int2 dims = (int2)(get_global_size(0), get_global_size(1));
 	
 	float3 pt = (float3)(convert_float2(coords) / convert_float2(dims - (int2)(1)), zCoord);
-	const float3 center = (float3)(0.5,0.5,0.5);
-	float3 diff = pt - center;
-	float len = length(diff);
 
-	len += noiseAmp * fbmNoise3(pt * noiseScale, H, lacunarity, octaves);
+	int index = coords.x + coords.y * dims.x;
+	outDensity[index] = rockDensity(pt, radius, noiseScale, H, lacunarity, octaves, noiseAmp);
+}
+
+// Same as generateRockDensity for the whole volume at once, for when the 
+// field stays on the device.
+__kernel void generateRockDensityVolume(
+	__write_only __global float *outDensity,
+	float radius,
+	float3 noiseScale,
+	float H,
+	float lacunarity,
+	float octaves,
+	float noiseAmp
+	)
+{
+	int3 coords = (int3)(get_global_id(0), get_global_id(1), get_global_id(2));
+	int3 dims = (int3)(get_global_size(0), get_global_size(1), get_global_size(2));
+
+	float3 pt = convert_float3(coords) / convert_float3(dims - (int3)(1));
+
+	int index = coords.x + dims.x * (coords.y + dims.y * coords.z);
+	outDensity[index] = rockDensity(pt, radius, noiseScale, H, lacunarity, octaves, noiseAmp);
+}
+
+// Terrain density at world space sample points, negative below the ground.
+// The ground is at heightScale * fbm noise, and since the noise is 3D it 
+// also makes overhangs.
+__kernel void generateTerrainDensity(
+	__write_only __global float *outDensity,
+	float3 origin,
+	float spacing,
+	float3 noiseScale,
+	float H,
+	float lacunarity,
+	float octaves,
+	float heightScale,
+	float zCoord
+	)
+{
+	int2 coords = (int2)(get_global_id(0), get_global_id(1));
+	int2 dims = (int2)(get_global_size(0), get_global_size(1));
+
+	float3 pt = (float3)(origin.xy + spacing * convert_float2(coords), zCoord);
+	float density = pt.z - heightScale * fbmNoise3(pt * noiseScale, H, lacunarity, octaves);
 
 	int index = coords.x + coords.y * dims.x;
-	float density = len - radius;
 	outDensity[index] = density;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// Device contouring
+// Marching tetrahedra with the same cell split and tables as surfcon.cpp, run
+// as classify, scan, compact and generate stages so the field never has to 
+// leave the device (see clcontour.cpp for the host side). A vertex belongs to
+// the lattice edge it lies on, and an edge to its lower lattice point (by 
+// index) and one of 7 kinds. Each point's vertices are numbered from the
+// point's scanned vertex offset, in order of edge kind.
+
+// lattice step from the lower to the upper end of each edge kind
+__constant int g_contourEdgeSteps[7][3] = {
+	{ 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 }, { -1, 1, 0 }, { 1, 0, 1 }, { 0, -1, 1 }, { 1, -1, 1 },
+};
+
+// lattice offsets of the cell corners
+__constant int g_contourCellCorners[8][3] = {
+	{ 0, 0, 0 }, { 1, 0, 0 }, { 1, 1, 0 }, { 0, 1, 0 },
+	{ 0, 0, 1 }, { 1, 0, 1 }, { 1, 1, 1 }, { 0, 1, 1 },
+};
+
+// edge kind for a pair of cell corners, indexed [lower corner][upper corner]
+__constant int g_contourCellEdgeKinds[8][8] = {
+	{ -1,  0, -1,  1,  2,  4, -1, -1 },
+	{ -1, -1,  1,  3, -1,  2, -1, -1 },
+	{ -1, -1, -1, -1, -1,  5,  2, -1 },
+	{ -1, -1,  0, -1,  5,  6,  4,  2 },
+	{ -1, -1, -1, -1, -1,  0, -1,  1 },
+	{ -1, -1, -1, -1, -1, -1,  1,  3 },
+	{ -1, -1, -1, -1, -1, -1, -1, -1 },
+	{ -1, -1, -1, -1, -1, -1,  0, -1 },
+};
+
+__constant int g_contourCellTets[6][4] = {
+	{ 0, 3, 1, 5 }, { 1, 3, 2, 5 }, { 4, 5, 7, 3 }, 
+	{ 5, 6, 7, 3 }, { 0, 5, 4, 3 }, { 5, 2, 6, 3 },
+};
+
+__constant int g_contourTetEdges[6][2] = {
+	{ 0, 1 }, { 1, 2 }, { 2, 0 }, { 0, 3 }, { 1, 3 }, { 2, 3 }
+};
+
+// tetrahedron edges of each triangle, by inside bits of the tetrahedron's corners
+__constant int g_contourTetTris[16][6] = {
+	{ -1, -1, -1, -1, -1, -1 },
+	{ 0, 3, 2, -1, -1, -1 },
+	{ 0, 1, 4, -1, -1, -1 },
+	{ 1, 4, 3, 1, 3, 2 },
+	{ 1, 2, 5, -1, -1, -1 },
+	{ 1, 3, 5, 1, 0, 3 },
+	{ 2, 5, 4, 2, 4, 0 },
+	{ 3, 5, 4, -1, -1, -1 },
+	{ 3, 4, 5, -1, -1, -1 },
+	{ 2, 4, 5, 2, 0, 4 },
+	{ 1, 5, 3, 1, 3, 0 },
+	{ 1, 5, 2, -1, -1, -1 },
+	{ 1, 3, 4, 1, 2, 3 },
+	{ 0, 4, 1, -1, -1, -1 },
+	{ 0, 2, 3, -1, -1, -1 },
+	{ -1, -1, -1, -1, -1, -1 },
+};
+
+__constant uint g_contourTetNumTris[16] = { 0, 1, 1, 2, 1, 2, 2, 1, 1, 2, 2, 1, 2, 1, 1, 0 };
+
+// central differences, one sided at the border, matching surfcon_Gradient
+float3 contourGradient(__global const float *density, int x, int y, int z, 
+	int width, int height, int depth)
+{
+	int slicePitch = width * height;
+	int index = x + width * y + slicePitch * z;
+	int dx0 = x > 0 ? 1 : 0, dx1 = x + 1 < width ? 1 : 0;
+	int dy0 = y > 0 ? width : 0, dy1 = y + 1 < height ? width : 0;
+	int dz0 = z > 0 ? slicePitch : 0, dz1 = z + 1 < depth ? slicePitch : 0;
+	return (float3)(
+		density[index + dx1] - density[index - dx0],
+		density[index + dy1] - density[index - dy0],
+		density[index + dz1] - density[index - dz0]);
+}
+
+// Stage 1, one work item per lattice point: which of the point's edges cross
+// the isolevel, and how many vertices that makes.
+__kernel void classifyContourPoints(
+	__global const float *density,
+	__global uint *vertexCounts,
+	__global uchar *edgeMasks,
+	float isolevel,
+	int width, int height, int depth)
+{
+	int x = get_global_id(0), y = get_global_id(1), z = get_global_id(2);
+	int index = x + width * (y + height * z);
+	bool inside = density[index] - isolevel < 0;
+
+	uint mask = 0;
+	for(int kind = 0; kind < 7; ++kind)
+	{
+		int ux = x + g_contourEdgeSteps[kind][0];
+		int uy = y + g_contourEdgeSteps[kind][1];
+		int uz = z + g_contourEdgeSteps[kind][2];
+		if(ux < 0 || ux >= width || uy < 0 || uy >= height || uz >= depth)
+			continue;
+		int upper = ux + width * (uy + height * uz);
+		if((density[upper] - isolevel < 0) != inside)
+			mask |= 1 << kind;
+	}
+	edgeMasks[index] = mask;
+	vertexCounts[index] = popcount(mask);
+}
+
+// Stage 1, one work item per cell: how many triangles the cell makes.
+__kernel void classifyContourCells(
+	__global const float *density,
+	__global uint *triCounts,
+	float isolevel,
+	int width, int height, int depth)
+{
+	int x = get_global_id(0), y = get_global_id(1), z = get_global_id(2);
+	uint insideBits = 0;
+	for(int i = 0; i < 8; ++i)
+	{
+		int index = (x + g_contourCellCorners[i][0]) + 
+			width * ((y + g_contourCellCorners[i][1]) + height * (z + g_contourCellCorners[i][2]));
+		insideBits |= (density[index] - isolevel < 0 ? 1 : 0) << i;
+	}
+
+	uint count = 0;
+	if(insideBits != 0 && insideBits != 0xff)
+	{
+		for(int tet = 0; tet < 6; ++tet)
+		{
+			uint tetIndex = 0;
+			for(int i = 0; i < 4; ++i)
+				tetIndex |= ((insideBits >> g_contourCellTets[tet][i]) & 1) << i;
+			count += g_contourTetNumTris[tetIndex];
+		}
+	}
+	triCounts[x + (width - 1) * (y + (height - 1) * z)] = count;
+}
+
+// Stage 3: the indices of the nonzero counts, at the slots from scanning the
+// counts with countNonZero.
+__kernel void compactContourItems(
+	__global const uint *counts,
+	__global const uint *slots,
+	__global uint *items)
+{
+	uint index = get_global_id(0);
+	if(counts[index])
+		items[slots[index]] = index;
+}
+
+// Stage 4, one work item per active point: position and normal of each 
+// crossing, 6 floats per vertex.
+__kernel void generateContourVertices(
+	__global const float *density,
+	__global const uchar *edgeMasks,
+	__global const uint *vertexOffsets,
+	__global const uint *activePoints,
+	__global float *vertices,
+	float isolevel,
+	int width, int height, int depth,
+	float3 startPt,
+	float inc)
+{
+	int index = activePoints[get_global_id(0)];
+	int x = index % width;
+	int y = (index / width) % height;
+	int z = index / (width * height);
+	uint mask = edgeMasks[index];
+	uint vertex = vertexOffsets[index];
+
+	float d0 = density[index] - isolevel;
+	float3 p0 = startPt + inc * (float3)(x, y, z);
+	float3 g0 = contourGradient(density, x, y, z, width, height, depth);
+	for(int kind = 0; kind < 7; ++kind)
+	{
+		if(!(mask & (1 << kind)))
+			continue;
+		int ux = x + g_contourEdgeSteps[kind][0];
+		int uy = y + g_contourEdgeSteps[kind][1];
+		int uz = z + g_contourEdgeSteps[kind][2];
+		float d1 = density[ux + width * (uy + height * uz)] - isolevel;
+		float t = clamp(d0 / (d0 - d1), 0.f, 1.f);
+		float3 pos = (1.f - t) * p0 + t * (startPt + inc * (float3)(ux, uy, uz));
+		float3 grad = (1.f - t) * g0 + t * contourGradient(density, ux, uy, uz, width, height, depth);
+		float len = length(grad);
+		float3 normal = len > 0.f ? grad / len : (float3)(0.f, 0.f, 1.f);
+
+		__global float *out = vertices + 6 * vertex;
+		out[0] = pos.x; out[1] = pos.y; out[2] = pos.z;
+		out[3] = normal.x; out[4] = normal.y; out[5] = normal.z;
+		++vertex;
+	}
+}
+
+// Stage 4, one work item per active cell: the cell's triangles, as indices of
+// the vertices generateContourVertices writes.
+__kernel void generateContourTriangles(
+	__global const float *density,
+	__global const uchar *edgeMasks,
+	__global const uint *vertexOffsets,
+	__global const uint *triOffsets,
+	__global const uint *activeCells,
+	__global uint *indices,
+	float isolevel,
+	int width, int height, int depth)
+{
+	int cell = activeCells[get_global_id(0)];
+	int x = cell % (width - 1);
+	int y = (cell / (width - 1)) % (height - 1);
+	int z = cell / ((width - 1) * (height - 1));
+
+	int corners[8];
+	uint insideBits = 0;
+	for(int i = 0; i < 8; ++i)
+	{
+		corners[i] = (x + g_contourCellCorners[i][0]) + 
+			width * ((y + g_contourCellCorners[i][1]) + height * (z + g_contourCellCorners[i][2]));
+		insideBits |= (density[corners[i]] - isolevel < 0 ? 1 : 0) << i;
+	}
+
+	__global uint *out = indices + 3 * triOffsets[cell];
+	for(int tet = 0; tet < 6; ++tet)
+	{
+		uint tetIndex = 0;
+		for(int i = 0; i < 4; ++i)
+			tetIndex |= ((insideBits >> g_contourCellTets[tet][i]) & 1) << i;
+
+		for(int i = 0; i < 6 && g_contourTetTris[tetIndex][i] >= 0; ++i)
+		{
+			int edge = g_contourTetTris[tetIndex][i];
+			int c0 = g_contourCellTets[tet][g_contourTetEdges[edge][0]];
+			int c1 = g_contourCellTets[tet][g_contourTetEdges[edge][1]];
+			if(corners[c1] < corners[c0])
+			{
+				int tmp = c0; c0 = c1; c1 = tmp;
+			}
+			int point = corners[c0];
+			uint lowerKinds = (1 << g_contourCellEdgeKinds[c0][c1]) - 1;
+			*out++ = vertexOffsets[point] + popcount(edgeMasks[point] & lowerKinds);
+		}
+	}
+}
@@ -52,15 +52,17 @@ void render_Init()
 
 
 ////////////////////////////////////////////////////////////////////////////////
-Geom::Geom(int numVerts, const float* verts, 
+Geom::Geom(int numVerts, const void* verts, 
 		int numIndices, const unsigned short* indices,
 		int vertStride, int glPrimType, 
-		const std::vector<GeomBindPair>& elements)
+		const std::vector<GeomBindPair>& elements,
+		const std::vector<GeomRange>& ranges)
 	: m_stride(vertStride)
 	, m_glPrimType(glPrimType)
 	, m_glIndexType(GL_UNSIGNED_SHORT)
 	, m_numIndices(numIndices)
 	, m_elements(elements)
+	, m_ranges(ranges)
 {
 	glGenBuffers(2, m_buffer);
 	glBindBuffer(GL_ARRAY_BUFFER, m_buffer[VTX_BUFFER]);
@@ -70,7 +72,7 @@ Geom::Geom(int numVerts, const float* verts,
 	checkGlError("Geom::Geom");
 }
 
-Geom::Geom(int numVerts, const float* verts, 
+Geom::Geom(int numVerts, const void* verts, 
 		int numIndices, const unsigned int* indices,
 		int vertStride, int glPrimType, 
 		const std::vector<GeomBindPair>& elements)
@@ -111,14 +113,47 @@ void Geom::Bind(const ShaderInfo& shader)
 		{
 			glEnableVertexAttribArray(shader.m_attrs[pair.m_attr]);
 			glVertexAttribPointer(shader.m_attrs[pair.m_attr], pair.m_count, 
-					GL_FLOAT, GL_FALSE, m_stride, ((char*)(0) + pair.m_offset));
+					pair.m_type, pair.m_normalized ? GL_TRUE : GL_FALSE, m_stride, ((char*)(0) + pair.m_offset));
 		}
 	}
 }
 
 void Geom::Submit()
 {
-	glDrawElements(m_glPrimType, m_numIndices, m_glIndexType, 0);
+	if(m_ranges.empty())
+	{
+		glDrawElements(m_glPrimType, m_numIndices, m_glIndexType, 0);
+		return;
+	}
+
+	for(const GeomRange& range : m_ranges)
+		AddDraw(range);
+	SubmitDraws();
+}
+
+void Geom::Submit(const std::vector<int>& ranges)
+{
+	for(int index : ranges)
+		AddDraw(m_ranges[index]);
+	SubmitDraws();
+}
+
+void Geom::AddDraw(const GeomRange& range)
+{
+	const int indexSize = m_glIndexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+	m_drawCounts.push_back(range.m_numIndices);
+	m_drawOffsets.push_back((char*)(0) + range.m_firstIndex * indexSize);
+	m_drawBaseVertices.push_back(range.m_baseVertex);
+}
+
+void Geom::SubmitDraws()
+{
+	if(!m_drawCounts.empty())
+		glMultiDrawElementsBaseVertex(m_glPrimType, &m_drawCounts[0], m_glIndexType,
+			&m_drawOffsets[0], m_drawCounts.size(), &m_drawBaseVertices[0]);
+	m_drawCounts.clear();
+	m_drawOffsets.clear();
+	m_drawBaseVertices.clear();
 }
 
 void Geom::Unbind(const ShaderInfo& shader)
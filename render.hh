@@ -64,21 +64,38 @@ void render_drawDebugTexture(GLuint dbgTex, bool splitChannels);
 class GeomBindPair 
 {
 public:
-	GeomBindPair(int attr, int count, int offset) : m_attr(attr), m_count(count), m_offset(offset) {}
+	GeomBindPair(int attr, int count, int offset, int type = GL_FLOAT, bool normalized = false) 
+		: m_attr(attr), m_count(count), m_offset(offset), m_type(type), m_normalized(normalized) {}
 	int m_attr;
 	int m_count;
 	int m_offset;
+	int m_type; // GL_FLOAT, or an integer type the shader reads as float
+	bool m_normalized; // integers map to [0,1], or [-1,1] if signed
+} ;
+
+////////////////////////////////////////////////////////////////////////////////
+// a run of a Geom's indices, offset by baseVertex when drawn
+class GeomRange
+{
+public:
+	GeomRange(int firstIndex, int numIndices, int baseVertex) 
+		: m_firstIndex(firstIndex), m_numIndices(numIndices), m_baseVertex(baseVertex) {}
+	int m_firstIndex;
+	int m_numIndices;
+	int m_baseVertex;
 } ;
 
 ////////////////////////////////////////////////////////////////////////////////
 class Geom 
 {
 public:
-	Geom(int numVerts, const float* verts, 
+	// with ranges, Submit draws each one instead of all the indices at once
+	Geom(int numVerts, const void* verts, 
 		int numIndices, const unsigned short* indices,
 		int vertStride, int glPrimType, 
-		const std::vector<GeomBindPair>& elements);
-	Geom(int numVerts, const float* verts, 
+		const std::vector<GeomBindPair>& elements,
+		const std::vector<GeomRange>& ranges = std::vector<GeomRange>());
+	Geom(int numVerts, const void* verts, 
 		int numIndices, const unsigned int* indices,
 		int vertStride, int glPrimType, 
 		const std::vector<GeomBindPair>& elements);
@@ -90,14 +107,24 @@ public:
 	// rendering many times
 	void Bind(const ShaderInfo& shader);
 	void Submit();
+	// draws just the listed ranges
+	void Submit(const std::vector<int>& ranges);
 	void Unbind(const ShaderInfo& shader);
 private:
+	void AddDraw(const GeomRange& range);
+	void SubmitDraws();
+
 	GLuint m_buffer[2];
 	int m_stride;
 	int m_glPrimType;
 	int m_glIndexType;
 	int m_numIndices;
 	std::vector<GeomBindPair> m_elements;
+	std::vector<GeomRange> m_ranges;
+	// glMultiDrawElementsBaseVertex arguments, kept between submits
+	std::vector<GLsizei> m_drawCounts;
+	std::vector<const GLvoid*> m_drawOffsets;
+	std::vector<GLint> m_drawBaseVertices;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -14,6 +14,11 @@ uniform sampler2D heightMap;
 uniform sampler2D diffuseMap;
 uniform sampler2DShadow shadowMap;
 uniform mat4 shadowMat;
+// packed vertices, see TriSoupVertexFormatType: positions in [0,1] across the
+// mesh's box, and octahedral normals in [0,1]^2
+uniform vec3 posOffset = vec3(0);
+uniform vec3 posScale = vec3(1);
+uniform bool octNormals = false;
 
 const float PI = 3.14159265358979;
 const float invPI = 1.0 / PI;
@@ -27,17 +32,30 @@ out vec2 vCoord1;
 out vec2 vCoord2;
 out vec3 vPos;
 out vec4 vShadowMapCoord;
+
+vec3 DecodeNormal(vec3 n)
+{
+	if(!octNormals)
+		return n;
+	vec2 e = n.xy * 2.0 - 1.0;
+	vec3 r = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	if(r.z < 0.0)
+		r.xy = (1.0 - abs(r.yx)) * vec2(r.x >= 0.0 ? 1.0 : -1.0, r.y >= 0.0 ? 1.0 : -1.0);
+	return normalize(r);
+}
+
 void main()
 {
-	gl_Position = mvp * vec4(pos, 1);
-	vPos = (model * vec4(pos, 1)).xyz;
-	vec3 xfmNormal = normalize((modelIT * vec4(normal, 0)).xyz);
+	vec3 p = posOffset + pos * posScale;
+	gl_Position = mvp * vec4(p, 1);
+	vPos = (model * vec4(p, 1)).xyz;
+	vec3 xfmNormal = normalize((modelIT * vec4(DecodeNormal(normal), 0)).xyz);
 	vNormal = xfmNormal;
-	vToEye = eyePos - pos;
-	vCoord0 = pos.xz * 0.5 + 0.5;
-	vCoord1 = pos.yz * 0.5 + 0.5;
-	vCoord2 = pos.xy * 0.5 + 0.5;
-	vShadowMapCoord = shadowMat * vec4(pos, 1);
+	vToEye = eyePos - p;
+	vCoord0 = p.xz * 0.5 + 0.5;
+	vCoord1 = p.yz * 0.5 + 0.5;
+	vCoord2 = p.xy * 0.5 + 0.5;
+	vShadowMapCoord = shadowMat * vec4(p, 1);
 }
 #endif
 
@@ -1,10 +1,13 @@
 uniform mat4 mvp;
+// packed positions, as in rock.glsl
+uniform vec3 posOffset = vec3(0);
+uniform vec3 posScale = vec3(1);
 
 #ifdef VERTEX_P
 in vec3 pos;
 void main()
 {
-	gl_Position = mvp * vec4(pos, 1);
+	gl_Position = mvp * vec4(posOffset + pos * posScale, 1);
 }
 #endif
 
@@ -1,7 +1,25 @@
 #include "surfcon.hh"
 #include "mesh.hh"
+#include "task.hh"
+#include "common.hh"
+#include "mctables.hh"
+#include <climits>
+#include <cstdint>
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
-static const unsigned int g_edgeTable[16] =
+// number of cell layers per slab when contouring in parallel
+static constexpr int kSlabDepth = 16;
+
+static constexpr unsigned int g_edgeTable[16] =
 {
 	0x00, // 0000
 	0x0D, // 0001
@@ -21,7 +39,7 @@ static const unsigned int g_edgeTable[16] =
 	0x00  // 1111
 };
 
-static const int g_triTable[16][6] =
+static constexpr int g_triTable[16][6] =
 {
 	{ -1, -1, -1, -1, -1, -1 }, // 0000
 	{ 0, 3, 2, -1, -1, -1 },        // 0001
@@ -41,122 +59,1284 @@ static const int g_triTable[16][6] =
 	{ -1, -1, -1, -1, -1, -1 }, // 1111
 };
 
+static inline float InterpParam(float d0, float d1)
+{
+	const float t = d0 / (d0 - d1);
+	return Clamp(t, 0.f, 1.f);
+}
+
 static inline vec3 InterpPoints(const vec3& v0, const vec3& v1, float d0, float d1)
 {
-	float t = d0 / (d0 - d1);
-	t = Clamp(t, 0.f, 1.f);
+	const float t = InterpParam(d0, d1);
 	return (1.f - t) * v0 + t * v1;
 }
 
-static inline unsigned int MakeTableIndex(float (&distances)[4])
+// Central differences of the field at a lattice point, one sided at the border.
+// Inside is below the isolevel, so this points out of the surface.
+static inline vec3 surfcon_Gradient(const float* densityField, 
+	int width, int height, int depth, int x, int y, int z)
 {
-	unsigned int index = 0;
-	index |= distances[0] < 0 ? 1 : 0;
-	index |= distances[1] < 0 ? 2 : 0;
-	index |= distances[2] < 0 ? 4 : 0;
-	index |= distances[3] < 0 ? 8 : 0;
-	return index;
+	const int slicePitch = width * height;
+	const float* center = densityField + x + width * y + slicePitch * z;
+	const int dx0 = x > 0 ? 1 : 0, dx1 = x + 1 < width ? 1 : 0;
+	const int dy0 = y > 0 ? width : 0, dy1 = y + 1 < height ? width : 0;
+	const int dz0 = z > 0 ? slicePitch : 0, dz1 = z + 1 < depth ? slicePitch : 0;
+	return vec3(
+		center[dx1] - center[-dx0],
+		center[dy1] - center[-dy0],
+		center[dz1] - center[-dz0]);
 }
 
-static void surfcon_CreateFaces(TriSoup* result,
-	PointGrid& grid, 
-	const float *samples, const vec3* points);
+static inline vec3 surfcon_NormalFromGradient(const vec3& gradient)
+{
+	const float len = Length(gradient);
+	return len > 0.f ? gradient / len : vec3(0.f, 0.f, 1.f);
+}
 
-std::shared_ptr<TriSoup> surfcon_CreateMeshFromDensityField(
-	float isolevel,
-	const float* densityField, 
-	unsigned int width, unsigned int height, unsigned int depth)
+////////////////////////////////////////////////////////////////////////////////
+// Edge vertex cache
+// Every vertex the tetrahedral split creates lies on one of 7 kinds of lattice
+// edge, so it is identified exactly by the edge's lower corner and kind. Only
+// the two z slices touched by the current layer of cells are kept around.
+static constexpr int kNumEdgeTypes = 7;
+
+// edge kind for a pair of cell corners, indexed [lower corner][upper corner]
+// kinds: +x, +y, +z, (-1,1,0), (1,0,1), (0,-1,1), (1,-1,1)
+static const int g_cellEdgeTypes[8][8] =
 {
-	std::shared_ptr<TriSoup> result = std::make_shared<TriSoup>();
-	TriSoup* mesh = result.get();
-	unsigned int slicePitch = width * height;
-	unsigned int zOffset = 0;
+	{ -1,  0, -1,  1,  2,  4, -1, -1 },
+	{ -1, -1,  1,  3, -1,  2, -1, -1 },
+	{ -1, -1, -1, -1, -1,  5,  2, -1 },
+	{ -1, -1,  0, -1,  5,  6,  4,  2 },
+	{ -1, -1, -1, -1, -1,  0, -1,  1 },
+	{ -1, -1, -1, -1, -1, -1,  1,  3 },
+	{ -1, -1, -1, -1, -1, -1, -1, -1 },
+	{ -1, -1, -1, -1, -1, -1,  0, -1 },
+};
+
+class EdgeVertexCache
+{
+public:
+	EdgeVertexCache(unsigned int slicePitch)
+		: m_slicePitch(slicePitch)
+		, m_verts(2 * kNumEdgeTypes * slicePitch, -1)
+	{}
+
+	int& Get(unsigned int lowerCorner, int edgeType)
+	{
+		const unsigned int z = lowerCorner / m_slicePitch;
+		const unsigned int planeIdx = lowerCorner - z * m_slicePitch;
+		return m_verts[((z & 1) * m_slicePitch + planeIdx) * kNumEdgeTypes + edgeType];
+	}
+
+	// forget slice z so its storage can be reused for slice z + 2
+	void ClearSlice(int z) 
+	{
+		auto first = SliceBegin(z);
+		std::fill(first, first + kNumEdgeTypes * m_slicePitch, -1);
+	}
+
+	void CopySlice(int z, std::vector<int>& out) const
+	{
+		auto first = SliceBegin(z);
+		out.assign(first, first + kNumEdgeTypes * m_slicePitch);
+	}
+
+	// frees the storage once the borders have been copied out, the cache can't be used after
+	void Release() { std::vector<int>().swap(m_verts); }
+private:
+	std::vector<int>::iterator SliceBegin(int z) {
+		return m_verts.begin() + (z & 1) * kNumEdgeTypes * m_slicePitch;
+	}
+	std::vector<int>::const_iterator SliceBegin(int z) const {
+		return m_verts.begin() + (z & 1) * kNumEdgeTypes * m_slicePitch;
+	}
+
+	unsigned int m_slicePitch;
+	std::vector<int> m_verts;
+};
+
+// Vertex index of each cell in the current and previous layer of cells, for
+// the dual methods that place one vertex per cell.
+class CellVertexCache
+{
+public:
+	CellVertexCache(unsigned int width, unsigned int slicePitch)
+		: m_width(width)
+		, m_slicePitch(slicePitch)
+		, m_verts(2 * slicePitch, -1)
+	{}
+
+	int& Get(int x, int y, int z)
+	{
+		return m_verts[(z & 1) * m_slicePitch + y * m_width + x];
+	}
+
+	// forget layer z so its storage can be reused for layer z + 2
+	void ClearSlice(int z)
+	{
+		auto first = m_verts.begin() + (z & 1) * m_slicePitch;
+		std::fill(first, first + m_slicePitch, -1);
+	}
+
+	void CopySlice(int z, std::vector<int>& out) const
+	{
+		auto first = m_verts.begin() + (z & 1) * m_slicePitch;
+		out.assign(first, first + m_slicePitch);
+	}
+
+	void Release() { std::vector<int>().swap(m_verts); }
+private:
+	unsigned int m_width;
+	unsigned int m_slicePitch;
+	std::vector<int> m_verts;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Contouring state for a range of z slices. The serial path uses one of these
+// for the whole field, the parallel path uses one per slab. The edge cache
+// slices at the bottom and top of the slab are kept so neighbouring slabs can
+// be welded by edge. The dual methods keep the cell layers at the bottom and 
+// top instead, and only use the cell cache. The caches are freed once the slab
+// has been contoured, leaving just those border copies.
+struct ContourSlab
+{
+	ContourSlab(unsigned int width, unsigned int slicePitch, int zBegin, int zEnd, bool dual)
+		: m_mesh(std::make_shared<TriSoup>())
+		, m_cache(dual ? 0 : slicePitch)
+		, m_cellCache(width, dual ? slicePitch : 0)
+		, m_bottomVerts()
+		, m_topVerts()
+		, m_zBegin(zBegin)
+		, m_zEnd(zEnd)
+		, m_xBegin(0)
+		, m_xEnd(INT_MAX)
+		, m_yBegin(0)
+		, m_yEnd(INT_MAX)
+		, m_dual(dual)
+		, m_emitFaces(true)
+	{}
+
+	std::shared_ptr<TriSoup> m_mesh;
+	EdgeVertexCache m_cache;
+	CellVertexCache m_cellCache;
+	std::vector<int> m_bottomVerts;
+	std::vector<int> m_topVerts;
+	int m_zBegin;
+	int m_zEnd;
+	int m_xBegin, m_xEnd; // cells in x and y to contour, all of them by default
+	int m_yBegin, m_yEnd;
+	bool m_dual;
+	bool m_emitFaces; // false while placing the dual vertices of the layer below the slab
+};
+
+struct ContourCell
+{
+	float m_samples[8];
+	vec3 m_points[8];
+	unsigned int m_offsets[8];
+	int m_x, m_y, m_z;
+	// the field, for gradients. It holds slices [m_fieldZ, m_fieldZ + m_depth).
+	const float* m_densityField;
+	int m_width, m_height, m_depth;
+	int m_fieldZ;
+};
+
+// lattice offsets of the cell corners, in m_samples order
+static const int g_cellCorners[8][3] = {
+	{ 0, 0, 0 }, { 1, 0, 0 }, { 1, 1, 0 }, { 0, 1, 0 },
+	{ 0, 0, 1 }, { 1, 0, 1 }, { 1, 1, 1 }, { 0, 1, 1 },
+};
+
+static inline vec3 surfcon_CornerGradient(const ContourCell& cell, int corner)
+{
+	return surfcon_Gradient(cell.m_densityField, cell.m_width, cell.m_height, cell.m_depth,
+		cell.m_x + g_cellCorners[corner][0], 
+		cell.m_y + g_cellCorners[corner][1], 
+		cell.m_z - cell.m_fieldZ + g_cellCorners[corner][2]);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// DensityPyramid
+bool DensityPyramid::Range::Straddles(float isolevel) const
+{
+	// same inside test as the cell classification: sample - isolevel < 0
+	return m_min - isolevel < 0 && !(m_max - isolevel < 0);
+}
+
+DensityPyramid::DensityPyramid(const float* densityField, 
+	unsigned int width, unsigned int height, unsigned int depth,
+	int flags)
+	: m_bricksX((width - 1 + kBrickDim - 1) / kBrickDim)
+	, m_bricksY((height - 1 + kBrickDim - 1) / kBrickDim)
+	, m_bricksZ((depth - 1 + kBrickDim - 1) / kBrickDim)
+	, m_blocksX((m_bricksX + kBlockDim - 1) / kBlockDim)
+	, m_blocksY((m_bricksY + kBlockDim - 1) / kBlockDim)
+	, m_blocksZ((m_bricksZ + kBlockDim - 1) / kBlockDim)
+	, m_bricks(m_bricksX * m_bricksY * m_bricksZ)
+	, m_blocks(m_blocksX * m_blocksY * m_blocksZ, Range{FLT_MAX, -FLT_MAX})
+{
+	auto buildBrickLayer = [&](int bz) {
+		for(int by = 0; by < m_bricksY; ++by)
+			for(int bx = 0; bx < m_bricksX; ++bx)
+				ComputeBrick(densityField, width, height, depth, bx, by, bz);
+	};
+
+	if(flags & SURFCON_Parallel)
+		task_ParallelFor(m_bricksZ, buildBrickLayer);
+	else
+		for(int bz = 0; bz < m_bricksZ; ++bz)
+			buildBrickLayer(bz);
+
+	for(int bz = 0; bz < m_bricksZ; ++bz)
+	{
+		for(int by = 0; by < m_bricksY; ++by)
+		{
+			for(int bx = 0; bx < m_bricksX; ++bx)
+			{
+				const Range& brick = m_bricks[bx + m_bricksX * (by + m_bricksY * bz)];
+				Range& block = m_blocks[bx / kBlockDim + 
+					m_blocksX * (by / kBlockDim + m_blocksY * (bz / kBlockDim))];
+				block.m_min = Min(block.m_min, brick.m_min);
+				block.m_max = Max(block.m_max, brick.m_max);
+			}
+		}
+	}
+}
+
+DensityPyramid::DensityPyramid(unsigned int width, unsigned int height, unsigned int depth)
+	: m_bricksX((width - 1 + kBrickDim - 1) / kBrickDim)
+	, m_bricksY((height - 1 + kBrickDim - 1) / kBrickDim)
+	, m_bricksZ((depth - 1 + kBrickDim - 1) / kBrickDim)
+	, m_blocksX((m_bricksX + kBlockDim - 1) / kBlockDim)
+	, m_blocksY((m_bricksY + kBlockDim - 1) / kBlockDim)
+	, m_blocksZ((m_bricksZ + kBlockDim - 1) / kBlockDim)
+	, m_bricks(m_bricksX * m_bricksY * m_bricksZ, Range{FLT_MAX, -FLT_MAX})
+	, m_blocks(m_blocksX * m_blocksY * m_blocksZ, Range{FLT_MAX, -FLT_MAX})
+{
+}
+
+void DensityPyramid::SetBrickRange(int bx, int by, int bz, float lo, float hi)
+{
+	m_bricks[bx + m_bricksX * (by + m_bricksY * bz)] = Range{lo, hi};
+	Range& block = m_blocks[bx / kBlockDim + 
+		m_blocksX * (by / kBlockDim + m_blocksY * (bz / kBlockDim))];
+	block.m_min = Min(block.m_min, lo);
+	block.m_max = Max(block.m_max, hi);
+}
+
+void DensityPyramid::ComputeBrick(const float* densityField, 
+	unsigned int width, unsigned int height, unsigned int depth,
+	int bx, int by, int bz)
+{
+	const unsigned int slicePitch = width * height;
+	// a brick's cells read the samples on its far faces too, so ranges overlap by one sample
+	const unsigned int xBegin = bx * kBrickDim;
+	const unsigned int xEnd = Min(xBegin + kBrickDim + 1, width);
+	const unsigned int yBegin = by * kBrickDim;
+	const unsigned int yEnd = Min(yBegin + kBrickDim + 1, height);
+	const unsigned int zBegin = bz * kBrickDim;
+	const unsigned int zEnd = Min(zBegin + kBrickDim + 1, depth);
+	float lo = FLT_MAX, hi = -FLT_MAX;
+	for(unsigned int z = zBegin; z < zEnd; ++z)
+	{
+		for(unsigned int y = yBegin; y < yEnd; ++y)
+		{
+			const float* row = densityField + z * slicePitch + y * width;
+			for(unsigned int x = xBegin; x < xEnd; ++x)
+			{
+				lo = Min(lo, row[x]);
+				hi = Max(hi, row[x]);
+			}
+		}
+	}
+	m_bricks[bx + m_bricksX * (by + m_bricksY * bz)] = Range{lo, hi};
+}
+
+void DensityPyramid::Update(const float* densityField, 
+	unsigned int width, unsigned int height, unsigned int depth,
+	const SurfconBox& bricks)
+{
+	for(int bz = bricks.m_min[2]; bz < bricks.m_max[2]; ++bz)
+		for(int by = bricks.m_min[1]; by < bricks.m_max[1]; ++by)
+			for(int bx = bricks.m_min[0]; bx < bricks.m_max[0]; ++bx)
+				ComputeBrick(densityField, width, height, depth, bx, by, bz);
+
+	// blocks only ever grow from their bricks, so rebuild the touched ones whole
+	const int cxEnd = (bricks.m_max[0] + kBlockDim - 1) / kBlockDim;
+	const int cyEnd = (bricks.m_max[1] + kBlockDim - 1) / kBlockDim;
+	const int czEnd = (bricks.m_max[2] + kBlockDim - 1) / kBlockDim;
+	for(int cz = bricks.m_min[2] / kBlockDim; cz < czEnd; ++cz)
+	for(int cy = bricks.m_min[1] / kBlockDim; cy < cyEnd; ++cy)
+	for(int cx = bricks.m_min[0] / kBlockDim; cx < cxEnd; ++cx)
+	{
+		Range block{FLT_MAX, -FLT_MAX};
+		const int bxEnd = Min((cx + 1) * kBlockDim, m_bricksX);
+		const int byEnd = Min((cy + 1) * kBlockDim, m_bricksY);
+		const int bzEnd = Min((cz + 1) * kBlockDim, m_bricksZ);
+		for(int bz = cz * kBlockDim; bz < bzEnd; ++bz)
+			for(int by = cy * kBlockDim; by < byEnd; ++by)
+				for(int bx = cx * kBlockDim; bx < bxEnd; ++bx)
+				{
+					const Range& brick = m_bricks[bx + m_bricksX * (by + m_bricksY * bz)];
+					block.m_min = Min(block.m_min, brick.m_min);
+					block.m_max = Max(block.m_max, brick.m_max);
+				}
+		m_blocks[cx + m_blocksX * (cy + m_blocksY * cz)] = block;
+	}
+}
+
+bool DensityPyramid::BrickStraddles(int bx, int by, int bz, float isolevel) const
+{
+	return m_bricks[bx + m_bricksX * (by + m_bricksY * bz)].Straddles(isolevel);
+}
+
+bool DensityPyramid::BlockStraddles(int cx, int cy, int cz, float isolevel) const
+{
+	return m_blocks[cx + m_blocksX * (cy + m_blocksY * cz)].Straddles(isolevel);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// SparseDensityField
+SparseDensityField::SparseDensityField(unsigned int width, unsigned int height, unsigned int depth,
+	float isolevel, float bandWidth)
+	: m_width(width)
+	, m_height(height)
+	, m_depth(depth)
+	, m_isolevel(isolevel)
+	, m_bandWidth(bandWidth)
+	, m_pyramid(width, height, depth)
+	, m_bricksX(m_pyramid.NumBricksX())
+	, m_bricksY(m_pyramid.NumBricksY())
+	, m_bricksZ(m_pyramid.NumBricksZ())
+	, m_slots(m_bricksX * m_bricksY * m_bricksZ, kSlotOutside)
+	, m_values(m_slots.size(), FLT_MAX)
+	, m_pages()
+	, m_numDenseBricks(0)
+{
+}
+
+SparseDensityField::SparseDensityField(const float* densityField, 
+	unsigned int width, unsigned int height, unsigned int depth,
+	float isolevel, float bandWidth)
+	: SparseDensityField(width, height, depth, isolevel, bandWidth)
+{
+	for(int bz = 0; bz < m_bricksZ; ++bz)
+		SetBrickLayer(bz, densityField + size_t(bz) * kBrickDim * width * height);
+}
+
+float* SparseDensityField::AllocBrick(int brick)
+{
+	const int slot = m_numDenseBricks++;
+	if(slot % kBricksPerPage == 0)
+		m_pages.push_back(std::vector<float>(kBricksPerPage * kBrickSize));
+	m_slots[brick] = slot;
+	return &m_pages[slot / kBricksPerPage][(slot % kBricksPerPage) * kBrickSize];
+}
+
+const float* SparseDensityField::BrickSamples(int slot) const
+{
+	return &m_pages[slot / kBricksPerPage][(slot % kBricksPerPage) * kBrickSize];
+}
+
+void SparseDensityField::SetBrickLayer(int bz, const float* slices)
+{
+	const size_t slicePitch = size_t(m_width) * m_height;
+	const unsigned int zBegin = bz * kBrickDim;
+	const unsigned int zEnd = Min(zBegin + kBrickSamples, m_depth);
+	for(int by = 0; by < m_bricksY; ++by)
+	{
+		const unsigned int yBegin = by * kBrickDim;
+		const unsigned int yEnd = Min(yBegin + kBrickSamples, m_height);
+		for(int bx = 0; bx < m_bricksX; ++bx)
+		{
+			const unsigned int xBegin = bx * kBrickDim;
+			const unsigned int xEnd = Min(xBegin + kBrickSamples, m_width);
+			float lo = FLT_MAX, hi = -FLT_MAX;
+			for(unsigned int z = zBegin; z < zEnd; ++z)
+			{
+				for(unsigned int y = yBegin; y < yEnd; ++y)
+				{
+					const float* row = slices + (z - zBegin) * slicePitch + y * m_width;
+					for(unsigned int x = xBegin; x < xEnd; ++x)
+					{
+						lo = Min(lo, row[x]);
+						hi = Max(hi, row[x]);
+					}
+				}
+			}
+			m_pyramid.SetBrickRange(bx, by, bz, lo, hi);
+
+			// uniform for every isolevel in the band, by the same test as the cells
+			const int brick = bx + m_bricksX * (by + m_bricksY * bz);
+			if(hi - (m_isolevel - m_bandWidth) < 0)
+			{
+				m_slots[brick] = kSlotInside;
+				m_values[brick] = hi;
+				continue;
+			}
+			if(!(lo - (m_isolevel + m_bandWidth) < 0))
+			{
+				m_slots[brick] = kSlotOutside;
+				m_values[brick] = lo;
+				continue;
+			}
+
+			float* samples = AllocBrick(brick);
+			for(unsigned int z = zBegin; z < zEnd; ++z)
+			{
+				for(unsigned int y = yBegin; y < yEnd; ++y)
+				{
+					const float* row = slices + (z - zBegin) * slicePitch + y * m_width;
+					std::copy(row + xBegin, row + xEnd, 
+						samples + kBrickSamples * ((y - yBegin) + kBrickSamples * (z - zBegin)));
+				}
+			}
+		}
+	}
+}
+
+void SparseDensityField::ExtractSlices(unsigned int zBegin, unsigned int zEnd, float* out) const
+{
+	const size_t slicePitch = size_t(m_width) * m_height;
+	// bricks read the samples on their far faces, so the brick below zBegin may hold it
+	const int bzBegin = Max(0, int(zBegin) - 1) / kBrickDim;
+	const int bzEnd = Min<int>(m_bricksZ, (zEnd - 1) / kBrickDim + 1);
+
+	// uniform bricks first, so dense bricks' samples win on the faces they share
+	for(int pass = 0; pass < 2; ++pass)
+	{
+		const bool dense = pass == 1;
+		for(int bz = bzBegin; bz < bzEnd; ++bz)
+		for(int by = 0; by < m_bricksY; ++by)
+		for(int bx = 0; bx < m_bricksX; ++bx)
+		{
+			const int brick = bx + m_bricksX * (by + m_bricksY * bz);
+			const int slot = m_slots[brick];
+			if((slot >= 0) != dense)
+				continue;
+
+			const unsigned int xBegin = bx * kBrickDim;
+			const unsigned int xEnd = Min(xBegin + kBrickSamples, m_width);
+			const unsigned int yBegin = by * kBrickDim;
+			const unsigned int yEnd = Min(yBegin + kBrickSamples, m_height);
+			const unsigned int brickZ = bz * kBrickDim;
+			const unsigned int z0 = Max(zBegin, brickZ);
+			const unsigned int z1 = Min(Min(zEnd, brickZ + kBrickSamples), m_depth);
+			const float* samples = dense ? BrickSamples(slot) : nullptr;
+			for(unsigned int z = z0; z < z1; ++z)
+			{
+				for(unsigned int y = yBegin; y < yEnd; ++y)
+				{
+					float* row = out + (z - zBegin) * slicePitch + y * m_width;
+					if(dense)
+					{
+						const float* src = samples + 
+							kBrickSamples * ((y - yBegin) + kBrickSamples * (z - brickZ));
+						std::copy(src, src + (xEnd - xBegin), row + xBegin);
+					}
+					else
+						std::fill(row + xBegin, row + xEnd, m_values[brick]);
+				}
+			}
+		}
+	}
+}
+
+bool SparseDensityField::CoversIsolevel(float isolevel) const
+{
+	return isolevel >= m_isolevel - m_bandWidth && isolevel <= m_isolevel + m_bandWidth;
+}
+
+size_t SparseDensityField::GetMemoryUsed() const
+{
+	return m_pages.size() * kBricksPerPage * kBrickSize * sizeof(float) +
+		m_slots.size() * (sizeof(int) + sizeof(float));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Sets a bit per cell of the cell row (by, bz) that lies in a brick straddling
+// the isolevel, and the range of sample columns those cells read. Returns false
+// if there are none.
+static bool surfcon_FindActiveCells(const DensityPyramid& pyramid, 
+	int by, int bz, float isolevel, unsigned int width,
+	uint32_t* activeBits, unsigned int& firstColumn, unsigned int& endColumn)
+{
+	constexpr int kBrickDim = DensityPyramid::kBrickDim;
+	constexpr int kBlockDim = DensityPyramid::kBlockDim;
+	static_assert(32 % kBrickDim == 0, "bricks must pack evenly into 32 bit words");
+
+	std::fill(activeBits, activeBits + (width + 31) / 32, 0);
+	int firstBrick = -1, lastBrick = -1;
+	for(int bx = 0, c = pyramid.NumBricksX(); bx < c; ++bx)
+	{
+		if(bx % kBlockDim == 0 && 
+			!pyramid.BlockStraddles(bx / kBlockDim, by / kBlockDim, bz / kBlockDim, isolevel))
+		{
+			bx += kBlockDim - 1;
+			continue;
+		}
+
+		if(pyramid.BrickStraddles(bx, by, bz, isolevel))
+		{
+			const unsigned int cell = bx * kBrickDim;
+			activeBits[cell >> 5] |= ((1u << kBrickDim) - 1) << (cell & 31);
+			if(firstBrick < 0) firstBrick = bx;
+			lastBrick = bx;
+		}
+	}
+
+	if(firstBrick < 0)
+		return false;
+	firstColumn = firstBrick * kBrickDim;
+	endColumn = Min<unsigned int>((lastBrick + 1) * kBrickDim + 1, width);
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Row classification
+// Most cells are entirely inside or outside the surface. For a row of cells,
+// the four sample rows bounding it are tested against the isolevel a vector at
+// a time, producing per-column bits for "any corner inside" and "all corners
+// inside". A cell spans two columns, so it is mixed if either column has an
+// inside corner and not both columns are fully inside.
+static inline uint32_t surfcon_InsideMask4(const float* row, unsigned int x, float isolevel)
+{
+	uint32_t mask = 0;
+	for(int i = 0; i < 4; ++i)
+		mask |= (row[x + i] - isolevel < 0 ? 1 : 0) << i;
+	return mask;
+}
+
+// Only columns [first, count) are classified; first must be a multiple of 8.
+static void surfcon_ClassifyColumns(const float* const (&rows)[4], 
+	unsigned int first, unsigned int count, unsigned int width,
+	float isolevel, uint32_t* anyBits, uint32_t* allBits)
+{
+	ASSERT((first & 7) == 0);
+	const unsigned int numWords = (width + 31) / 32;
+	std::fill(anyBits, anyBits + numWords, 0);
+	std::fill(allBits, allBits + numWords, 0);
+
+	unsigned int x = first;
+#if defined(__AVX__)
+	const __m256 iso8 = _mm256_set1_ps(isolevel);
+	const __m256 zero8 = _mm256_setzero_ps();
+	for(; x + 8 <= count; x += 8)
+	{
+		// compare the difference against zero like the tetrahedron tables do,
+		// so both agree even when the difference flushes to zero
+		__m256 in[4];
+		for(int i = 0; i < 4; ++i)
+			in[i] = _mm256_cmp_ps(_mm256_sub_ps(_mm256_loadu_ps(rows[i] + x), iso8), zero8, _CMP_LT_OQ);
+		const uint32_t any = _mm256_movemask_ps(
+			_mm256_or_ps(_mm256_or_ps(in[0], in[1]), _mm256_or_ps(in[2], in[3])));
+		const uint32_t all = _mm256_movemask_ps(
+			_mm256_and_ps(_mm256_and_ps(in[0], in[1]), _mm256_and_ps(in[2], in[3])));
+		anyBits[x >> 5] |= any << (x & 31);
+		allBits[x >> 5] |= all << (x & 31);
+	}
+#elif defined(__SSE2__)
+	const __m128 iso4 = _mm_set1_ps(isolevel);
+	const __m128 zero4 = _mm_setzero_ps();
+	for(; x + 4 <= count; x += 4)
+	{
+		__m128 in[4];
+		for(int i = 0; i < 4; ++i)
+			in[i] = _mm_cmplt_ps(_mm_sub_ps(_mm_loadu_ps(rows[i] + x), iso4), zero4);
+		const uint32_t any = _mm_movemask_ps(
+			_mm_or_ps(_mm_or_ps(in[0], in[1]), _mm_or_ps(in[2], in[3])));
+		const uint32_t all = _mm_movemask_ps(
+			_mm_and_ps(_mm_and_ps(in[0], in[1]), _mm_and_ps(in[2], in[3])));
+		anyBits[x >> 5] |= any << (x & 31);
+		allBits[x >> 5] |= all << (x & 31);
+	}
+#else
+	for(; x + 4 <= count; x += 4)
+	{
+		const uint32_t m0 = surfcon_InsideMask4(rows[0], x, isolevel);
+		const uint32_t m1 = surfcon_InsideMask4(rows[1], x, isolevel);
+		const uint32_t m2 = surfcon_InsideMask4(rows[2], x, isolevel);
+		const uint32_t m3 = surfcon_InsideMask4(rows[3], x, isolevel);
+		anyBits[x >> 5] |= (m0 | m1 | m2 | m3) << (x & 31);
+		allBits[x >> 5] |= (m0 & m1 & m2 & m3) << (x & 31);
+	}
+#endif
+	for(; x < count; ++x)
+	{
+		uint32_t any = 0, all = 1;
+		for(int i = 0; i < 4; ++i)
+		{
+			const uint32_t in = rows[i][x] - isolevel < 0 ? 1 : 0;
+			any |= in;
+			all &= in;
+		}
+		anyBits[x >> 5] |= any << (x & 31);
+		allBits[x >> 5] |= all << (x & 31);
+	}
+}
+
+// Turns column bits into a bit per cell (column x and x + 1) that is set when
+// the cell straddles the isolevel. anyBits and allBits are overwritten.
+static void surfcon_FindMixedCells(unsigned int numCells, uint32_t* anyBits, uint32_t* allBits)
+{
+	const unsigned int numWords = (numCells + 1 + 31) / 32;
+	for(unsigned int w = 0; w < numWords; ++w)
+	{
+		const uint32_t anyNext = w + 1 < numWords ? anyBits[w + 1] : 0;
+		const uint32_t allNext = w + 1 < numWords ? allBits[w + 1] : 0;
+		const uint32_t any = anyBits[w] | (anyBits[w] >> 1) | (anyNext << 31);
+		const uint32_t all = allBits[w] & ((allBits[w] >> 1) | (allNext << 31));
+		anyBits[w] = any & ~all;
+	}
+
+	// the last column has no cell of its own
+	const unsigned int lastBits = numCells & 31;
+	if(lastBits)
+		anyBits[numCells >> 5] &= (1u << lastBits) - 1;
+	if(numWords > (numCells + 31) / 32)
+		anyBits[numWords - 1] = 0;
+}
+
+typedef void (*CreateCellTrisFunc)(ContourSlab* slab, const ContourCell& cell);
+static void surfcon_CreateFaces(ContourSlab* slab, const ContourCell& cell);
+static void surfcon_CreateCubeTris(ContourSlab* slab, const ContourCell& cell);
+static void surfcon_CreateDualTris(ContourSlab* slab, const ContourCell& cell);
+
+// Contours one set of slices for several isolevels at once, slabs[i] getting
+// the surface at isolevels[i]. Every slab must cover the same cells. Each row
+// is classified against every isolevel while it's in cache, and each mixed 
+// cell's samples and corners are gathered once and handed to every level it 
+// straddles. pyramid may be null, in which case every brick is treated as active.
+// densityField holds fieldDepth slices of the field starting at slice fieldZ,
+// which must cover the slices the slabs' cells and their gradients read.
+static void surfcon_ContourSlabs(ContourSlab* const* slabs, 
+	const float* isolevels, int numLevels,
+	const DensityPyramid* pyramid,
+	CreateCellTrisFunc createCellTris,
+	const float* densityField,
+	unsigned int width, unsigned int height, unsigned int depth,
+	unsigned int fieldZ, unsigned int fieldDepth)
+{
+	const ContourSlab* first = slabs[0];
+	for(int level = 1; level < numLevels; ++level)
+	{
+		ASSERT(slabs[level]->m_zBegin == first->m_zBegin && slabs[level]->m_zEnd == first->m_zEnd);
+		ASSERT(slabs[level]->m_xBegin == first->m_xBegin && slabs[level]->m_xEnd == first->m_xEnd);
+		ASSERT(slabs[level]->m_yBegin == first->m_yBegin && slabs[level]->m_yEnd == first->m_yEnd);
+	}
+	// the edge cache tells slices apart by the parity of their offsets
+	ASSERT((fieldZ & 1) == 0);
+
+	const unsigned int slicePitch = width * height;
 	const float smallestSide = Min(Min(width,height),depth);
 	const float inc = 2.0 / smallestSide;
 	const vec3 sideScale = vec3(width,height,depth) / smallestSide;
-	PointGrid grid(AABB(-sideScale, sideScale), 1.0f/64);
 	const vec3 startPt = -sideScale;
-	for(int z = 0, zMax = depth - 1; z < zMax; ++z)
+	const unsigned int numWords = (width + 31) / 32;
+	// per level bit rows, level i at [i * numWords, (i + 1) * numWords)
+	std::vector<uint32_t> mixedBits(numLevels * numWords);
+	std::vector<uint32_t> allBits(numWords);
+	std::vector<uint32_t> activeBits(numLevels * numWords, ~0u);
+	std::vector<uint32_t> anyMixedBits(numWords);
+	std::vector<unsigned int> firstColumn(numLevels, 0);
+	std::vector<unsigned int> endColumn(numLevels, pyramid ? 0 : width);
+	std::vector<bool> rowActive(numLevels, !pyramid);
+	constexpr int kBrickDim = DensityPyramid::kBrickDim;
+	ContourCell cell;
+	cell.m_densityField = densityField;
+	cell.m_width = width;
+	cell.m_height = height;
+	cell.m_depth = fieldDepth;
+	cell.m_fieldZ = fieldZ;
+	float samples[8];
+
+	const bool dual = first->m_dual;
+	const int zBegin = first->m_zBegin, zEnd = first->m_zEnd;
+	const int xBegin = first->m_xBegin, xEnd = Min<int>(first->m_xEnd, width - 1);
+	const int yBegin = first->m_yBegin, yEnd = Min<int>(first->m_yEnd, height - 1);
+	std::vector<uint32_t> rangeBits(numWords, 0);
+	for(int x = xBegin; x < xEnd; ++x)
+		rangeBits[x >> 5] |= 1u << (x & 31);
+	// dual faces join each cell to the cells below it, so a dual slab also 
+	// places the vertices of the top cell layer of the slab below, without 
+	// connecting them. Stitching welds the two copies.
+	const int zFirst = dual ? Max(0, zBegin - 1) : zBegin;
+	for(int z = zFirst; z < zEnd; ++z)
+	{
+		if(dual)
+		{
+			for(int level = 0; level < numLevels; ++level)
+			{
+				slabs[level]->m_cellCache.ClearSlice(z);
+				slabs[level]->m_emitFaces = z >= zBegin;
+			}
+		}
+
+		const unsigned int zOffset = (z - fieldZ) * slicePitch;
+		unsigned int yOffset = yBegin * width;
+		for(int y = yBegin; y < yEnd; ++y, yOffset += width)
+		{
+			bool anyRowActive = false;
+			for(int level = 0; level < numLevels; ++level)
+			{
+				if(pyramid && (y == yBegin || y % kBrickDim == 0))
+					rowActive[level] = surfcon_FindActiveCells(*pyramid, y / kBrickDim, z / kBrickDim, 
+						isolevels[level], width, &activeBits[level * numWords], 
+						firstColumn[level], endColumn[level]);
+				anyRowActive |= rowActive[level];
+			}
+			if(!anyRowActive)
+				continue;
+
+			const float* row = densityField + yOffset + zOffset;
+			const float* const rows[4] = { 
+				row, row + width, row + slicePitch, row + slicePitch + width };
+			std::fill(anyMixedBits.begin(), anyMixedBits.end(), 0);
+			for(int level = 0; level < numLevels; ++level)
+			{
+				uint32_t* levelMixed = &mixedBits[level * numWords];
+				if(!rowActive[level])
+				{
+					std::fill(levelMixed, levelMixed + numWords, 0);
+					continue;
+				}
+				surfcon_ClassifyColumns(rows, firstColumn[level], endColumn[level], width, 
+					isolevels[level], levelMixed, &allBits[0]);
+				surfcon_FindMixedCells(width - 1, levelMixed, &allBits[0]);
+				const uint32_t* levelActive = &activeBits[level * numWords];
+				for(unsigned int w = 0; w < numWords; ++w)
+				{
+					levelMixed[w] &= levelActive[w] & rangeBits[w];
+					anyMixedBits[w] |= levelMixed[w];
+				}
+			}
+
+			for(unsigned int w = 0; w < numWords; ++w)
+			{
+				for(uint32_t bits = anyMixedBits[w]; bits; bits &= bits - 1)
+				{
+					const int bit = __builtin_ctz(bits);
+					const int x = (w << 5) + bit;
+					const unsigned int off = x + yOffset + zOffset;
+					const unsigned int off2 = off + slicePitch;
+					cell.m_x = x;
+					cell.m_y = y;
+					cell.m_z = z;
+					unsigned int* offsets = cell.m_offsets;
+					offsets[0] = off;
+					offsets[1] = off + 1;			// + (1,0,0)
+					offsets[2] = off + 1 + width; 	// + (1,1,0)
+					offsets[3] = off + width;		// + (0,1,0)
+					offsets[4] = off2;				// + (0,0,1)
+					offsets[5] = off2 + 1;			// + (1,0,1)
+					offsets[6] = off2 + 1 + width;	// + (1,1,1)
+					offsets[7] = off2 + width;		// + (0,1,1)
+
+					// corners are computed from their lattice coordinates so the
+					// same corner has the same position in every cell that shares it.
+					vec3* points = cell.m_points;
+					points[0] = startPt + inc * vec3(x,y,z);
+					points[1] = startPt + inc * vec3(x+1,y,z);
+					points[2] = startPt + inc * vec3(x+1,y+1,z);
+					points[3] = startPt + inc * vec3(x,y+1,z);
+					points[4] = startPt + inc * vec3(x,y,z+1);
+					points[5] = startPt + inc * vec3(x+1,y,z+1);
+					points[6] = startPt + inc * vec3(x+1,y+1,z+1);
+					points[7] = startPt + inc * vec3(x,y+1,z+1);
+
+					for(int i = 0; i < 8; ++i) 
+						samples[i] = densityField[offsets[i]];
+
+					for(int level = 0; level < numLevels; ++level)
+					{
+						if(!(mixedBits[level * numWords + w] & (1u << bit)))
+							continue;
+						for(int i = 0; i < 8; ++i) 
+							cell.m_samples[i] = samples[i] - isolevels[level];
+						createCellTris(slabs[level], cell);
+					}
+				}
+			}
+		}
+
+		for(int level = 0; level < numLevels; ++level)
+		{
+			ContourSlab* slab = slabs[level];
+			if(dual)
+			{
+				if(z < zBegin)
+					slab->m_cellCache.CopySlice(z, slab->m_bottomVerts);
+				continue;
+			}
+
+			if(z == zBegin)
+				slab->m_cache.CopySlice(z, slab->m_bottomVerts);
+			slab->m_cache.ClearSlice(z);
+		}
+	}
+
+	for(int level = 0; level < numLevels; ++level)
 	{
-		unsigned int yOffset = 0;
-		for(int y = 0, yMax = depth - 1; y < yMax; ++y)
+		ContourSlab* slab = slabs[level];
+		if(dual)
+			slab->m_cellCache.CopySlice(zEnd - 1, slab->m_topVerts);
+		else
+			slab->m_cache.CopySlice(zEnd, slab->m_topVerts);
+		slab->m_cache.Release();
+		slab->m_cellCache.Release();
+	}
+}
+
+static void surfcon_ContourSlab(ContourSlab* slab, const DensityPyramid* pyramid,
+	CreateCellTrisFunc createCellTris,
+	float isolevel, const float* densityField,
+	unsigned int width, unsigned int height, unsigned int depth)
+{
+	surfcon_ContourSlabs(&slab, &isolevel, 1, pyramid, createCellTris,
+		densityField, width, height, depth, 0, depth);
+}
+
+// Appends a slab's mesh to mesh. Vertices on the plane between two slabs (or
+// in the cell layer below the boundary, for the dual methods) were created 
+// once by each, so the upper slab's copies are dropped and its faces are 
+// pointed at the lower slab's vertices. prev is the slab appended before this
+// one, or null. Only the top border is needed after this, so the bottom one is freed.
+static void surfcon_AppendSlab(TriSoup* mesh, ContourSlab* slab, const ContourSlab* prev)
+{
+	const TriSoup* slabMesh = slab->m_mesh.get();
+	std::vector<int> remap(slabMesh->NumVertices(), -1);
+
+	if(prev)
+	{
+		// only edges or cells in the shared layer can be set in both
+		for(int i = 0, c = slab->m_bottomVerts.size(); i < c; ++i)
 		{
-			for(int x = 0, xMax = depth - 1; x < xMax; ++x)
+			const int vert = slab->m_bottomVerts[i];
+			if(vert >= 0 && prev->m_topVerts[i] >= 0)
+				remap[vert] = prev->m_topVerts[i];
+		}
+	}
+	std::vector<int>().swap(slab->m_bottomVerts);
+
+	for(int i = 0, c = slabMesh->NumVertices(); i < c; ++i)
+	{
+		if(remap[i] < 0)
+			remap[i] = mesh->AddVertex(slabMesh->GetVertexPos(i), slabMesh->GetVertexNormal(i));
+	}
+
+	for(int i = 0, c = slabMesh->NumFaces(); i < c; ++i)
+	{
+		int indices[3];
+		slabMesh->GetFace(i, indices);
+		mesh->AddFace(remap[indices[0]], remap[indices[1]], remap[indices[2]]);
+	}
+
+	// the next slab welds against this slab's top plane, in the merged mesh's indices
+	for(int& vert: slab->m_topVerts)
+		if(vert >= 0) vert = remap[vert];
+}
+
+static CreateCellTrisFunc surfcon_GetCreateCellTrisFunc(int flags)
+{
+	if(flags & SURFCON_SurfaceNets)
+		return surfcon_CreateDualTris;
+	else if(flags & SURFCON_MarchingCubes)
+		return surfcon_CreateCubeTris;
+	return surfcon_CreateFaces;
+}
+
+std::shared_ptr<TriSoup> surfcon_CreateMeshFromDensityField(
+	float isolevel,
+	const float* densityField, 
+	unsigned int width, unsigned int height, unsigned int depth,
+	int flags,
+	const DensityPyramid* pyramid)
+{
+	return surfcon_CreateMeshesFromDensityField(std::vector<float>(1, isolevel),
+		densityField, width, height, depth, flags, pyramid)[0];
+}
+
+std::vector<std::shared_ptr<TriSoup>> surfcon_CreateMeshesFromDensityField(
+	const std::vector<float>& isolevels,
+	const float* densityField, 
+	unsigned int width, unsigned int height, unsigned int depth,
+	int flags,
+	const DensityPyramid* pyramid)
+{
+	const unsigned int slicePitch = width * height;
+	const int numCellsZ = depth - 1;
+	const int numLevels = isolevels.size();
+	std::vector<std::shared_ptr<TriSoup>> result;
+	if(numLevels == 0)
+		return result;
+
+	std::shared_ptr<DensityPyramid> localPyramid;
+	if(!pyramid)
+	{
+		localPyramid = std::make_shared<DensityPyramid>(densityField, width, height, depth, flags);
+		pyramid = localPyramid.get();
+	}
+
+	// Slabs are contoured a batch at a time, each task making its own slabs, 
+	// and appended as soon as the batch is done. Only the batch's caches and 
+	// the top border of the last slab appended are alive at once.
+	int numSlabs = 1, batchSize = 1;
+	if(flags & SURFCON_Parallel)
+	{
+		numSlabs = Max(1, (numCellsZ + kSlabDepth - 1) / kSlabDepth);
+		batchSize = Max<int>(1, std::thread::hardware_concurrency());
+	}
+
+	const bool dual = (flags & SURFCON_SurfaceNets) != 0;
+	const CreateCellTrisFunc createCellTris = surfcon_GetCreateCellTrisFunc(flags);
+	result.resize(numLevels);
+	if(numSlabs > 1)
+		for(auto& mesh: result)
+			mesh = std::make_shared<TriSoup>();
+	std::vector<std::shared_ptr<ContourSlab>> prev(numLevels);
+	// slab i of the batch for level l is at batch[l * batchCount + i]
+	std::vector<std::shared_ptr<ContourSlab>> batch;
+	for(int batchBegin = 0; batchBegin < numSlabs; batchBegin += batchSize)
+	{
+		const int batchCount = Min(batchSize, numSlabs - batchBegin);
+		batch.assign(numLevels * batchCount, nullptr);
+		task_ParallelFor(batchCount, [&](int i) {
+			const int zBegin = (numCellsZ * (batchBegin + i)) / numSlabs;
+			const int zEnd = (numCellsZ * (batchBegin + i + 1)) / numSlabs;
+			std::vector<ContourSlab*> levelSlabs(numLevels);
+			for(int level = 0; level < numLevels; ++level)
 			{
-				const unsigned int off = x + yOffset + zOffset;
-				const unsigned int off2 = off + slicePitch;
-				const unsigned int offsets[8] = {
-					off,
-					off + 1,			// + (1,0,0)
-					off + 1 + width, 	// + (1,1,0)
-					off + width,		// + (0,1,0)
-					off2,				// + (0,0,1)
-					off2 + 1,			// + (1,0,1)
-					off2 + 1 + width,	// + (1,1,1)
-					off2 + width,		// + (0,1,1)
-				};
-
-				const vec3 pt = startPt + inc * vec3(x,y,z);
-				const vec3 points[8] = {
-					pt,
-					pt + vec3(inc,0,0),
-					pt + vec3(inc,inc,0),
-					pt + vec3(0,inc,0),
-					pt + vec3(0,0,inc),
-					pt + vec3(inc,0,inc),
-					pt + vec3(inc,inc,inc),
-					pt + vec3(0,inc,inc),
-				};
-
-				float samples[8];
-				for(int i = 0; i < 8; ++i) 
-					samples[i] = densityField[offsets[i]] - isolevel;
-			
-				surfcon_CreateFaces(mesh, grid, samples, points);
+				auto& slab = batch[level * batchCount + i];
+				slab = std::make_shared<ContourSlab>(width, slicePitch, zBegin, zEnd, dual);
+				levelSlabs[level] = slab.get();
+			}
+			surfcon_ContourSlabs(&levelSlabs[0], &isolevels[0], numLevels, pyramid, createCellTris,
+				densityField, width, height, depth, 0, depth);
+		});
 
+		for(int level = 0; level < numLevels; ++level)
+		{
+			for(int i = 0; i < batchCount; ++i)
+			{
+				const std::shared_ptr<ContourSlab>& slab = batch[level * batchCount + i];
+				if(numSlabs == 1)
+				{
+					result[level] = slab->m_mesh;
+					continue;
+				}
+				surfcon_AppendSlab(result[level].get(), slab.get(), prev[level].get());
+				slab->m_mesh.reset();
+				prev[level] = slab;
 			}
-			yOffset += width;
 		}
-		zOffset += slicePitch;
+	}
+
+	for(const auto& mesh: result)
+		std::cout << "mesh has " << mesh->NumVertices() << " verts and " <<
+			mesh->NumFaces() << " faces. " <<std::endl;
+
+	return result;
+}
+
+std::shared_ptr<TriSoup> surfcon_CreateMeshFromDensityBox(
+	float isolevel,
+	const float* densityField, 
+	unsigned int width, unsigned int height, unsigned int depth,
+	const SurfconBox& cells,
+	int flags,
+	const DensityPyramid* pyramid)
+{
+	ASSERT(!(flags & SURFCON_SurfaceNets));
+	const unsigned int slicePitch = width * height;
+	ContourSlab slab(width, slicePitch, 
+		cells.m_min[2], Min<int>(cells.m_max[2], depth - 1), false);
+	slab.m_xBegin = cells.m_min[0];
+	slab.m_xEnd = cells.m_max[0];
+	slab.m_yBegin = cells.m_min[1];
+	slab.m_yEnd = cells.m_max[1];
+	if(slab.m_zBegin < slab.m_zEnd)
+		surfcon_ContourSlab(&slab, pyramid, surfcon_GetCreateCellTrisFunc(flags),
+			isolevel, densityField, width, height, depth);
+	return slab.m_mesh;
+}
+
+// Applies advice to the whole pages covering slices [zBegin, zEnd) of a mapped volume.
+static void surfcon_AdviseSlices(void* mapping, size_t slicePitch, 
+	unsigned int zBegin, unsigned int zEnd, int advice)
+{
+	const size_t pageSize = sysconf(_SC_PAGESIZE);
+	size_t first = zBegin * slicePitch * sizeof(float);
+	size_t last = zEnd * slicePitch * sizeof(float);
+	// dropped pages must not reach into slices still in use, prefetched ones may
+	if(advice == MADV_DONTNEED)
+		first = (first + pageSize - 1) & ~(pageSize - 1);
+	else
+		first &= ~(pageSize - 1);
+	last &= ~(pageSize - 1);
+	if(first < last)
+		madvise(static_cast<char*>(mapping) + first, last - first, advice);
+}
+
+std::shared_ptr<TriSoup> surfcon_CreateMeshFromVolumeFile(
+	float isolevel,
+	const char* filename,
+	unsigned int width, unsigned int height, unsigned int depth,
+	int flags,
+	const SurfconSinkFunc& sink)
+{
+	const size_t slicePitch = size_t(width) * height;
+	const size_t volumeSize = slicePitch * depth * sizeof(float);
+
+	const int fd = open(filename, O_RDONLY);
+	if(fd < 0)
+	{
+		std::cerr << "failed to open volume " << filename << std::endl;
+		return nullptr;
+	}
+	struct stat st;
+	if(fstat(fd, &st) != 0 || size_t(st.st_size) < volumeSize)
+	{
+		std::cerr << "volume " << filename << " is smaller than " << width << "x" << 
+			height << "x" << depth << " floats" << std::endl;
+		close(fd);
+		return nullptr;
+	}
+	void* mapping = mmap(nullptr, volumeSize, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(mapping == MAP_FAILED)
+	{
+		std::cerr << "failed to map volume " << filename << std::endl;
+		return nullptr;
+	}
+	madvise(mapping, volumeSize, MADV_SEQUENTIAL);
+	const float* densityField = static_cast<const float*>(mapping);
+
+	// Without the whole field there's no pyramid, so every row goes through 
+	// the row classification. The slabs of a batch are contoured in parallel,
+	// and only the batch's slices need to be resident.
+	const int numCellsZ = depth - 1;
+	const bool dual = (flags & SURFCON_SurfaceNets) != 0;
+	const CreateCellTrisFunc createCellTris = surfcon_GetCreateCellTrisFunc(flags);
+	const int batchDepth = kSlabDepth * ((flags & SURFCON_Parallel) ? 
+		Max<int>(1, std::thread::hardware_concurrency()) : 1);
+
+	std::shared_ptr<TriSoup> result;
+	if(!sink)
+		result = std::make_shared<TriSoup>();
+	std::shared_ptr<ContourSlab> prev;
+	std::vector<std::shared_ptr<ContourSlab>> batch;
+	for(int zBatch = 0; zBatch < numCellsZ; zBatch += batchDepth)
+	{
+		const int zBatchEnd = Min(zBatch + batchDepth, numCellsZ);
+		batch.clear();
+		for(int z = zBatch; z < zBatchEnd; z += kSlabDepth)
+			batch.push_back(std::make_shared<ContourSlab>(width, slicePitch, 
+				z, Min(z + kSlabDepth, zBatchEnd), dual));
+
+		// start reading the next batch while this one is contoured
+		surfcon_AdviseSlices(mapping, slicePitch, zBatchEnd + 1, 
+			Min<unsigned int>(zBatchEnd + 1 + batchDepth, depth), MADV_WILLNEED);
+
+		task_ParallelFor(batch.size(), [&](int i) {
+			surfcon_ContourSlab(batch[i].get(), nullptr, createCellTris,
+				isolevel, densityField, width, height, depth);
+		});
+
+		for(auto& slab: batch)
+		{
+			if(sink)
+				sink(*slab->m_mesh);
+			else
+				surfcon_AppendSlab(result.get(), slab.get(), prev.get());
+			slab->m_mesh.reset();
+			prev = slab;
+		}
+
+		// the next batch reads the top slice again, and the dual methods the one below it
+		surfcon_AdviseSlices(mapping, slicePitch, 0, zBatchEnd - 1, MADV_DONTNEED);
+	}
+	munmap(mapping, volumeSize);
+
+	if(result)
+	{
+		std::cout << "mesh has " << result->NumVertices() << " verts and " <<
+			result->NumFaces() << " faces. " <<std::endl;
+	}
+	return result;
+}
+
+std::shared_ptr<TriSoup> surfcon_CreateMeshFromSparseField(
+	float isolevel,
+	const SparseDensityField& field,
+	int flags)
+{
+	if(!field.CoversIsolevel(isolevel))
+	{
+		std::cerr << "sparse density field doesn't cover isolevel " << isolevel << std::endl;
+		return nullptr;
+	}
+
+	constexpr int kBrickDim = SparseDensityField::kBrickDim;
+	const unsigned int width = field.Width();
+	const unsigned int height = field.Height();
+	const unsigned int depth = field.Depth();
+	const size_t slicePitch = size_t(width) * height;
+	const int numCellsZ = depth - 1;
+	const bool dual = (flags & SURFCON_SurfaceNets) != 0;
+	const CreateCellTrisFunc createCellTris = surfcon_GetCreateCellTrisFunc(flags);
+
+	// A slab per brick layer, each contouring a window of slices extracted
+	// from the bricks. The window reaches two slices below the layer for the
+	// gradients (and the dual methods' extra layer), and starts on an even 
+	// slice for the edge cache. Like the volume file, slabs go a batch at a 
+	// time, so only a batch's windows and caches exist at once.
+	const int batchDepth = kBrickDim * ((flags & SURFCON_Parallel) ? 
+		Max<int>(1, std::thread::hardware_concurrency()) : 1);
+
+	std::shared_ptr<TriSoup> result = std::make_shared<TriSoup>();
+	std::shared_ptr<ContourSlab> prev;
+	std::vector<std::shared_ptr<ContourSlab>> batch;
+	for(int zBatch = 0; zBatch < numCellsZ; zBatch += batchDepth)
+	{
+		const int zBatchEnd = Min(zBatch + batchDepth, numCellsZ);
+		batch.clear();
+		for(int z = zBatch; z < zBatchEnd; z += kBrickDim)
+			batch.push_back(std::make_shared<ContourSlab>(width, slicePitch, 
+				z, Min(z + kBrickDim, zBatchEnd), dual));
+
+		task_ParallelFor(batch.size(), [&](int i) {
+			ContourSlab* slab = batch[i].get();
+			const unsigned int fieldZ = Max(0, slab->m_zBegin - 2) & ~1;
+			const unsigned int fieldEnd = Min<unsigned int>(slab->m_zEnd + 2, depth);
+			std::vector<float> window((fieldEnd - fieldZ) * slicePitch);
+			field.ExtractSlices(fieldZ, fieldEnd, &window[0]);
+			surfcon_ContourSlabs(&slab, &isolevel, 1, &field.GetPyramid(), createCellTris,
+				&window[0], width, height, depth, fieldZ, fieldEnd - fieldZ);
+		});
+
+		for(auto& slab: batch)
+		{
+			surfcon_AppendSlab(result.get(), slab.get(), prev.get());
+			slab->m_mesh.reset();
+			prev = slab;
+		}
 	}
 
 	std::cout << "mesh has " << result->NumVertices() << " verts and " <<
 		result->NumFaces() << " faces. " <<std::endl;
-
 	return result;
 }
 
-static void surfcon_CreateTetrahedronTris(TriSoup* result,
-	PointGrid& grid, 
-	const float* samples, const vec3* points, int v0, int v1, int v2, int v3)
+static int surfcon_AddEdgeVertex(ContourSlab* slab, const ContourCell& cell, int c0, int c1)
+{
+	if(cell.m_offsets[c1] < cell.m_offsets[c0])
+		std::swap(c0, c1);
+
+	const int edgeType = g_cellEdgeTypes[c0][c1];
+	ASSERT(edgeType >= 0);
+	int& vert = slab->m_cache.Get(cell.m_offsets[c0], edgeType);
+	if(vert < 0)
+	{
+		const float t = InterpParam(cell.m_samples[c0], cell.m_samples[c1]);
+		const vec3 gradient = (1.f - t) * surfcon_CornerGradient(cell, c0) + 
+			t * surfcon_CornerGradient(cell, c1);
+		vert = slab->m_mesh->AddVertex((1.f - t) * cell.m_points[c0] + t * cell.m_points[c1],
+			surfcon_NormalFromGradient(gradient));
+	}
+	return vert;
+}
+
+// The triangles of one tetrahedron case, with the tetrahedron's corners and
+// the case fixed at compile time so the edge tests and table lookups fold 
+// away. Edges are in the order of the bits in g_edgeTable: 01 12 20 03 13 23.
+template<int V0, int V1, int V2, int V3, unsigned int Case>
+static inline void surfcon_CreateTetrahedronCaseTris(ContourSlab* slab, const ContourCell& cell)
 {
-	float localSamples[4] = {
-		samples[v0], samples[v1], samples[v2], samples[v3] };
-	unsigned int tetIndex = MakeTableIndex(localSamples);
-	int edges = g_edgeTable[tetIndex];
-	
+	constexpr unsigned int edges = g_edgeTable[Case];
 	int edgeVerts[6] = {-1,-1,-1,-1,-1,-1};
-	if(edges & 1)
-		edgeVerts[0] = UniqueAddVertex(result, grid, 
-			InterpPoints(points[v0], points[v1], samples[v0], samples[v1]));
-	if(edges & 2)
-		edgeVerts[1] = UniqueAddVertex(result, grid,
-			InterpPoints(points[v1], points[v2], samples[v1], samples[v2]));
-	if(edges & 4)
-		edgeVerts[2] = UniqueAddVertex(result, grid,
-			InterpPoints(points[v2], points[v0], samples[v2], samples[v0]));
-	if(edges & 8)
-		edgeVerts[3] = UniqueAddVertex(result, grid,
-			InterpPoints(points[v0], points[v3], samples[v0], samples[v3]));
-	if(edges & 16)
-		edgeVerts[4] = UniqueAddVertex(result, grid,
-			InterpPoints(points[v1], points[v3], samples[v1], samples[v3]));
-	if(edges & 32)
-		edgeVerts[5] = UniqueAddVertex(result, grid,
-			InterpPoints(points[v2], points[v3], samples[v2], samples[v3]));
-
-	const int* triTable = g_triTable[tetIndex];
-	for(int i = 0; i < 6 && triTable[i] >= 0; i += 3)
+	if(edges & 0x01) edgeVerts[0] = surfcon_AddEdgeVertex(slab, cell, V0, V1);
+	if(edges & 0x02) edgeVerts[1] = surfcon_AddEdgeVertex(slab, cell, V1, V2);
+	if(edges & 0x04) edgeVerts[2] = surfcon_AddEdgeVertex(slab, cell, V2, V0);
+	if(edges & 0x08) edgeVerts[3] = surfcon_AddEdgeVertex(slab, cell, V0, V3);
+	if(edges & 0x10) edgeVerts[4] = surfcon_AddEdgeVertex(slab, cell, V1, V3);
+	if(edges & 0x20) edgeVerts[5] = surfcon_AddEdgeVertex(slab, cell, V2, V3);
+
+	TriSoup* result = slab->m_mesh.get();
+	result->AddFace(edgeVerts[g_triTable[Case][0]],
+		edgeVerts[g_triTable[Case][1]],
+		edgeVerts[g_triTable[Case][2]]);
+	if(g_triTable[Case][3] >= 0)
+	{
+		result->AddFace(edgeVerts[g_triTable[Case][3]],
+			edgeVerts[g_triTable[Case][4]],
+			edgeVerts[g_triTable[Case][5]]);
+	}
+}
+
+// Picks the case from the corners' signs. The switch compiles to a jump table
+// into straight line code for each case.
+template<int V0, int V1, int V2, int V3>
+static inline void surfcon_CreateTetrahedronTris(ContourSlab* slab, const ContourCell& cell)
+{
+	const float* samples = cell.m_samples;
+	const unsigned int tetIndex = 
+		(samples[V0] < 0 ? 1 : 0) |
+		(samples[V1] < 0 ? 2 : 0) |
+		(samples[V2] < 0 ? 4 : 0) |
+		(samples[V3] < 0 ? 8 : 0);
+	switch(tetIndex)
+	{
+		case 1: surfcon_CreateTetrahedronCaseTris<V0, V1, V2, V3, 1>(slab, cell); break;
+		case 2: surfcon_CreateTetrahedronCaseTris<V0, V1, V2, V3, 2>(slab, cell); break;
+		case 3: surfcon_CreateTetrahedronCaseTris<V0, V1, V2, V3, 3>(slab, cell); break;
+		case 4: surfcon_CreateTetrahedronCaseTris<V0, V1, V2, V3, 4>(slab, cell); break;
+		case 5: surfcon_CreateTetrahedronCaseTris<V0, V1, V2, V3, 5>(slab, cell); break;
+		case 6: surfcon_CreateTetrahedronCaseTris<V0, V1, V2, V3, 6>(slab, cell); break;
+		case 7: surfcon_CreateTetrahedronCaseTris<V0, V1, V2, V3, 7>(slab, cell); break;
+		case 8: surfcon_CreateTetrahedronCaseTris<V0, V1, V2, V3, 8>(slab, cell); break;
+		case 9: surfcon_CreateTetrahedronCaseTris<V0, V1, V2, V3, 9>(slab, cell); break;
+		case 10: surfcon_CreateTetrahedronCaseTris<V0, V1, V2, V3, 10>(slab, cell); break;
+		case 11: surfcon_CreateTetrahedronCaseTris<V0, V1, V2, V3, 11>(slab, cell); break;
+		case 12: surfcon_CreateTetrahedronCaseTris<V0, V1, V2, V3, 12>(slab, cell); break;
+		case 13: surfcon_CreateTetrahedronCaseTris<V0, V1, V2, V3, 13>(slab, cell); break;
+		case 14: surfcon_CreateTetrahedronCaseTris<V0, V1, V2, V3, 14>(slab, cell); break;
+		default: break; // all inside or all outside
+	}
+}
+
+static void surfcon_CreateFaces(ContourSlab* slab, const ContourCell& cell)
+{
+	surfcon_CreateTetrahedronTris<0, 3, 1, 5>(slab, cell);
+	surfcon_CreateTetrahedronTris<1, 3, 2, 5>(slab, cell);
+	surfcon_CreateTetrahedronTris<4, 5, 7, 3>(slab, cell);
+	surfcon_CreateTetrahedronTris<5, 6, 7, 3>(slab, cell);
+	surfcon_CreateTetrahedronTris<0, 5, 4, 3>(slab, cell);
+	surfcon_CreateTetrahedronTris<5, 2, 6, 3>(slab, cell);
+}
+
+static void surfcon_CreateCubeTris(ContourSlab* slab, const ContourCell& cell)
+{
+	unsigned int cubeIndex = 0;
+	for(int i = 0; i < 8; ++i)
+		cubeIndex |= cell.m_samples[i] < 0 ? (1 << i) : 0;
+	const unsigned int edges = g_mcEdgeTable[cubeIndex];
+	if(!edges)
+		return;
+
+	// cube edges are all axis aligned lattice edges, so they share the 
+	// tetrahedral split's edge cache
+	int edgeVerts[12];
+	for(int i = 0; i < 12; ++i)
+	{
+		if(edges & (1 << i))
+			edgeVerts[i] = surfcon_AddEdgeVertex(slab, cell, 
+				g_mcCubeEdges[i][0], g_mcCubeEdges[i][1]);
+	}
+
+	TriSoup* result = slab->m_mesh.get();
+	const signed char* triTable = g_mcTriTable[cubeIndex];
+	for(int i = 0; triTable[i] >= 0; i += 3)
 	{
 		result->AddFace(edgeVerts[triTable[i]],
 			edgeVerts[triTable[i+1]],
@@ -164,15 +1344,550 @@ static void surfcon_CreateTetrahedronTris(TriSoup* result,
 	}
 }
 
-static void surfcon_CreateFaces(TriSoup* result,
-	PointGrid& grid,
-	const float *samples, const vec3* points)
+// Surface nets: one vertex per mixed cell, at the mean of the crossings on the
+// cell's edges. Each lattice edge with a sign change is surrounded by four 
+// mixed cells, and their vertices make a quad across it. A cell makes the 
+// quads for the three edges leaving its lowest corner, since the other cells
+// around those edges have all been visited already.
+static void surfcon_CreateDualTris(ContourSlab* slab, const ContourCell& cell)
 {
-	surfcon_CreateTetrahedronTris(result, grid, samples, points, 0, 3, 1, 5);
-	surfcon_CreateTetrahedronTris(result, grid, samples, points, 1, 3, 2, 5);
-	surfcon_CreateTetrahedronTris(result, grid, samples, points, 4, 5, 7, 3);
-	surfcon_CreateTetrahedronTris(result, grid, samples, points, 5, 6, 7, 3);
-	surfcon_CreateTetrahedronTris(result, grid, samples, points, 0, 5, 4, 3);
-	surfcon_CreateTetrahedronTris(result, grid, samples, points, 5, 2, 6, 3);
+	const float* samples = cell.m_samples;
+	vec3 sum(0.f);
+	vec3 gradientSum(0.f);
+	int numCrossings = 0;
+	for(int i = 0; i < 12; ++i)
+	{
+		int c0 = g_mcCubeEdges[i][0], c1 = g_mcCubeEdges[i][1];
+		if((samples[c0] < 0) == (samples[c1] < 0))
+			continue;
+		// interpolate from the lower corner so neighbours agree on the crossing
+		if(cell.m_offsets[c1] < cell.m_offsets[c0])
+			std::swap(c0, c1);
+		const float t = InterpParam(samples[c0], samples[c1]);
+		sum += (1.f - t) * cell.m_points[c0] + t * cell.m_points[c1];
+		gradientSum += surfcon_NormalFromGradient((1.f - t) * surfcon_CornerGradient(cell, c0) + 
+			t * surfcon_CornerGradient(cell, c1));
+		++numCrossings;
+	}
+	ASSERT(numCrossings > 0);
+
+	TriSoup* result = slab->m_mesh.get();
+	CellVertexCache& cache = slab->m_cellCache;
+	const int vert = result->AddVertex(sum / float(numCrossings), 
+		surfcon_NormalFromGradient(gradientSum));
+	cache.Get(cell.m_x, cell.m_y, cell.m_z) = vert;
+	if(!slab->m_emitFaces)
+		return;
+
+	static const int kAxisCorners[3] = { 1, 3, 4 };
+	const bool inside = samples[0] < 0;
+	const int pos[3] = { cell.m_x, cell.m_y, cell.m_z };
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		if(inside == (samples[kAxisCorners[axis]] < 0))
+			continue;
+		// walk the cells around the edge, stepping back along the other two axes
+		const int j = (axis + 1) % 3, k = (axis + 2) % 3;
+		if(pos[j] == 0 || pos[k] == 0)
+			continue;
+		int p[3] = { pos[0], pos[1], pos[2] };
+		--p[j];
+		const int vj = cache.Get(p[0], p[1], p[2]);
+		--p[k];
+		const int vjk = cache.Get(p[0], p[1], p[2]);
+		++p[j];
+		const int vk = cache.Get(p[0], p[1], p[2]);
+		ASSERT(vj >= 0 && vjk >= 0 && vk >= 0);
+
+		// wind the quad so the front faces outside, like the primal methods
+		int quad[4] = { vert, vj, vjk, vk };
+		if(!inside)
+			std::swap(quad[1], quad[3]);
+
+		// split along the shorter diagonal
+		const vec3 d02 = result->GetVertexPos(quad[0]) - result->GetVertexPos(quad[2]);
+		const vec3 d13 = result->GetVertexPos(quad[1]) - result->GetVertexPos(quad[3]);
+		if(Dot(d02, d02) <= Dot(d13, d13))
+		{
+			result->AddFace(quad[0], quad[1], quad[2]);
+			result->AddFace(quad[0], quad[2], quad[3]);
+		}
+		else
+		{
+			result->AddFace(quad[0], quad[1], quad[3]);
+			result->AddFace(quad[1], quad[2], quad[3]);
+		}
+	}
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// Adaptive contouring
+// Octree dual contouring. The octree is built bottom up from the mixed cells, 
+// and eight leaves are merged into one when the LOD params allow it and the 
+// merge can't change the surface's topology. Each leaf gets one vertex at the
+// mean of the crossings on the edges of the field cells it covers. Faces are
+// made by walking the minimal edges shared by leaves (cellProc / faceProc / 
+// edgeProc from Ju et al.), which joins leaves of different sizes directly, 
+// so there are no cracks between levels.
+
+// child i sits at offset ((i >> 2) & 1, (i >> 1) & 1, i & 1) in half sizes, 
+// and the node's corners are numbered the same way.
+static const int g_octEdgeCorners[12][2] = {
+	{0,4},{1,5},{2,6},{3,7}, // x
+	{0,2},{1,3},{4,6},{5,7}, // y
+	{0,1},{2,3},{4,5},{6,7}, // z
+};
+
+// pairs of children sharing a face, and the face's axis
+static const int g_octCellProcFaces[12][3] = {
+	{0,4,0},{1,5,0},{2,6,0},{3,7,0},
+	{0,2,1},{4,6,1},{1,3,1},{5,7,1},
+	{0,1,2},{2,3,2},{4,5,2},{6,7,2},
+};
+
+// quads of children sharing an edge, and the edge's axis
+static const int g_octCellProcEdges[6][5] = {
+	{0,1,2,3,0},{4,5,6,7,0},
+	{0,4,1,5,1},{2,6,3,7,1},
+	{0,2,4,6,2},{1,3,5,7,2},
+};
+
+// for a face along an axis: the child pairs sharing sub-faces
+static const int g_octFaceProcFaces[3][4][3] = {
+	{{4,0,0},{5,1,0},{6,2,0},{7,3,0}},
+	{{2,0,1},{6,4,1},{3,1,1},{7,5,1}},
+	{{1,0,2},{3,2,2},{5,4,2},{7,6,2}},
+};
+
+// for a face along an axis: which of the two nodes each of the four nodes 
+// around a sub-edge comes from (0 = 0,0,1,1 and 1 = 0,1,0,1), their children,
+// and the sub-edge's axis
+static const int g_octFaceProcEdges[3][4][6] = {
+	{{1,4,0,5,1,1},{1,6,2,7,3,1},{0,4,6,0,2,2},{0,5,7,1,3,2}},
+	{{0,2,3,0,1,0},{0,6,7,4,5,0},{1,2,0,6,4,2},{1,3,1,7,5,2}},
+	{{1,1,0,3,2,0},{1,5,4,7,6,0},{0,1,5,0,4,1},{0,3,7,2,6,1}},
+};
+
+// for an edge along an axis: the children of the four nodes around each half
+static const int g_octEdgeProcEdges[3][2][5] = {
+	{{3,2,1,0,0},{7,6,5,4,0}},
+	{{5,1,4,0,1},{7,3,6,2,1}},
+	{{6,4,2,0,2},{7,5,3,1,2}},
+};
+
+// the edge of each of the four nodes around an edge along an axis that lies on it
+static const int g_octProcessEdges[3][4] = {
+	{3,2,1,0},{7,5,6,4},{11,10,9,8}
+};
+
+class AdaptiveContourer
+{
+public:
+	AdaptiveContourer(float isolevel, const float* densityField, 
+		unsigned int width, unsigned int height, unsigned int depth,
+		const SurfconLodParams& lod, const DensityPyramid& pyramid);
+
+	std::shared_ptr<TriSoup> Contour();
+private:
+	struct Node {
+		int m_children[8]; // -1 for children with no surface
+		int m_size;
+		int m_vertex;
+		unsigned int m_corners; // inside bits by corner
+		bool m_leaf;
+		// over all the crossings in the node's cells
+		vec3 m_massSum;
+		vec3 m_normalSum;
+		int m_numCrossings;
+	};
+
+	int BuildNode(int x, int y, int z, int size);
+	int BuildCell(int x, int y, int z);
+	bool AnyBrickStraddles(int x, int y, int z, int size) const;
+	bool CanMerge(const Node& node, int x, int y, int z) const;
+	unsigned int CornerBits(int x, int y, int z, int size) const;
+	void CreateVertices(int node);
+	void CellProc(int node);
+	void FaceProc(const int (&nodes)[2], int axis);
+	void EdgeProc(const int (&nodes)[4], int axis);
+	void ProcessEdge(const int (&nodes)[4], int axis);
+
+	float Sample(int x, int y, int z) const {
+		return m_densityField[x + m_width * (y + m_height * z)] - m_isolevel;
+	}
+	bool Inside(int x, int y, int z) const { return Sample(x, y, z) < 0; }
+	vec3 Point(int x, int y, int z) const { return m_startPt + m_inc * vec3(x, y, z); }
+	vec3 Gradient(int x, int y, int z) const;
+
+	float m_isolevel;
+	const float* m_densityField;
+	int m_width, m_height, m_depth;
+	SurfconLodParams m_lod;
+	const DensityPyramid& m_pyramid;
+	float m_inc;
+	vec3 m_startPt;
+	std::vector<Node> m_nodes;
+	std::shared_ptr<TriSoup> m_mesh;
+};
+
+AdaptiveContourer::AdaptiveContourer(float isolevel, const float* densityField, 
+	unsigned int width, unsigned int height, unsigned int depth,
+	const SurfconLodParams& lod, const DensityPyramid& pyramid)
+	: m_isolevel(isolevel)
+	, m_densityField(densityField)
+	, m_width(width)
+	, m_height(height)
+	, m_depth(depth)
+	, m_lod(lod)
+	, m_pyramid(pyramid)
+	, m_inc()
+	, m_startPt()
+	, m_nodes()
+	, m_mesh(std::make_shared<TriSoup>())
+{
+	// same placement as the uniform contourers
+	const float smallestSide = Min(Min(width,height),depth);
+	m_inc = 2.0 / smallestSide;
+	m_startPt = -vec3(width,height,depth) / smallestSide;
+}
+
+std::shared_ptr<TriSoup> AdaptiveContourer::Contour()
+{
+	int rootSize = 1;
+	while(rootSize < m_width - 1 || rootSize < m_height - 1 || rootSize < m_depth - 1)
+		rootSize *= 2;
+	const int root = BuildNode(0, 0, 0, rootSize);
+	if(root >= 0)
+	{
+		CreateVertices(root);
+		CellProc(root);
+	}
+	return m_mesh;
+}
+
+vec3 AdaptiveContourer::Gradient(int x, int y, int z) const
+{
+	return surfcon_Gradient(m_densityField, m_width, m_height, m_depth, x, y, z);
+}
+
+unsigned int AdaptiveContourer::CornerBits(int x, int y, int z, int size) const
+{
+	unsigned int corners = 0;
+	for(int i = 0; i < 8; ++i)
+	{
+		if(Inside(x + ((i >> 2) & 1) * size, y + ((i >> 1) & 1) * size, z + (i & 1) * size))
+			corners |= 1 << i;
+	}
+	return corners;
+}
+
+bool AdaptiveContourer::AnyBrickStraddles(int x, int y, int z, int size) const
+{
+	constexpr int kBrickDim = DensityPyramid::kBrickDim;
+	const int bxEnd = Min((x + size) / kBrickDim, m_pyramid.NumBricksX());
+	const int byEnd = Min((y + size) / kBrickDim, m_pyramid.NumBricksY());
+	const int bzEnd = Min((z + size) / kBrickDim, m_pyramid.NumBricksZ());
+	for(int bz = z / kBrickDim; bz < bzEnd; ++bz)
+		for(int by = y / kBrickDim; by < byEnd; ++by)
+			for(int bx = x / kBrickDim; bx < bxEnd; ++bx)
+				if(m_pyramid.BrickStraddles(bx, by, bz, m_isolevel))
+					return true;
+	return false;
+}
+
+int AdaptiveContourer::BuildCell(int x, int y, int z)
+{
+	const unsigned int corners = CornerBits(x, y, z, 1);
+	if(corners == 0 || corners == 0xff)
+		return -1;
+
+	Node node;
+	std::fill(node.m_children, node.m_children + 8, -1);
+	node.m_size = 1;
+	node.m_vertex = -1;
+	node.m_corners = corners;
+	node.m_leaf = true;
+	node.m_massSum = vec3(0.f);
+	node.m_normalSum = vec3(0.f);
+	node.m_numCrossings = 0;
+	for(int i = 0; i < 12; ++i)
+	{
+		const int c0 = g_octEdgeCorners[i][0], c1 = g_octEdgeCorners[i][1];
+		if(((corners >> c0) & 1) == ((corners >> c1) & 1))
+			continue;
+		const int x0 = x + ((c0 >> 2) & 1), y0 = y + ((c0 >> 1) & 1), z0 = z + (c0 & 1);
+		const int x1 = x + ((c1 >> 2) & 1), y1 = y + ((c1 >> 1) & 1), z1 = z + (c1 & 1);
+		const float d0 = Sample(x0, y0, z0), d1 = Sample(x1, y1, z1);
+		const float t = Clamp(d0 / (d0 - d1), 0.f, 1.f);
+		node.m_massSum += (1.f - t) * Point(x0, y0, z0) + t * Point(x1, y1, z1);
+		const vec3 grad = (1.f - t) * Gradient(x0, y0, z0) + t * Gradient(x1, y1, z1);
+		const float gradLen = Length(grad);
+		if(gradLen > 0.f)
+			node.m_normalSum += grad / gradLen;
+		++node.m_numCrossings;
+	}
+	m_nodes.push_back(node);
+	return m_nodes.size() - 1;
+}
+
+// A merge is only allowed if the field agrees with the merged cell: the 
+// middle of each edge and face, and the centre, must each have the same sign
+// as one of the corners of that edge, face or cell. 
+bool AdaptiveContourer::CanMerge(const Node& node, int x, int y, int z) const
+{
+	const int size = node.m_size;
+	if(size > m_lod.m_maxCellSize)
+		return false;
+	if(x + size >= m_width || y + size >= m_height || z + size >= m_depth)
+		return false;
+
+	const float mergedSize = size * m_inc;
+	const vec3 center = Point(x, y, z) + vec3(0.5f * mergedSize);
+	if(Length(center - m_lod.m_viewPos) < m_lod.m_lodDistance * mergedSize)
+		return false;
+	if(Length(node.m_normalSum) < m_lod.m_minFlatness * node.m_numCrossings)
+		return false;
+
+	const int half = size / 2;
+	for(int k = 0; k < 3; ++k)
+	for(int j = 0; j < 3; ++j)
+	for(int i = 0; i < 3; ++i)
+	{
+		const int pt[3] = { i, j, k };
+		int numMid = 0;
+		for(int a = 0; a < 3; ++a)
+			numMid += pt[a] == 1 ? 1 : 0;
+		if(numMid == 0)
+			continue;
+
+		// the corners of the edge, face or cell this point is the middle of
+		const bool inside = Inside(x + i * half, y + j * half, z + k * half);
+		bool matched = false;
+		for(int c = 0; c < 8 && !matched; ++c)
+		{
+			int corner[3];
+			for(int a = 0; a < 3; ++a)
+				corner[a] = pt[a] == 1 ? ((c >> a) & 1) * 2 : pt[a];
+			matched = Inside(x + corner[0] * half, y + corner[1] * half, 
+				z + corner[2] * half) == inside;
+		}
+		if(!matched)
+			return false;
+	}
+	return true;
+}
+
+int AdaptiveContourer::BuildNode(int x, int y, int z, int size)
+{
+	if(x >= m_width - 1 || y >= m_height - 1 || z >= m_depth - 1)
+		return -1;
+	if(size >= DensityPyramid::kBrickDim && !AnyBrickStraddles(x, y, z, size))
+		return -1;
+	if(size == 1)
+		return BuildCell(x, y, z);
+
+	// children are built first, so everything past poolMark is this subtree
+	const size_t poolMark = m_nodes.size();
+	const int half = size / 2;
+	Node node;
+	node.m_size = size;
+	node.m_vertex = -1;
+	node.m_corners = 0;
+	node.m_leaf = true;
+	node.m_massSum = vec3(0.f);
+	node.m_normalSum = vec3(0.f);
+	node.m_numCrossings = 0;
+	bool any = false;
+	for(int i = 0; i < 8; ++i)
+	{
+		const int child = BuildNode(x + ((i >> 2) & 1) * half, 
+			y + ((i >> 1) & 1) * half, z + (i & 1) * half, half);
+		node.m_children[i] = child;
+		if(child < 0)
+			continue;
+		any = true;
+		const Node& childNode = m_nodes[child];
+		node.m_leaf = node.m_leaf && childNode.m_leaf;
+		node.m_massSum += childNode.m_massSum;
+		node.m_normalSum += childNode.m_normalSum;
+		node.m_numCrossings += childNode.m_numCrossings;
+	}
+	if(!any)
+		return -1;
+
+	if(node.m_leaf && CanMerge(node, x, y, z))
+	{
+		m_nodes.resize(poolMark);
+		std::fill(node.m_children, node.m_children + 8, -1);
+		node.m_corners = CornerBits(x, y, z, size);
+	}
+	else
+		node.m_leaf = false;
+
+	m_nodes.push_back(node);
+	return m_nodes.size() - 1;
+}
+
+void AdaptiveContourer::CreateVertices(int nodeIndex)
+{
+	Node& node = m_nodes[nodeIndex];
+	if(node.m_leaf)
+	{
+		node.m_vertex = m_mesh->AddVertex(node.m_massSum / float(node.m_numCrossings),
+			surfcon_NormalFromGradient(node.m_normalSum));
+		return;
+	}
+	for(int i = 0; i < 8; ++i)
+		if(node.m_children[i] >= 0)
+			CreateVertices(node.m_children[i]);
+}
+
+void AdaptiveContourer::CellProc(int nodeIndex)
+{
+	const Node& node = m_nodes[nodeIndex];
+	if(node.m_leaf)
+		return;
+
+	for(int i = 0; i < 8; ++i)
+		if(node.m_children[i] >= 0)
+			CellProc(node.m_children[i]);
+
+	for(int i = 0; i < 12; ++i)
+	{
+		const int faceNodes[2] = { 
+			node.m_children[g_octCellProcFaces[i][0]], 
+			node.m_children[g_octCellProcFaces[i][1]] };
+		FaceProc(faceNodes, g_octCellProcFaces[i][2]);
+	}
+
+	for(int i = 0; i < 6; ++i)
+	{
+		const int* mask = g_octCellProcEdges[i];
+		const int edgeNodes[4] = { 
+			node.m_children[mask[0]], node.m_children[mask[1]],
+			node.m_children[mask[2]], node.m_children[mask[3]] };
+		EdgeProc(edgeNodes, mask[4]);
+	}
+}
+
+void AdaptiveContourer::FaceProc(const int (&nodes)[2], int axis)
+{
+	if(nodes[0] < 0 || nodes[1] < 0)
+		return;
+	const Node* faceNodes[2] = { &m_nodes[nodes[0]], &m_nodes[nodes[1]] };
+	if(faceNodes[0]->m_leaf && faceNodes[1]->m_leaf)
+		return;
+
+	for(int i = 0; i < 4; ++i)
+	{
+		const int* mask = g_octFaceProcFaces[axis][i];
+		int subNodes[2];
+		for(int j = 0; j < 2; ++j)
+			subNodes[j] = faceNodes[j]->m_leaf ? nodes[j] : faceNodes[j]->m_children[mask[j]];
+		FaceProc(subNodes, mask[2]);
+	}
+
+	static const int kOrders[2][4] = { { 0, 0, 1, 1 }, { 0, 1, 0, 1 } };
+	for(int i = 0; i < 4; ++i)
+	{
+		const int* mask = g_octFaceProcEdges[axis][i];
+		const int* order = kOrders[mask[0]];
+		int edgeNodes[4];
+		for(int j = 0; j < 4; ++j)
+		{
+			const Node* node = faceNodes[order[j]];
+			edgeNodes[j] = node->m_leaf ? nodes[order[j]] : node->m_children[mask[1 + j]];
+		}
+		EdgeProc(edgeNodes, mask[5]);
+	}
+}
+
+void AdaptiveContourer::EdgeProc(const int (&nodes)[4], int axis)
+{
+	bool allLeaves = true;
+	for(int i = 0; i < 4; ++i)
+	{
+		if(nodes[i] < 0)
+			return;
+		allLeaves = allLeaves && m_nodes[nodes[i]].m_leaf;
+	}
+	if(allLeaves)
+	{
+		ProcessEdge(nodes, axis);
+		return;
+	}
+
+	for(int i = 0; i < 2; ++i)
+	{
+		const int* mask = g_octEdgeProcEdges[axis][i];
+		int subNodes[4];
+		for(int j = 0; j < 4; ++j)
+		{
+			const Node& node = m_nodes[nodes[j]];
+			subNodes[j] = node.m_leaf ? nodes[j] : node.m_children[mask[j]];
+		}
+		EdgeProc(subNodes, mask[4]);
+	}
+}
+
+// The four leaves around an edge make a quad if the smallest of them, whose 
+// edge is the whole of the shared edge, has a sign change along it.
+void AdaptiveContourer::ProcessEdge(const int (&nodes)[4], int axis)
+{
+	int minSize = INT_MAX;
+	bool signChange = false, flip = false;
+	int verts[4];
+	for(int i = 0; i < 4; ++i)
+	{
+		const Node& node = m_nodes[nodes[i]];
+		verts[i] = node.m_vertex;
+		if(node.m_size < minSize)
+		{
+			const int edge = g_octProcessEdges[axis][i];
+			const bool inside0 = (node.m_corners >> g_octEdgeCorners[edge][0]) & 1;
+			const bool inside1 = (node.m_corners >> g_octEdgeCorners[edge][1]) & 1;
+			minSize = node.m_size;
+			signChange = inside0 != inside1;
+			flip = inside0;
+		}
+	}
+	if(!signChange)
+		return;
+
+	// leaves bigger than the edge can appear twice, leaving a triangle 
+	const int tris[2][3] = { 
+		{ verts[0], verts[1], verts[3] }, 
+		{ verts[0], verts[3], verts[2] } };
+	for(int i = 0; i < 2; ++i)
+	{
+		const int* tri = tris[i];
+		if(tri[0] == tri[1] || tri[1] == tri[2] || tri[0] == tri[2])
+			continue;
+		if(flip)
+			m_mesh->AddFace(tri[0], tri[2], tri[1]);
+		else
+			m_mesh->AddFace(tri[0], tri[1], tri[2]);
+	}
+}
+
+std::shared_ptr<TriSoup> surfcon_CreateAdaptiveMeshFromDensityField(
+	float isolevel,
+	const float* densityField, 
+	unsigned int width, unsigned int height, unsigned int depth,
+	const SurfconLodParams& lod,
+	const DensityPyramid* pyramid)
+{
+	std::shared_ptr<DensityPyramid> localPyramid;
+	if(!pyramid)
+	{
+		localPyramid = std::make_shared<DensityPyramid>(densityField, width, height, depth);
+		pyramid = localPyramid.get();
+	}
+
+	AdaptiveContourer contourer(isolevel, densityField, width, height, depth, lod, *pyramid);
+	std::shared_ptr<TriSoup> result = contourer.Contour();
+
+	std::cout << "mesh has " << result->NumVertices() << " verts and " <<
+		result->NumFaces() << " faces. " <<std::endl;
+	return result;
+}
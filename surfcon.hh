@@ -1,10 +1,203 @@
 #pragma once
 
+#include <functional>
 #include <memory>
+#include <vector>
+#include "vec.hh"
 class TriSoup;
 
+enum SurfconFlagsType {
+	SURFCON_Parallel = 1, // split the field into z slabs and contour them on all cores
+	SURFCON_MarchingCubes = 2, // marching cubes instead of splitting cells into 6 tetrahedra
+	SURFCON_SurfaceNets = 4, // one vertex per surface cell, joined by quads across sign changes
+};
+
+// A box of cells or bricks, [m_min, m_max) on each axis.
+struct SurfconBox
+{
+	int m_min[3];
+	int m_max[3];
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// DensityPyramid
+// Min/max ranges of a density field over bricks of 8^3 cells, and over blocks 
+// of 8^3 bricks above that. Contouring skips any brick whose range doesn't 
+// straddle the isolevel. The ranges don't depend on the isolevel, so keep one
+// around to re-contour the same field at a different isolevel.
+class DensityPyramid
+{
+public:
+	static constexpr int kBrickDim = 8; // cells per brick side
+	static constexpr int kBlockDim = 8; // bricks per block side
+
+	DensityPyramid(const float* densityField, 
+		unsigned int width, unsigned int height, unsigned int depth,
+		int flags = 0);
+
+	// An empty pyramid, for fields built a brick at a time with SetBrickRange.
+	DensityPyramid(unsigned int width, unsigned int height, unsigned int depth);
+
+	int NumBricksX() const { return m_bricksX; }
+	int NumBricksY() const { return m_bricksY; }
+	int NumBricksZ() const { return m_bricksZ; }
+
+	bool BrickStraddles(int bx, int by, int bz, float isolevel) const;
+	bool BlockStraddles(int cx, int cy, int cz, float isolevel) const;
+
+	// recomputes a box of bricks, and the blocks above them, after the field changed
+	void Update(const float* densityField, 
+		unsigned int width, unsigned int height, unsigned int depth,
+		const SurfconBox& bricks);
+
+	// sets a brick's range, growing its block to cover it. Each brick once.
+	void SetBrickRange(int bx, int by, int bz, float lo, float hi);
+private:
+	struct Range {
+		float m_min;
+		float m_max;
+		bool Straddles(float isolevel) const;
+	};
+
+	void ComputeBrick(const float* densityField, 
+		unsigned int width, unsigned int height, unsigned int depth,
+		int bx, int by, int bz);
+
+	int m_bricksX, m_bricksY, m_bricksZ;
+	int m_blocksX, m_blocksY, m_blocksZ;
+	std::vector<Range> m_bricks;
+	std::vector<Range> m_blocks;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// SparseDensityField
+// A density field stored only in the pyramid bricks whose range comes within 
+// bandWidth of an isolevel. The other bricks are flagged as uniformly inside
+// or outside and keep one value, their range's end nearest the isolevel. Any
+// isolevel within the band contours as the dense field would, except for 
+// normals at the band's edge, where gradients read the uniform values. It can 
+// be filled a layer of bricks at a time, so the dense field never has to exist.
+class SparseDensityField
+{
+public:
+	static constexpr int kBrickDim = DensityPyramid::kBrickDim;
+	static constexpr int kBrickSamples = kBrickDim + 1; // per side, neighbours share their faces
+
+	// an empty field, fill it with SetBrickLayer
+	SparseDensityField(unsigned int width, unsigned int height, unsigned int depth,
+		float isolevel, float bandWidth);
+	SparseDensityField(const float* densityField, 
+		unsigned int width, unsigned int height, unsigned int depth,
+		float isolevel, float bandWidth);
+
+	// Fills brick layer bz from slices [bz * kBrickDim, bz * kBrickDim + kBrickDim] 
+	// of the field, or up to the last slice, starting at slices. Each layer once.
+	void SetBrickLayer(int bz, const float* slices);
+
+	// writes slices [zBegin, zEnd) of the field to out, uniform bricks at their value
+	void ExtractSlices(unsigned int zBegin, unsigned int zEnd, float* out) const;
+
+	bool CoversIsolevel(float isolevel) const;
+	unsigned int Width() const { return m_width; }
+	unsigned int Height() const { return m_height; }
+	unsigned int Depth() const { return m_depth; }
+	const DensityPyramid& GetPyramid() const { return m_pyramid; }
+	int NumBricks() const { return m_slots.size(); }
+	int NumDenseBricks() const { return m_numDenseBricks; }
+	size_t GetMemoryUsed() const;
+private:
+	static constexpr int kBrickSize = kBrickSamples * kBrickSamples * kBrickSamples;
+	static constexpr int kBricksPerPage = 512;
+	// m_slots values for uniform bricks, dense ones index their samples
+	enum { kSlotOutside = -1, kSlotInside = -2 };
+
+	float* AllocBrick(int brick);
+	const float* BrickSamples(int slot) const;
+
+	unsigned int m_width, m_height, m_depth;
+	float m_isolevel;
+	float m_bandWidth;
+	DensityPyramid m_pyramid;
+	int m_bricksX, m_bricksY, m_bricksZ;
+	std::vector<int> m_slots;
+	std::vector<float> m_values; // of the uniform bricks
+	std::vector<std::vector<float>> m_pages; // dense bricks' samples, kBricksPerPage to a page
+	int m_numDenseBricks;
+};
+
+// pyramid is optional; when null one is built for this call.
 std::shared_ptr<TriSoup> surfcon_CreateMeshFromDensityField(
 	float isolevel,
 	const float* densityField, 
-	unsigned int width, unsigned int height, unsigned int depth);
+	unsigned int width, unsigned int height, unsigned int depth,
+	int flags = 0,
+	const DensityPyramid* pyramid = nullptr);
+
+// Same as above for several isolevels in one pass over the field, returning a
+// mesh per isolevel in the same order. Cheaper than contouring each level on
+// its own, e.g. for nested shells or trying out isolevels.
+std::vector<std::shared_ptr<TriSoup>> surfcon_CreateMeshesFromDensityField(
+	const std::vector<float>& isolevels,
+	const float* densityField, 
+	unsigned int width, unsigned int height, unsigned int depth,
+	int flags = 0,
+	const DensityPyramid* pyramid = nullptr);
+
+// Contours only the cells in a box, serially. Meshes of neighbouring boxes 
+// meet exactly at the shared face but don't share vertices. The dual methods
+// join cells to their neighbours, so SURFCON_SurfaceNets isn't supported.
+// pyramid is optional; when null every brick is treated as active.
+std::shared_ptr<TriSoup> surfcon_CreateMeshFromDensityBox(
+	float isolevel,
+	const float* densityField, 
+	unsigned int width, unsigned int height, unsigned int depth,
+	const SurfconBox& cells,
+	int flags = 0,
+	const DensityPyramid* pyramid = nullptr);
+
+// Contours a sparse field a layer of bricks at a time, extracting only the 
+// slices each layer reads. Returns null if the field doesn't cover isolevel.
+// SURFCON_Parallel contours several layers at once.
+std::shared_ptr<TriSoup> surfcon_CreateMeshFromSparseField(
+	float isolevel,
+	const SparseDensityField& field,
+	int flags = 0);
+
+// Receives the mesh of each slab of a streamed volume, in z order. Vertices on
+// the plane between two slabs appear in both, at identical positions.
+typedef std::function<void(const TriSoup& slabMesh)> SurfconSinkFunc;
+
+// Contours a raw file of width * height * depth floats (x fastest, native byte
+// order) without loading it: the file is mapped and contoured a few slabs at a 
+// time, and the pages behind them are dropped, so volumes larger than memory 
+// work. With a sink, slab meshes are handed over as they finish and null is 
+// returned, otherwise they're welded into one mesh. Returns null on error.
+std::shared_ptr<TriSoup> surfcon_CreateMeshFromVolumeFile(
+	float isolevel,
+	const char* filename,
+	unsigned int width, unsigned int height, unsigned int depth,
+	int flags = 0,
+	const SurfconSinkFunc& sink = SurfconSinkFunc());
 
+// Controls where the adaptive contourer coarsens. Eight octree leaves are 
+// merged into one only where all of these allow it.
+struct SurfconLodParams
+{
+	SurfconLodParams() 
+		: m_viewPos(0.f), m_lodDistance(8.f), m_minFlatness(0.99f), m_maxCellSize(16) {}
+
+	vec3 m_viewPos; // in the mesh's coordinates
+	float m_lodDistance; // merged leaves are at least this many of their widths from m_viewPos
+	float m_minFlatness; // length of the mean crossing normal in a merged leaf, 1 being flat
+	int m_maxCellSize; // largest leaf, in field cells
+};
+
+// Octree dual contouring: leaf size adapts to the surface's curvature and its
+// distance from the viewer, and there are no cracks where sizes change.
+// pyramid is optional; when null one is built for this call.
+std::shared_ptr<TriSoup> surfcon_CreateAdaptiveMeshFromDensityField(
+	float isolevel,
+	const float* densityField, 
+	unsigned int width, unsigned int height, unsigned int depth,
+	const SurfconLodParams& lod,
+	const DensityPyramid* pyramid = nullptr);
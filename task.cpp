@@ -1,6 +1,8 @@
 #include <vector>
 #include <deque>
 #include <iostream>
+#include <mutex>
+#include <condition_variable>
 #include "task.hh"
 #include "common.hh"
 #include "ui.hh"
@@ -201,4 +203,3 @@ void task_RenderProgress()
 	checkGlError("task_RenderProgress");
 }
 
-
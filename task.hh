@@ -43,3 +43,9 @@ void task_Update();
 void task_AppendTask(const std::shared_ptr<Task>& task);
 void task_RenderProgress();
 
+// Runs func(0) .. func(count-1) across a set of helper threads (one per core,
+// including the caller) and blocks until they are all done. This doesn't go
+// through the task queue because that's only pumped by task_Update on the main
+// thread, and the caller is usually a task itself.
+void task_ParallelFor(int count, const std::function<void(int)>& func);
+
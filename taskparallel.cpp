@@ -0,0 +1,28 @@
+#include <atomic>
+#include <vector>
+#include "task.hh"
+#include "common.hh"
+#include "mathhelpers.hh"
+
+////////////////////////////////////////////////////////////////////////////////
+// task_ParallelFor doesn't touch the task queue or the renderer, so it lives
+// apart from them for tools that link the contourers without GL.
+void task_ParallelFor(int count, const std::function<void(int)>& func)
+{
+	if(count <= 0) return;
+
+	std::atomic<int> next(0);
+	auto runFunc = [&]() {
+		for(int i = next++; i < count; i = next++)
+			func(i);
+	};
+
+	const int numThreads = Min<int>(count, Max<int>(1, std::thread::hardware_concurrency()));
+	std::vector<std::thread> threads;
+	threads.reserve(numThreads - 1);
+	for(int i = 1; i < numThreads; ++i)
+		threads.emplace_back(runFunc);
+	runFunc();
+	for(auto& thread: threads)
+		thread.join();
+}
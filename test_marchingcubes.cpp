@@ -0,0 +1,97 @@
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <unordered_set>
+#include <vector>
+#include "common.hh"
+#include "surfcon.hh"
+#include "mesh.hh"
+
+////////////////////////////////////////////////////////////////////////////////
+// Contouring manifold test
+// Contours fields with the methods that make a manifold surface, and checks
+// each directed edge is used by at most one face; surface nets can join four
+// quads at an edge, so aren't checked. A triangle lying in a cube face is made
+// again, turned over, by the cube next door, which shows up here as an edge
+// used by four faces. Random samples make most cube faces ambiguous, so every
+// table case and the ways its loops meet are hit. Needs no GL, SDL or OpenCL;
+// run it with 'make test'.
+
+static constexpr int kDim = 40;
+
+// count of directed edges used more than once
+static int test_CountRepeatedEdges(const TriSoup& mesh)
+{
+	std::unordered_set<uint64_t> edges;
+	edges.reserve(mesh.NumFaces() * 3);
+	int repeated = 0;
+	for(int i = 0; i < mesh.NumFaces(); ++i)
+	{
+		int face[3];
+		mesh.GetFace(i, face);
+		for(int j = 0; j < 3; ++j)
+		{
+			const uint64_t edge = (uint64_t(uint32_t(face[j])) << 32) | uint32_t(face[(j + 1) % 3]);
+			if(!edges.insert(edge).second)
+				++repeated;
+		}
+	}
+	return repeated;
+}
+
+// deterministic values in [-1, 1)
+static float test_Hash(uint32_t i)
+{
+	i ^= i >> 16; i *= 0x7feb352d;
+	i ^= i >> 15; i *= 0x846ca68b;
+	i ^= i >> 16;
+	return (i >> 8) * (2.f / (1 << 24)) - 1.f;
+}
+
+int main()
+{
+	std::vector<float> randomField(kDim * kDim * kDim);
+	std::vector<float> wavyField(kDim * kDim * kDim);
+	for(int z = 0; z < kDim; ++z)
+		for(int y = 0; y < kDim; ++y)
+			for(int x = 0; x < kDim; ++x)
+			{
+				const int i = x + kDim * (y + kDim * z);
+				randomField[i] = test_Hash(i);
+				wavyField[i] = sinf(0.9f * x) * cosf(0.7f * y) + sinf(0.8f * z + 0.3f * x);
+			}
+
+	static const struct { const char* m_name; int m_flags; } kMethods[] =
+	{
+		{ "tetrahedra", 0 },
+		{ "marching cubes", SURFCON_MarchingCubes },
+	};
+	const struct { const char* m_name; const float* m_field; } fields[] =
+	{
+		{ "random", &randomField[0] },
+		{ "wavy", &wavyField[0] },
+	};
+
+	int failures = 0;
+	for(const auto& field: fields)
+	{
+		for(const auto& method: kMethods)
+		{
+			for(int parallel = 0; parallel < 2; ++parallel)
+			{
+				std::shared_ptr<TriSoup> mesh = surfcon_CreateMeshFromDensityField(0.f, field.m_field,
+					kDim, kDim, kDim, method.m_flags | (parallel ? SURFCON_Parallel : 0));
+				const int repeated = test_CountRepeatedEdges(*mesh);
+				if(repeated)
+				{
+					printf("%s field, %s%s: %d directed edges are used by more than one face\n",
+						field.m_name, method.m_name, parallel ? ", parallel" : "", repeated);
+					++failures;
+				}
+			}
+		}
+	}
+
+	printf("%s\n", failures ? "FAILED" : "passed");
+	return failures ? 1 : 0;
+}